@@ -32,6 +32,8 @@
  * 7. Add arguments to select your architecture to the help text and the
  *    argument parsing logic, both in main.c
  * 8. Add it to the list of architectures to test with ubsan in release.sh
+ * 9. Add it to jit_host_inter in jit.c, so that the JIT run mode can use it
+ *    when eambfc itself runs on that architecture.
  *
  * All of the places that need to be edited have the text __BACKENDS__ in a
  * comment that's right before them, to make it easier to find them, except for
@@ -41,6 +43,23 @@
  * ARM64 and AARCH64 identifiers out for your backend, for the sake of
  * consistency. */
 
+/* Layout of the segment used for buffered I/O, relative to its start address.
+ *
+ * The output buffer comes first, and is followed by a 64-bit count of the bytes
+ * currently stored in it, then the 64-bit index of the next unread byte in the
+ * input buffer, and the 64-bit count of bytes stored in the input buffer. The
+ * input buffer itself starts at the next 4 KiB boundary. The segment is
+ * zero-initialized when the program is loaded, so both buffers start out empty
+ * without any setup code. */
+#define OUTBUF_SZ 0x4000
+#define OUTBUF_LEN_OFFSET OUTBUF_SZ
+#define INBUF_POS_OFFSET (OUTBUF_LEN_OFFSET + 8)
+#define INBUF_LEN_OFFSET (INBUF_POS_OFFSET + 8)
+#define INBUF_OFFSET (OUTBUF_LEN_OFFSET + 0x1000)
+#define INBUF_SZ 0x4000
+/* size of the whole segment */
+#define IO_SEG_SZ (INBUF_OFFSET + INBUF_SZ)
+
 typedef const struct arch_registers {
     /* register Linux checks for system call number */
     u8 sc_num;
@@ -53,6 +72,10 @@ typedef const struct arch_registers {
      * register exists, the arch_funcs->syscall function must push this register
      * to a stack, then pop it once syscall is complete. */
     u8 bf_ptr;
+    /* a register that is not clobbered during syscalls, nor used as a scratch
+     * register by any of the arch_funcs, to keep a copy of the current tape
+     * cell in across straight-line code. Only its lowest byte is meaningful. */
+    u8 cell;
 } arch_registers;
 
 typedef const struct arch_sc_nums {
@@ -60,6 +83,7 @@ typedef const struct arch_sc_nums {
     i64 read;
     i64 write;
     i64 exit;
+    i64 madvise;
 } arch_sc_nums;
 
 typedef const struct arch_funcs {
@@ -83,14 +107,42 @@ typedef const struct arch_funcs {
      * register dst. */
     bool (*const reg_copy)(u8 dst, u8 src, sized_buf *dst_buf);
 
+    /* Write instruction/s to dst_buf to load the byte stored at address in
+     * register reg into register dst, zeroing the rest of dst. */
+    bool (*const load_byte)(u8 reg, u8 dst, sized_buf *dst_buf);
+
+    /* Write instruction/s to dst_buf to store the lowest byte of register src
+     * at address in register reg. */
+    bool (*const store_byte)(u8 reg, u8 src, sized_buf *dst_buf);
+
     /* Write the system call instruction to dst_buf. */
     bool (*const syscall)(sized_buf *dst_buf);
 
+    /* Write instruction/s to dst_buf to store the address that's offset bytes
+     * after the start of those instructions in register reg. offset is never
+     * negative, and is always within the range of 32-bit signed integers. May
+     * clobber any scratch registers the backend uses elsewhere.
+     *
+     * The same number of bytes must be written for any offset, as the
+     * instructions are first written with a placeholder offset of 0, then
+     * overwritten once the actual offset is known.
+     *
+     * Used to find the constant data used by IR_OUTPUT_CONST and IR_SET_RANGE,
+     * which is stored after the end of the code. */
+    bool (*const load_code_addr)(u8 reg, i64 offset, sized_buf *dst_buf);
+
     /* write NOP instruction/s that take the same space as the jump_zero
-     * instruction output, to be overwritten once jump_zero is called, but allow
-     * for a semi-functional program to analyze if compilation fails due to
-     * an unclosed loop. */
-    bool (*const nop_loop_open)(sized_buf *dst_buf);
+     * instruction output with the same value of short_jump, to be overwritten
+     * once jump_zero is called, but allow for a semi-functional program to
+     * analyze if compilation fails due to an unclosed loop. */
+    bool (*const nop_loop_open)(bool short_jump, sized_buf *dst_buf);
+
+    /* Write NOP instruction/s that take up exactly sz bytes to dst_buf. sz is
+     * always less than LOOP_ALIGN, and a multiple of the size of the smallest
+     * instruction for the architecture.
+     *
+     * Used to align the start of loops to LOOP_ALIGN-byte boundaries. */
+    bool (*const pad_nops)(u8 sz, sized_buf *dst_buf);
 
     /* Functions that correspond 1 to 1 with brainfuck instructions.
      * Note that the `.` and `,` instructions are implemented using more complex
@@ -98,26 +150,39 @@ typedef const struct arch_funcs {
      * argument registers to either fixed values or the contents of the bf_ptr
      * register, and calling the syscall instruction. */
 
-    /* Write instruction/s to dst_buf to jump offset bytes if the byte stored at
-     * address in register reg is set to zero.
+    /* Write instruction/s to dst_buf to jump offset bytes if the lowest byte of
+     * register reg is set to zero.
+     *
+     * If short_jump is true, use the shortest encoding available, which only
+     * needs to support offsets up to SHORT_JUMP_MAX bytes in either direction.
+     * Otherwise, use an encoding that supports the largest offsets possible.
+     * Either way, the same value of short_jump is passed to the matching
+     * nop_loop_open and jump_not_zero calls.
      *
      * Used to implement the `[` brainfuck instruction. */
-    bool (*const jump_zero)(u8 reg, i64 offset, sized_buf *dst_buf);
+    bool (*const jump_zero)(
+        u8 reg, i64 offset, bool short_jump, sized_buf *dst_buf
+    );
 
-    /* Write instruction/s to dst_buf to jump <offset> bytes if the byte stored
-     * at address in register reg is not set to zero.
+    /* Write instruction/s to dst_buf to jump <offset> bytes if the lowest byte
+     * of register reg is not set to zero. short_jump is the same as for
+     * jump_zero.
      *
      * Used to implement the `]` brainfuck instruction. */
-    bool (*const jump_not_zero)(u8 reg, i64 offset, sized_buf *dst_buf);
+    bool (*const jump_not_zero)(
+        u8 reg, i64 offset, bool short_jump, sized_buf *dst_buf
+    );
 
     /* Write instruction/s to dst_buf to increment register reg by one.
      *
-     * Used to implement the `>` brainfuck instruction. */
+     * Used to implement the `>` brainfuck instruction, and the `+` instruction
+     * on the cell register. */
     bool (*const inc_reg)(u8 reg, sized_buf *dst_buf);
 
     /* Write instruction/s to dst_buf to decrement register reg by one.
      *
-     * Used to implement the `<` brainfuck instruction. */
+     * Used to implement the `<` brainfuck instruction, and the `-` instruction
+     * on the cell register. */
     bool (*const dec_reg)(u8 reg, sized_buf *dst_buf);
 
     /* Write instruction/s to dst_buf to increment byte stored at address in
@@ -136,39 +201,197 @@ typedef const struct arch_funcs {
 
     /* Write instruction/s to dst_buf to add imm to register reg.
      *
-     * Used to implement sequences of consecutive `>` brainfuck instructions. */
+     * Used to implement sequences of consecutive `>` brainfuck instructions, as
+     * well as `+` instructions on the cell register. */
     bool (*const add_reg)(u8 reg, i64 imm, sized_buf *dst_buf);
 
     /* Write instruction/s to dst_buf to subtract imm from register reg.
      *
-     * Used to implement sequences of consecutive `<` brainfuck instructions. */
+     * Used to implement sequences of consecutive `<` brainfuck instructions, as
+     * well as `-` instructions on the cell register. */
     bool (*const sub_reg)(u8 reg, i64 imm, sized_buf *dst_buf);
 
-    /* Write instruction/s to dst_buf to add imm8 to byte stored at address in
-     * register reg.
+    /* Write instruction/s to dst_buf to add the byte stored at the address in
+     * register reg, multiplied by factor, to the byte stored offset bytes away
+     * from that address. offset is always within the range of 32-bit signed
+     * integers. May clobber any scratch registers the backend uses elsewhere,
+     * but must preserve reg.
+     *
+     * Used to implement loops like `[->+++<]`, which add a multiple of the
+     * current cell to other cells, then leave the current cell set to zero. */
+    bool (*const mul_add_byte_at)(
+        u8 reg, i64 offset, u8 factor, sized_buf *dst_buf
+    );
+
+    /* Write instruction/s to dst_buf to repeatedly add stride to register reg
+     * until the byte stored at the address in register reg is zero, without
+     * changing it at all if it already is. May clobber any scratch registers
+     * the backend uses elsewhere, but must preserve reg.
+     *
+     * Used to implement loops like `[>]`, `[<]`, and `[>>>>]`, which scan the
+     * tape for a zero cell. */
+    bool (*const scan_zero)(u8 reg, i64 stride, sized_buf *dst_buf);
+
+    /* Write instruction/s to dst_buf to add imm8 to the byte stored offset
+     * bytes away from the address in register reg. offset is always within the
+     * range of 32-bit signed integers. May clobber any scratch registers the
+     * backend uses elsewhere, but must preserve reg.
+     *
+     * Used to implement `+` and `-` instructions, as well as sequences of them,
+     * when pointer movement before them has been deferred. */
+    bool (*const add_byte_at)(u8 reg, i64 offset, i8 imm8, sized_buf *dst_buf);
+
+    /* Write instruction/s to dst_buf to set the byte stored offset bytes away
+     * from the address in register reg to 0, with the same constraints as
+     * add_byte_at.
+     *
+     * Used to implement `[-]` and `[+]` when pointer movement before them has
+     * been deferred. */
+    bool (*const zero_byte_at)(u8 reg, i64 offset, sized_buf *dst_buf);
+
+    /* Write instruction/s to dst_buf to set the byte stored offset bytes away
+     * from the address in register reg to imm8, with the same constraints as
+     * add_byte_at.
      *
-     * Used to implement sequences of consecutive `+` brainfuck instructions. */
-    bool (*const add_byte)(u8 reg, i8 imm8, sized_buf *dst_buf);
+     * Used to implement IR_SET, for cells known to be set to a specific value
+     * at compile time. */
+    bool (*const set_byte_at)(u8 reg, i64 offset, u8 imm8, sized_buf *dst_buf);
 
-    /* Write instruction/s to dst_buf to subtract imm8 from byte stored at
-     * address in register reg.
+    /* Write instruction/s to dst_buf to set the count bytes starting offset
+     * bytes away from the address in register reg to 0, with the same
+     * constraints as add_byte_at. count is from 2 to 32.
      *
-     * Used to implement sequences of consecutive `-` brainfuck instructions. */
-    bool (*const sub_byte)(u8 reg, i8 imm8, sized_buf *dst_buf);
+     * Used to implement IR_ZERO_RANGE, for runs of cells cleared one after
+     * another, like `[-]>[-]>[-]>[-]`. */
+    bool (*const zero_bytes_at)(
+        u8 reg, i64 offset, u8 count, sized_buf *dst_buf
+    );
 
-    /* Write instruction/s to dst_buf to set the value of byte stored at address
-     * in register reg to 0.
+    /* Write instruction/s to dst_buf to copy the count bytes starting at the
+     * address in register src to the ones starting offset bytes away from the
+     * address in register reg, with the same constraints as add_byte_at. count
+     * is from 2 to 32, and src is never reg.
      *
-     * Used to implement the `[-]` and `[+]` brainfuck instruction sequences. */
-    bool (*const zero_byte)(u8 reg, sized_buf *dst_buf);
+     * Used to implement IR_SET_RANGE, for runs of cells set to constant values
+     * one after another, like `>[-]++>[-]+++`, with src set to the address of
+     * the values within the constant data stored after the code. */
+    bool (*const copy_bytes_at)(
+        u8 reg, i64 offset, u8 src, u8 count, sized_buf *dst_buf
+    );
+
+    /* Write instruction/s to dst_buf to add 1 to the 64-bit integer at the
+     * address addr, in the target's byte order. Only scratch registers the
+     * backend uses elsewhere may be clobbered.
+     *
+     * Used when profiling, at the start of each loop's body, to count how many
+     * times it runs. */
+    bool (*const inc_counter)(i64 addr, sized_buf *dst_buf);
+
+    /* functions used for buffered I/O
+     *
+     * io_addr is the address of the buffered I/O segment, laid out as described
+     * by the *BUF* macros at the top of this file. These functions may clobber
+     * the system call and argument registers, as well as any scratch registers
+     * the backend uses elsewhere, but must preserve reg. */
+
+    /* Write instruction/s to dst_buf to append the byte stored at the address
+     * in register reg to the output buffer, then write the buffer's contents to
+     * stdout and mark it as empty if that filled it up.
+     *
+     * Used to implement the `.` brainfuck instruction when buffering I/O. */
+    bool (*const buffered_write)(u8 reg, i64 io_addr, sized_buf *dst_buf);
+
+    /* Write instruction/s to dst_buf to write the contents of the output buffer
+     * to stdout and mark it as empty, if it isn't already empty.
+     *
+     * Used before exiting when buffering I/O. */
+    bool (*const flush_output)(i64 io_addr, sized_buf *dst_buf);
+
+    /* Write instruction/s to dst_buf to store the next unread byte in the input
+     * buffer in the byte at the address in register reg. If the input buffer
+     * has no unread bytes left, first write out the contents of the output
+     * buffer as flush_output does, then try to refill the input buffer with a
+     * single read system call. If that reads nothing, leave the byte as is.
+     *
+     * Used to implement the `,` brainfuck instruction when buffering input. */
+    bool (*const buffered_read)(u8 reg, i64 io_addr, sized_buf *dst_buf);
+
+    /* functions used for the JIT run mode, where the machine code is a
+     * function called from within eambfc, rather than a standalone program. */
+
+    /* Write instruction/s to dst_buf to save any registers that the calling
+     * convention of the target platform's C ABI expects to be preserved and
+     * the rest of the code can modify, then set up any register that the rest
+     * of the code assumes the initial value of.
+     *
+     * Used at the start of the code, before the bf_ptr register is set. */
+    bool (*const jit_prologue)(sized_buf *dst_buf);
+
+    /* Write instruction/s to dst_buf to restore the registers saved by
+     * jit_prologue, then return to the caller.
+     *
+     * Used instead of the exit system call at the end of the code. */
+    bool (*const jit_epilogue)(sized_buf *dst_buf);
 } arch_funcs;
 
+/* The most bytes of machine code that the arch_funcs used to compile each kind
+ * of EAMBFC IR instruction can write, for any arguments. These are used to
+ * reserve enough space for the machine code up front, before compiling it, so
+ * they're allowed to be an overestimate, but should not be an underestimate.
+ *
+ * If an instruction can be compiled more than one way, the size of the largest
+ * applies. */
+typedef const struct arch_max_sizes {
+    /* inc_reg, dec_reg, add_reg, or sub_reg, for IR_MOVE */
+    u8 move;
+    /* inc_reg, dec_reg, add_reg or sub_reg with an immediate below 0x100, or
+     * add_byte_at, for IR_ADD */
+    u8 add;
+    /* set_reg with an immediate of 0, or zero_byte_at, for IR_ZERO */
+    u8 zero;
+    /* set_reg with an immediate below 0x100, or set_byte_at, for IR_SET */
+    u8 set;
+    /* zero_bytes_at, for IR_ZERO_RANGE */
+    u8 zero_range;
+    /* load_code_addr followed by copy_bytes_at, for IR_SET_RANGE */
+    u8 set_range;
+    /* mul_add_byte_at, for IR_MUL_ADD */
+    u8 mul_add;
+    /* scan_zero, for IR_SCAN */
+    u8 scan;
+    /* nop_loop_open, jump_zero, or jump_not_zero, for IR_LOOP_OPEN or
+     * IR_LOOP_CLOSE, with short_jump set to false */
+    u8 jump;
+    /* inc_counter, which follows the jump for IR_LOOP_OPEN when profiling */
+    u8 counter;
+    /* the set_reg, reg_copy, and syscall sequence for unbuffered IR_OUTPUT or
+     * IR_INPUT, or buffered_write or buffered_read for buffered ones */
+    u8 io;
+    /* the load_code_addr, set_reg, and syscall sequence for IR_OUTPUT_CONST,
+     * preceded by flush_output if I/O is buffered, not counting the constant
+     * data itself */
+    u8 output_const;
+    /* store_byte followed by load_byte, which can come before any of the
+     * above to write back or load the copy of the current cell kept in the
+     * cell register */
+    u8 cell;
+} arch_max_sizes;
+
 /* This struct contains all architecture-specific information needed for eambfc,
  * and can be passed as an argument to functions. */
 typedef const struct arch_inter {
     arch_funcs *FUNCS;
     arch_sc_nums *SC_NUMS;
     arch_registers *REGS;
+    arch_max_sizes *MAX_SIZES;
+    /* The largest distance in bytes between the start of the jump_zero for a
+     * loop and the start of the jump_not_zero for the same loop, for which
+     * short_jump can be set to true. */
+    i64 SHORT_JUMP_MAX;
+    /* The boundary in bytes to align the start of the body of innermost loops
+     * to, if aligning loops. Must be a power of 2 no larger than 256, as the
+     * code is only guaranteed to be loaded at a 256-byte boundary. */
+    u8 LOOP_ALIGN;
     /* CPU flags that should be set for executables for this architecture. */
     u32 FLAGS;
     /* The 16-bit EM_* identifier for the architecture, from elf.h */
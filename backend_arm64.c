@@ -5,22 +5,18 @@
  *
  * Unlike the x86_64 backend, this is based on the Rust implementation, rather
  * than the other way around. */
+/* C99 */
+#include <stddef.h> /* NULL */
 /* internal */
 #include "arch_inter.h" /* arch_{registers, sc_nums, funcs, inter} */
 #include "compat/elf.h" /* EM_X86_64, ELFDATA2LSB */
 #include "config.h" /* EAMBFC_TARGET_ARM64 */
 #include "err.h" /* basic_err */
+#include "serialize.h" /* serialize32le */
 #include "types.h" /* [iu]{8,16,32,64}, bool, off_t, size_t, UINT64_C */
-#include "util.h" /* append_obj */
+#include "util.h" /* append_obj, reserve_obj, commit_obj */
 #if EAMBFC_TARGET_ARM64
 
-/* mark a series of bytes within a u8 array as being a single instruction,
- * mostly to prevent automated code formatting from splitting them up */
-#define INSTRUCTION(...) __VA_ARGS__
-
-/* padding bytes to be replaced with an instruction within a u8 array. */
-#define PAD_INSTRUCTION 0x00, 0x00, 0x00, 0x00
-
 /* in MOVK, MOVZ, and MOVN instructions, these correspond to the bits used
  * within the 3rd byte to indicate shift level. */
 typedef enum {
@@ -42,6 +38,16 @@ typedef enum {
     A64_MT_INVERT = 0x92
 } mov_type;
 
+/* Write the 32-bit instruction instr to dst_buf, serializing it directly into
+ * the space reserved for it. */
+static bool append_instr(u32 instr, sized_buf *dst_buf) {
+    u8 *dst = reserve_obj(dst_buf, 4);
+    if (dst == NULL) return false;
+    serialize32le(instr, dst);
+    commit_obj(dst_buf, 4);
+    return true;
+}
+
 /* For an instruction that takes 2 registers, OR their bit values into the
  * appropriate parts of the machine code bytes in dst. */
 static void inject_reg_operands(u8 rt, u8 rn, u8 dst[4]) {
@@ -155,21 +161,66 @@ static bool reg_copy(u8 dst, u8 src, sized_buf *dst_buf) {
     return append_obj(dst_buf, (u8[]){0xe0 | dst, 0x01, src, 0xaa}, 4);
 }
 
+/* LDRB w.dst, x.reg */
+static bool load_byte(u8 reg, u8 dst, sized_buf *dst_buf) {
+    u8 instr_bytes[4];
+    load_from_byte(reg, dst, instr_bytes);
+    return append_obj(dst_buf, &instr_bytes, 4);
+}
+
+/* STRB w.src, x.reg */
+static bool store_byte(u8 reg, u8 src, sized_buf *dst_buf) {
+    u8 instr_bytes[4];
+    store_to_byte(reg, src, instr_bytes);
+    return append_obj(dst_buf, &instr_bytes, 4);
+}
+
 /* SVC 0 */
 static bool syscall(sized_buf *dst_buf) {
     return append_obj(dst_buf, (u8[]){0x01, 0x00, 0x00, 0xd4}, 4);
 }
 
+/* ADR x.reg, 0; MOVZ x.aux, offset[0:16]; MOVK x.aux, offset[16:32], lsl 16;
+ * ADD x.reg, x.reg, x.aux
+ * ADR alone can only reach 1 MiB either way, so it just gets the address of
+ * itself, and the offset is added separately. */
+static bool load_code_addr(u8 reg, i64 offset, sized_buf *dst_buf) {
+    u8 aux = aux_reg(reg);
+    return append_instr(0x10000000 | reg, dst_buf) &&
+           append_instr(0xd2800000 | ((offset & 0xffff) << 5) | aux, dst_buf) &&
+           append_instr(
+               0xf2a00000 | (((offset >> 16) & 0xffff) << 5) | aux, dst_buf
+           ) &&
+           append_instr(0x8b000000 | (aux << 16) | (reg << 5) | reg, dst_buf);
+}
+
 /* NOP; NOP; NOP */
-#define NOP 0x1f, 0x20, 0x03, 0xdf
+#define NOP 0x1f, 0x20, 0x03, 0xd5
 
-static bool nop_loop_open(sized_buf *dst_buf) {
+static bool nop_loop_open(bool short_jump, sized_buf *dst_buf) {
     u8 instr_bytes[12] = {NOP, NOP, NOP};
-    return append_obj(dst_buf, &instr_bytes, 12);
+    return append_obj(dst_buf, &instr_bytes, short_jump ? 8 : 12);
 }
 
-/* LDRB w.aux, x.reg; TST w.aux, 0xff; B.cond offset */
-static bool branch_cond(u8 reg, i64 offset, sized_buf *dst_buf, u8 cond) {
+/* times (sz / 4) NOP */
+static bool pad_nops(u8 sz, sized_buf *dst_buf) {
+    for (; sz >= 4; sz -= 4) {
+        if (!append_instr(0xd503201f, dst_buf)) return false;
+    }
+    return true;
+}
+
+/* B.EQ and B.NE differ only in their lowest condition bit */
+typedef enum { A64_COND_EQ = 0x0, A64_COND_NE = 0x1 } cond_code;
+
+/* if short_jump is true: TST w.reg, 0xff; B.cond offset
+ * otherwise: TST w.reg, 0xff; B.!cond 8; B offset
+ *
+ * The condition is inverted to skip over the B when it's not met, as B can
+ * jump up to 128 MiB either way, unlike the 1 MiB that B.cond can. */
+static bool branch_cond(
+    u8 reg, i64 offset, bool short_jump, sized_buf *dst_buf, cond_code cond
+) {
     if ((offset % 4) != 0) {
         basic_err(
             "INVALID_JUMP_ADDRESS",
@@ -177,41 +228,42 @@ static bool branch_cond(u8 reg, i64 offset, sized_buf *dst_buf, u8 cond) {
         );
         return false;
     }
-    /* use some bit shifts to check if the value is in range
-     * (19 immediate bits are used, but as it must be a multiple of 4, it treats
-     * them as though they're followed by an implicit 0b00, so it needs to fit
-     * within the range of possible 21-bit 2's complement values. */
-    if ((offset < -0x200000 || offset > 0x1fffff)) {
+    /* offset is from the end of the first instruction, so add 1 to the number
+     * of instructions to jump by to make up for it. Short jumps use 19
+     * immediate bits in the B.cond, and long jumps use 26 in the B. */
+    i64 imm = 1 + offset / 4;
+    i64 limit = short_jump ? 0x40000 : 0x2000000;
+    if (imm < -limit || imm >= limit) {
         basic_err(
             "JUMP_TOO_LONG",
-            "offset is outside the range of possible 21-bit signed values"
+            short_jump ? "offset is outside the range of 21-bit signed values"
+                       : "offset is outside the range of 28-bit signed values"
         );
         return false;
     }
-    u32 off_val = 1 + ((((u32)offset) >> 2) & 0x7fffff);
-    u8 aux = aux_reg(reg);
-    u8 test_and_branch[12] = {
-        /* after inject_reg_operands, will be LDRB w.aux, x.reg */
-        PAD_INSTRUCTION,
-        /* TST x.reg, 0xff */
-        INSTRUCTION(0x1f | aux << 5, (aux >> 3) | 0x1c, 0x40, 0xf2),
-        /* B.cond offset */
-        INSTRUCTION(cond | (off_val << 5), off_val >> 3, off_val >> 11, 0x54),
-    };
-    load_from_byte(reg, aux, test_and_branch);
-    return append_obj(dst_buf, test_and_branch, 12);
+    /* TST w.reg, 0xff (an alias of ANDS wzr, w.reg, 0xff) */
+    if (!append_instr(0x72001c1f | (reg << 5), dst_buf)) return false;
+    if (short_jump) {
+        u32 b_cond = 0x54000000 | ((imm & 0x7ffff) << 5) | cond;
+        return append_instr(b_cond, dst_buf);
+    }
+    /* flip between B.EQ and B.NE, and skip 2 instructions */
+    if (!append_instr(0x54000000 | (2 << 5) | (cond ^ 1), dst_buf)) {
+        return false;
+    }
+    return append_instr(0x14000000 | (imm & 0x3ffffff), dst_buf);
 }
 
-/* LDRB w.aux, x.reg; TST w.aux, 0xff; B.NE offset */
-static bool jump_not_zero(u8 reg, i64 offset, sized_buf *dst_buf) {
-    /* 1 is the not zero / not equal condition code */
-    return branch_cond(reg, offset, dst_buf, 1);
+/* TST w.reg, 0xff; B.NE offset (or the long equivalent) */
+static bool jump_not_zero(
+    u8 reg, i64 offset, bool short_jump, sized_buf *dst_buf
+) {
+    return branch_cond(reg, offset, short_jump, dst_buf, A64_COND_NE);
 }
 
-/* LDRB w.aux, x.reg; TST w.aux, 0xff; B.E offset */
-static bool jump_zero(u8 reg, i64 offset, sized_buf *dst_buf) {
-    /* 0 is the zero / equal condition code */
-    return branch_cond(reg, offset, dst_buf, 0);
+/* TST w.reg, 0xff; B.EQ offset (or the long equivalent) */
+static bool jump_zero(u8 reg, i64 offset, bool short_jump, sized_buf *dst_buf) {
+    return branch_cond(reg, offset, short_jump, dst_buf, A64_COND_EQ);
 }
 
 static bool add_sub_imm(
@@ -317,49 +369,468 @@ static bool dec_byte(u8 reg, sized_buf *dst_buf) {
     return inc_dec_byte(reg, dst_buf, &dec_reg);
 }
 
-/* similar to add_sub_reg, but operating on an auxiliary register, after loading
- * from byte and before restoring to that byte, much like inc_dec_byte */
-static bool add_sub_byte(u8 reg, i8 imm8, arith_op op, sized_buf *dst_buf) {
-    u8 imm = imm8;
+/* x.reg is temporarily moved to the target cell, and the current cell is loaded
+ * relative to it from there, as moving x.reg can clobber x17 if offset is large
+ * enough. */
+static bool mul_add_byte_at(
+    u8 reg, i64 offset, u8 factor, sized_buf *dst_buf
+) {
     u8 aux = aux_reg(reg);
-    u8 instr_bytes[12] = {
-        PAD_INSTRUCTION,
-        /* set middle instruction to (ADD|SUB) x.aux, x.aux, imm */
-        INSTRUCTION(aux | (aux << 5), (imm << 2) | (aux >> 3), imm >> 6, op),
-        PAD_INSTRUCTION,
-    };
-    /* load the byte in address stored in x.reg into x.aux */
-    load_from_byte(reg, aux, instr_bytes);
-    /* store the lowest byte in x.aux back to the address in x.reg */
-    store_to_byte(reg, aux, &(instr_bytes[8]));
-    return append_obj(dst_buf, &instr_bytes, 12);
+    u8 aux2 = aux_reg(aux);
+    u8 instr_bytes[4];
+    /* move x.reg to the target cell */
+    if (!((offset < 0) ? sub_reg(reg, -offset, dst_buf)
+                       : add_reg(reg, offset, dst_buf))) {
+        return false;
+    }
+    if (!set_reg(aux, -offset, dst_buf)) return false;
+    /* LDRB w.aux, [x.reg, x.aux] */
+    if (!append_instr(0x38606800 | (aux << 16) | (reg << 5) | aux, dst_buf)) {
+        return false;
+    }
+    if (factor != 1) {
+        /* MOVZ w.aux2, factor */
+        if (!append_instr(0x52800000 | (factor << 5) | aux2, dst_buf)) {
+            return false;
+        }
+        /* MUL w.aux, w.aux, w.aux2 */
+        u32 mul = 0x1b007c00 | (aux2 << 16) | (aux << 5) | aux;
+        if (!append_instr(mul, dst_buf)) return false;
+    }
+    load_from_byte(reg, aux2, instr_bytes);
+    if (!append_obj(dst_buf, &instr_bytes, 4)) return false;
+    /* ADD w.aux2, w.aux2, w.aux */
+    if (!append_instr(0x0b000000 | (aux << 16) | (aux2 << 5) | aux2, dst_buf)) {
+        return false;
+    }
+    store_to_byte(reg, aux2, instr_bytes);
+    if (!append_obj(dst_buf, &instr_bytes, 4)) return false;
+    /* move x.reg back to where it started */
+    return (offset < 0) ? add_reg(reg, -offset, dst_buf)
+                        : sub_reg(reg, offset, dst_buf);
 }
 
-/* now, the last few thin wrapper functions */
+/* write an instruction to dst_buf to load (if load is true) or store (if it's
+ * false) the lowest byte of w.rt from or to the address offset bytes away from
+ * the one in x.reg, using an immediate offset if it fits, or x.aux if not. */
+static bool byte_at(
+    bool load, u8 reg, i64 offset, u8 rt, u8 aux, sized_buf *dst_buf
+) {
+    u32 instr;
+    if (offset >= 0 && offset <= 0xfff) {
+        /* (LDRB|STRB) w.rt, [x.reg, offset] */
+        instr = 0x39000000 | (offset << 10);
+    } else if (offset >= -0x100 && offset < 0) {
+        /* (LDURB|STURB) w.rt, [x.reg, offset] */
+        instr = 0x38000000 | ((offset & 0x1ff) << 12);
+    } else {
+        if (!set_reg(aux, offset, dst_buf)) return false;
+        /* (LDRB|STRB) w.rt, [x.reg, x.aux] */
+        instr = 0x38206800 | (aux << 16);
+    }
+    if (load) instr |= 0x400000;
+    return append_instr(instr | (reg << 5) | rt, dst_buf);
+}
 
-static bool add_byte(u8 reg, i8 imm8, sized_buf *dst_buf) {
-    return add_sub_byte(reg, imm8, A64_OP_ADD, dst_buf);
+static bool add_byte_at(u8 reg, i64 offset, i8 imm8, sized_buf *dst_buf) {
+    u8 aux = aux_reg(reg);
+    u8 aux2 = aux_reg(aux);
+    if (!byte_at(true, reg, offset, aux, aux2, dst_buf)) return false;
+    /* ADD w.aux, w.aux, imm8 */
+    if (!append_instr(
+            0x11000000 | ((u8)imm8 << 10) | (aux << 5) | aux, dst_buf
+        )) {
+        return false;
+    }
+    /* x.aux2 still holds the offset if it was needed for the load */
+    return byte_at(false, reg, offset, aux, aux2, dst_buf);
 }
 
-static bool sub_byte(u8 reg, i8 imm8, sized_buf *dst_buf) {
-    return add_sub_byte(reg, imm8, A64_OP_SUB, dst_buf);
+static bool zero_byte_at(u8 reg, i64 offset, sized_buf *dst_buf) {
+    /* store wzr */
+    return byte_at(false, reg, offset, 31, aux_reg(reg), dst_buf);
 }
 
-/* a function to zero out a memory address. It sets an auxiliary register to 0,
- * then stores its least significant byte in the address in reg. */
-static bool zero_byte(u8 reg, sized_buf *dst_buf) {
+static bool set_byte_at(u8 reg, i64 offset, u8 imm8, sized_buf *dst_buf) {
+    /* store wzr if it's zero, so that there's nothing to set first */
+    if (imm8 == 0) return zero_byte_at(reg, offset, dst_buf);
     u8 aux = aux_reg(reg);
-    if (!set_reg(aux, 0, dst_buf)) return false;
+    /* MOVZ w.aux, imm8 */
+    if (!append_instr(0x52800000 | (imm8 << 5) | aux, dst_buf)) return false;
+    return byte_at(false, reg, offset, aux, aux_reg(aux), dst_buf);
+}
+
+/* Runs of bytes are set one chunk at a time, using the largest of 1, 2, 4, 8,
+ * or 16 bytes that isn't larger than the run. If the run isn't a multiple of
+ * that size, the last chunk is moved back to end at the end of the run, so that
+ * it overlaps the one before it, so runs of up to 32 bytes take 2 at most. */
+static u8 chunk_size(u8 count) {
+    u8 size = 16;
+    while (size > count) size >>= 1;
+    return size;
+}
+
+/* move *pos from one chunk of a run of count bytes to the next one, returning
+ * false if there isn't one */
+static bool next_chunk(u8 *pos, u8 size, u8 count) {
+    if (*pos + size >= count) return false;
+    *pos += size;
+    if (*pos + size > count) *pos = count - size;
+    return true;
+}
+
+/* write an instruction to dst_buf to load (if load is true) or store (if it's
+ * false) a size-byte chunk of w.rt or x.rt (or q.rt for 16-byte chunks) from or
+ * to the address imm9 bytes away from the one in x.rn. */
+static bool move_chunk(
+    bool load, u8 size, u8 rt, u8 rn, i64 imm9, sized_buf *dst_buf
+) {
+    u32 instr;
+    if (size == 16) {
+        /* (LDUR|STUR) q.rt, [x.rn, imm9] */
+        instr = 0x3c800000;
+    } else {
+        /* (LDUR|STUR)(B|H|) (w|x).rt, [x.rn, imm9] */
+        u32 log2 = (size == 8) ? 3 : size >> 1;
+        instr = 0x38000000 | (log2 << 30);
+    }
+    if (load) instr |= 0x400000;
+    instr |= ((imm9 & 0x1ff) << 12) | (rn << 5) | rt;
+    return append_instr(instr, dst_buf);
+}
+
+/* set *base to a register from which a run of count bytes offset bytes away
+ * from x.reg can be reached with 9-bit signed immediates, and *imm to the
+ * immediate for its first byte. That's x.reg itself if it's close enough, and
+ * otherwise, x.aux is set to the address of the first byte. */
+static bool range_base(
+    u8 reg, i64 offset, u8 count, u8 aux, u8 *base, i64 *imm, sized_buf *dst_buf
+) {
+    if (offset >= -0x100 && offset + count <= 0x100) {
+        *base = reg;
+        *imm = offset;
+        return true;
+    }
+    *base = aux;
+    *imm = 0;
+    if (offset > 0 && offset <= 0xfff) {
+        /* ADD x.aux, x.reg, offset */
+        return append_instr(
+            0x91000000 | (offset << 10) | (reg << 5) | aux, dst_buf
+        );
+    } else if (offset < 0 && offset >= -0xfff) {
+        /* SUB x.aux, x.reg, -offset */
+        return append_instr(
+            0xd1000000 | (-offset << 10) | (reg << 5) | aux, dst_buf
+        );
+    }
+    /* ADD x.aux, x.reg, x.aux */
+    return set_reg(aux, offset, dst_buf) &&
+           append_instr(0x8b000000 | (aux << 16) | (reg << 5) | aux, dst_buf);
+}
+
+static bool zero_bytes_at(u8 reg, i64 offset, u8 count, sized_buf *dst_buf) {
+    u8 size = chunk_size(count);
+    u8 pos = 0;
+    u8 base;
+    i64 imm;
+    if (!range_base(reg, offset, count, aux_reg(reg), &base, &imm, dst_buf)) {
+        return false;
+    }
+    /* MOVI v0.2d, 0 */
+    if (size == 16 && !append_instr(0x6f00e400, dst_buf)) return false;
+    /* store q0 for 16-byte chunks, or xzr or wzr for the rest */
+    u8 rt = (size == 16) ? 0 : 31;
+    do {
+        if (!move_chunk(false, size, rt, base, imm + pos, dst_buf)) {
+            return false;
+        }
+    } while (next_chunk(&pos, size, count));
+    return true;
+}
+
+static bool copy_bytes_at(
+    u8 reg, i64 offset, u8 src, u8 count, sized_buf *dst_buf
+) {
+    u8 size = chunk_size(count);
+    u8 pos = 0;
+    u8 aux = aux_reg(reg);
+    u8 base;
+    i64 imm;
+    if (!range_base(reg, offset, count, aux, &base, &imm, dst_buf)) {
+        return false;
+    }
+    /* move 16-byte chunks through q0, and the rest through x.aux2 */
+    u8 rt = (size == 16) ? 0 : aux_reg(aux);
+    do {
+        if (!move_chunk(true, size, rt, src, pos, dst_buf) ||
+            !move_chunk(false, size, rt, base, imm + pos, dst_buf)) {
+            return false;
+        }
+    } while (next_chunk(&pos, size, count));
+    return true;
+}
+
+static bool inc_counter(i64 addr, sized_buf *dst_buf) {
+    /* x17 holds the address, and x16 the counter */
+    return set_reg(17, addr, dst_buf) &&
+           /* LDR x16, [x17] */
+           append_instr(0xf9400000 | (17 << 5) | 16, dst_buf) &&
+           /* ADD x16, x16, 1 */
+           append_instr(0x91000400 | (16 << 5) | 16, dst_buf) &&
+           /* STR x16, [x17] */
+           append_instr(0xf9000000 | (17 << 5) | 16, dst_buf);
+}
+
+/* write the 4 instructions to dst to load the 16-byte block at the address in
+ * x.addr into q0, and set x.mask to a mask with 4 bits set for each zero byte
+ * in that block, with the first byte in the lowest bits. */
+static void scan_block(u8 addr, u8 mask, u32 *dst) {
+    /* LDR q0, [x.addr] */
+    dst[0] = 0x3dc00000 | (addr << 5);
+    /* CMEQ v0.16b, v0.16b, 0 */
+    dst[1] = 0x4e209800;
+    /* SHRN v0.8b, v0.8h, 4 */
+    dst[2] = 0x0f0c8400;
+    /* FMOV x.mask, d0 */
+    dst[3] = 0x9e660000 | mask;
+}
+
+/* For strides of 1 and -1, 16 bytes are checked at a time with NEON, which is
+ * part of the baseline ARMv8-A instruction set. The 16-byte blocks are aligned,
+ * so they never cross into a page that the bytes being checked aren't in. Each
+ * block is compared to zero and narrowed into a 64-bit mask, and the leading or
+ * trailing zero bits of that mask are used to find which byte was zero. Bits
+ * for bytes in the first block which are on the wrong side of the starting
+ * point are shifted out. */
+static bool scan_zero(u8 reg, i64 stride, sized_buf *dst_buf) {
+    u8 aux = aux_reg(reg);
+    u8 aux2 = aux_reg(aux);
+    u32 instrs[19];
     u8 instr_bytes[4];
-    store_to_byte(reg, aux, instr_bytes);
-    return append_obj(dst_buf, &instr_bytes, 4);
+    u8 i;
+    if (stride == 1 || stride == -1) {
+        /* AND x.aux2, x.reg, -16 */
+        instrs[0] = 0x927cec00 | (reg << 5) | aux2;
+        scan_block(aux2, aux, &(instrs[1]));
+        if (stride == 1) {
+            /* LSL x.aux2, x.reg, 2; LSR x.aux, x.aux, x.aux2 */
+            instrs[5] = 0xd37ef400 | (reg << 5) | aux2;
+            instrs[6] = 0x9ac02400 | (aux2 << 16) | (aux << 5) | aux;
+            /* CBNZ x.aux, found */
+            instrs[7] = 0xb5000000 | (9 << 5) | aux;
+            /* AND x.aux2, x.reg, -16 */
+            instrs[8] = instrs[0];
+            /* loop: ADD x.aux2, x.aux2, 16 */
+            instrs[9] = 0x91004000 | (aux2 << 5) | aux2;
+            scan_block(aux2, aux, &(instrs[10]));
+            /* CBZ x.aux, loop */
+            instrs[14] = 0xb4000000 | ((-5 & 0x7ffff) << 5) | aux;
+            /* MOV x.reg, x.aux2 */
+            instrs[15] = 0xaa0003e0 | (aux2 << 16) | reg;
+            /* found: RBIT x.aux, x.aux; CLZ x.aux, x.aux */
+            instrs[16] = 0xdac00000 | (aux << 5) | aux;
+            instrs[17] = 0xdac01000 | (aux << 5) | aux;
+            /* ADD x.reg, x.reg, x.aux, LSR 2 */
+            instrs[18] = 0x8b400800 | (aux << 16) | (reg << 5) | reg;
+        } else {
+            /* MVN x.aux2, x.reg; LSL x.aux2, x.aux2, 2 */
+            instrs[5] = 0xaa2003e0 | (reg << 16) | aux2;
+            instrs[6] = 0xd37ef400 | (aux2 << 5) | aux2;
+            /* LSL x.aux, x.aux, x.aux2 */
+            instrs[7] = 0x9ac02000 | (aux2 << 16) | (aux << 5) | aux;
+            /* CBNZ x.aux, found */
+            instrs[8] = 0xb5000000 | (9 << 5) | aux;
+            /* AND x.aux2, x.reg, -16 */
+            instrs[9] = instrs[0];
+            /* loop: SUB x.aux2, x.aux2, 16 */
+            instrs[10] = 0xd1004000 | (aux2 << 5) | aux2;
+            scan_block(aux2, aux, &(instrs[11]));
+            /* CBZ x.aux, loop */
+            instrs[15] = 0xb4000000 | ((-5 & 0x7ffff) << 5) | aux;
+            /* ADD x.reg, x.aux2, 15 */
+            instrs[16] = 0x91003c00 | (aux2 << 5) | reg;
+            /* found: CLZ x.aux, x.aux */
+            instrs[17] = 0xdac01000 | (aux << 5) | aux;
+            /* SUB x.reg, x.reg, x.aux, LSR 2 */
+            instrs[18] = 0xcb400800 | (aux << 16) | (reg << 5) | reg;
+        }
+        for (i = 0; i < 19; i++) {
+            if (!append_instr(instrs[i], dst_buf)) return false;
+        }
+        return true;
+    }
+    /* For other strides, fall back to a tight loop, one cell at a time. */
+    /* B test (will replace the jump offset) */
+    size_t start = dst_buf->sz;
+    if (!append_instr(0x14000000, dst_buf)) return false;
+    /* loop: ADD x.reg, x.reg, stride */
+    if (!((stride < 0) ? sub_reg(reg, -stride, dst_buf)
+                       : add_reg(reg, stride, dst_buf))) {
+        return false;
+    }
+    i64 offset = (dst_buf->sz - start) / 4;
+    serialize32le(0x14000000 | offset, &(((u8 *)dst_buf->buf)[start]));
+    /* test: LDRB w.aux, x.reg */
+    load_from_byte(reg, aux, instr_bytes);
+    if (!append_obj(dst_buf, &instr_bytes, 4)) return false;
+    /* CBNZ w.aux, loop */
+    return append_instr(0x35000000 | ((-offset & 0x7ffff) << 5) | aux, dst_buf);
+}
+
+/* Both buffered output functions keep the address of the output buffer in x1
+ * and the number of bytes stored in it in x2, as those are the registers the
+ * write system call expects them in. */
+
+/* LDR x2, [x1, OUTBUF_LEN_OFFSET] */
+#define LOAD_OUTBUF_LEN (0xf9400022 | ((OUTBUF_LEN_OFFSET / 8) << 10))
+/* STR x.rt, [x1, OUTBUF_LEN_OFFSET] */
+#define STORE_OUTBUF_LEN(rt) (0xf9000020 | ((OUTBUF_LEN_OFFSET / 8) << 10) | rt)
+
+/* number of instructions in the sequence written by flush_tail */
+#define FLUSH_TAIL_LEN 4
+
+/* write FLUSH_TAIL_LEN instructions to dst to write x2 bytes from x1 to stdout,
+ * then set the stored byte count to zero. */
+static void flush_tail(u8 *dst) {
+    /* MOVZ x8, 64 (write system call number) */
+    serialize32le(0xd2800808, dst);
+    /* MOVZ x0, 1 (stdout file descriptor) */
+    serialize32le(0xd2800020, &(dst[4]));
+    /* SVC 0 */
+    serialize32le(0xd4000001, &(dst[8]));
+    /* STR xzr, [x1, OUTBUF_LEN_OFFSET] */
+    serialize32le(STORE_OUTBUF_LEN(31), &(dst[12]));
+}
+
+static bool buffered_write(u8 reg, i64 io_addr, sized_buf *dst_buf) {
+    u8 aux = aux_reg(reg);
+    u8 instr_bytes[(7 + FLUSH_TAIL_LEN) * 4];
+    if (!set_reg(1, io_addr, dst_buf)) return false;
+    serialize32le(LOAD_OUTBUF_LEN, instr_bytes);
+    /* LDRB w.aux, x.reg */
+    load_from_byte(reg, aux, &(instr_bytes[4]));
+    /* STRB w.aux, [x1, x2] */
+    serialize32le(0x38226820 | aux, &(instr_bytes[8]));
+    /* ADD x2, x2, 1 */
+    serialize32le(0x91000442, &(instr_bytes[12]));
+    serialize32le(STORE_OUTBUF_LEN(2), &(instr_bytes[16]));
+    /* CMP x2, OUTBUF_SZ (OUTBUF_SZ is a multiple of 4 KiB, so it's shifted) */
+    serialize32le(0xf140005f | ((OUTBUF_SZ >> 12) << 10), &(instr_bytes[20]));
+    /* B.NE past the flush */
+    serialize32le(0x54000001 | ((FLUSH_TAIL_LEN + 1) << 5), &(instr_bytes[24]));
+    flush_tail(&(instr_bytes[28]));
+    return append_obj(dst_buf, &instr_bytes, sizeof(instr_bytes));
+}
+
+/* number of instructions in the sequence written by flush_body */
+#define FLUSH_LEN (2 + FLUSH_TAIL_LEN)
+
+/* write FLUSH_LEN instructions to dst to write out the contents of the output
+ * buffer at the address in x1, if it is not empty. */
+static void flush_body(u8 *dst) {
+    serialize32le(LOAD_OUTBUF_LEN, dst);
+    /* CBZ x2, past the flush */
+    serialize32le(0xb4000002 | ((FLUSH_TAIL_LEN + 1) << 5), &(dst[4]));
+    flush_tail(&(dst[8]));
+}
+
+static bool flush_output(i64 io_addr, sized_buf *dst_buf) {
+    u8 instr_bytes[FLUSH_LEN * 4];
+    if (!set_reg(1, io_addr, dst_buf)) return false;
+    flush_body(instr_bytes);
+    return append_obj(dst_buf, &instr_bytes, sizeof(instr_bytes));
+}
+
+/* [ADD|SUB] x1, x1, INBUF_OFFSET (INBUF_OFFSET is a multiple of 4 KiB) */
+#define SHIFT_TO_INBUF(op) \
+    (((u32)(op) << 24) | 0x400021 | ((INBUF_OFFSET >> 12) << 10))
+
+/* number of instructions in the input buffer refill sequence */
+#define REFILL_LEN (FLUSH_LEN + 10)
+/* number of instructions after the refill sequence */
+#define LOAD_LEN 5
+
+/* The buffered input function keeps the address of the I/O segment in x1, and
+ * the index of the next unread byte in x2. The refill path temporarily moves x1
+ * to the input buffer, as the read system call expects it there. */
+static bool buffered_read(u8 reg, i64 io_addr, sized_buf *dst_buf) {
+    u8 aux = aux_reg(reg);
+    u8 instr_bytes[(4 + REFILL_LEN + LOAD_LEN) * 4];
+    u8 *refill = &(instr_bytes[16 + FLUSH_LEN * 4]);
+    u8 *load = &(instr_bytes[(4 + REFILL_LEN) * 4]);
+    if (!set_reg(1, io_addr, dst_buf)) return false;
+    /* LDR x2, [x1, INBUF_POS_OFFSET] */
+    serialize32le(0xf9400022 | ((INBUF_POS_OFFSET / 8) << 10), instr_bytes);
+    /* LDR x.aux, [x1, INBUF_LEN_OFFSET] */
+    serialize32le(
+        0xf9400020 | ((INBUF_LEN_OFFSET / 8) << 10) | aux, &(instr_bytes[4])
+    );
+    /* CMP x2, x.aux */
+    serialize32le(0xeb00005f | (aux << 16), &(instr_bytes[8]));
+    /* B.NE past the refill */
+    serialize32le(0x54000001 | ((REFILL_LEN + 1) << 5), &(instr_bytes[12]));
+    flush_body(&(instr_bytes[16]));
+    serialize32le(SHIFT_TO_INBUF(A64_OP_ADD), refill);
+    /* MOVZ x8, 63 (read system call number) */
+    serialize32le(0xd28007e8, &(refill[4]));
+    /* MOVZ x0, 0 (stdin file descriptor) */
+    serialize32le(0xd2800000, &(refill[8]));
+    /* MOVZ x2, INBUF_SZ */
+    serialize32le(0xd2800002 | (INBUF_SZ << 5), &(refill[12]));
+    /* SVC 0 */
+    serialize32le(0xd4000001, &(refill[16]));
+    serialize32le(SHIFT_TO_INBUF(A64_OP_SUB), &(refill[20]));
+    /* CMP x0, 0 */
+    serialize32le(0xf100001f, &(refill[24]));
+    /* B.LE past the end (nothing was read) */
+    serialize32le(0x5400000d | ((LOAD_LEN + 3) << 5), &(refill[28]));
+    /* STR x0, [x1, INBUF_LEN_OFFSET] */
+    serialize32le(0xf9000020 | ((INBUF_LEN_OFFSET / 8) << 10), &(refill[32]));
+    /* MOVZ x2, 0 */
+    serialize32le(0xd2800002, &(refill[36]));
+    /* ADD x.aux, x1, INBUF_OFFSET */
+    serialize32le(
+        0x91400020 | ((INBUF_OFFSET >> 12) << 10) | aux, load
+    );
+    /* LDRB w.aux, [x.aux, x2] */
+    serialize32le(0x38626800 | (aux << 5) | aux, &(load[4]));
+    /* STRB w.aux, [x.reg] */
+    store_to_byte(reg, aux, &(load[8]));
+    /* ADD x2, x2, 1 */
+    serialize32le(0x91000442, &(load[12]));
+    /* STR x2, [x1, INBUF_POS_OFFSET] */
+    serialize32le(0xf9000022 | ((INBUF_POS_OFFSET / 8) << 10), &(load[16]));
+    return append_obj(dst_buf, &instr_bytes, sizeof(instr_bytes));
+}
+
+static bool jit_prologue(sized_buf *dst_buf) {
+    /* STP x19, x20, [sp, #-16]! */
+    return append_instr(0xa9bf53f3, dst_buf);
+}
+
+static bool jit_epilogue(sized_buf *dst_buf) {
+    return append_obj(
+        dst_buf,
+        (u8[]){
+            /* LDP x19, x20, [sp], #16 */
+            0xf3, 0x53, 0xc1, 0xa8,
+            /* RET */
+            0xc0, 0x03, 0x5f, 0xd6,
+        },
+        8
+    );
 }
 
 static const arch_funcs FUNCS = {
     set_reg,
     reg_copy,
+    load_byte,
+    store_byte,
     syscall,
+    load_code_addr,
     nop_loop_open,
+    pad_nops,
     jump_zero,
     jump_not_zero,
     inc_reg,
@@ -368,15 +839,26 @@ static const arch_funcs FUNCS = {
     dec_byte,
     add_reg,
     sub_reg,
-    add_byte,
-    sub_byte,
-    zero_byte,
+    mul_add_byte_at,
+    scan_zero,
+    add_byte_at,
+    zero_byte_at,
+    set_byte_at,
+    zero_bytes_at,
+    copy_bytes_at,
+    inc_counter,
+    buffered_write,
+    flush_output,
+    buffered_read,
+    jit_prologue,
+    jit_epilogue,
 };
 
 static const arch_sc_nums SC_NUMS = {
     .read = 63,
     .write = 64,
     .exit = 93,
+    .madvise = 233,
 };
 
 static const arch_registers REGS = {
@@ -385,12 +867,33 @@ static const arch_registers REGS = {
     .arg2 = 1 /* x1 */,
     .arg3 = 2 /* x2 */,
     .bf_ptr = 19 /* x19 */,
+    .cell = 20 /* x20 */,
+};
+
+static const arch_max_sizes MAX_SIZES = {
+    .move = 16,
+    .add = 28,
+    .zero = 12,
+    .set = 16,
+    .zero_range = 24,
+    .set_range = 44,
+    .mul_add = 56,
+    .scan = 76,
+    .jump = 12,
+    .counter = 28,
+    .io = 116,
+    .output_const = 72,
+    .cell = 8,
 };
 
 const arch_inter ARM64_INTER = {
     .FUNCS = &FUNCS,
     .SC_NUMS = &SC_NUMS,
     .REGS = &REGS,
+    .MAX_SIZES = &MAX_SIZES,
+    /* the most that a B.cond can jump forwards, with the extra instruction */
+    .SHORT_JUMP_MAX = 0xffff8,
+    .LOOP_ALIGN = 16,
     .FLAGS = 0 /* no flags are defined for this architecture */,
     .ELF_ARCH = EM_AARCH64,
     .ELF_DATA = ELFDATA2LSB,
@@ -92,6 +92,12 @@
  *  - bits 12-15: lower 4 bits of opcode
  *  - bits 16-47: immediate
  *
+ * * RIL-b (3 halfwords, 12-bit opcode, [register, 32-bit relative immediate])
+ *  - bits 0-7: higher 8 bits of opcode
+ *  - bits 8-11: register
+ *  - bits 12-15: lower 4 bits of opcode
+ *  - bits 16-47: relative immediate
+ *
  * * RIL-c (3 halfwords, 12-bit opcode, [mask, 32-bit relative immediate])
  *  - bits 0-7: higher 8 bits of opcode
  *  - bits 8-11: mask
@@ -121,6 +127,20 @@
  *  - bits 32-39: memory displacement (higher 8 bits)
  *  - bits 40-47: lower 8 bits of opcode
  *
+ * * SI (2 halfwords, 8-bit opcode, [memory, byte immediate])
+ *  - bits 0-7: opcode
+ *  - bits 8-15: immediate
+ *  - bits 16-19: memory base register
+ *  - bits 20-31: memory displacement
+ *
+ * * SIY (3 halfwords, 16-bit opcode, [extended memory, byte immediate])
+ *  - bits 0-7: higher 8 bits of opcode
+ *  - bits 8-15: immediate
+ *  - bits 16-19: memory base register
+ *  - bits 20-31: memory displacement (lower 12 bits)
+ *  - bits 32-39: memory displacement (higher 8 bits)
+ *  - bits 40-47: lower 8 bits of opcode
+ *
  * * RR (1 halfword, 8-bit opcode, [register or mask, register])
  *  - bits 0-7: opcode
  *  - bits 8-11: first register or mask
@@ -246,10 +266,14 @@ typedef enum {
     MASK_LT = 4,
     MASK_GT = 2,
     MASK_NE = MASK_LT | MASK_GT,
+    /* after TEST UNDER MASK, the condition code for all tested bits being 1 */
+    MASK_ONES = 1,
     MASK_NOP = 0
 } comp_mask;
 
-static bool branch_cond(u8 reg, i64 offset, comp_mask mask, sized_buf *dst) {
+static bool branch_cond(
+    u8 reg, i64 offset, bool short_jump, comp_mask mask, sized_buf *dst
+) {
     /* jumps are done by Halfwords, not bytes, so must ensure it's valid. */
     if ((offset % 2) != 0) {
         basic_err(
@@ -258,35 +282,31 @@ static bool branch_cond(u8 reg, i64 offset, comp_mask mask, sized_buf *dst) {
         return false;
     }
     /* make sure offset is in range - the branch instructions take a 16-bit
-     * offset of halfwords, so offset must be even and fit within a 17-bit
-     * signed (2's complement) integer */
-    if (offset < -0x10000 || offset > 0xffff) {
+     * offset of halfwords for short jumps, or a 32-bit one for long jumps, so
+     * offset must be even and fit within a 17-bit or 33-bit signed (2's
+     * complement) integer */
+    i64 limit = short_jump ? INT64_C(0x10000) : INT64_C(0x100000000);
+    if (offset < -limit || offset >= limit) {
         basic_err(
             "JUMP_TOO_LONG", "offset is out-of-range for this architecture"
         );
         return false;
     }
-    /* addressing halfwords is possible in compare instructions, but not
-     * addressing individual bytes, so instead load the byte of interest into
-     * an auxiliary register and compare with that, much like the ARM
-     * implementation. */
-    u8 aux = aux_reg(reg);
-    /* load the value to compare with into the auxiliary register */
-    bool ret = load_from_byte(reg, aux, dst);
-    /* set condition code according to contents of the auxiliary register, then
-     * conditionally branch if the condition code's corresponding mask bit is
-     * set to one.
+    /* test the lowest byte of the register, which sets the condition code
+     * according to the tested bits, then conditionally branch if the condition
+     * code's corresponding mask bit is set to one.
      *
-     * More specifically, if the auxiliary register contains the value 0, then
-     * the condition code will be 0b1000 If it's less than 0, then it will be
-     * 0b0100, and if it's more than zero, it will be 0b0010.
-     * That's according to page "C-2" of the Principles of Operation.
+     * More specifically, if the tested bits are all 0, then the condition code
+     * will be 0b1000. If they are all 1, it will be 0b0001, and otherwise, it
+     * will be 0b0100.
+     * That's according to the "TEST UNDER MASK" section of the Principles of
+     * Operation.
      *
      * in pseudocode:
-     * | switch (aux) {
+     * | switch (reg & 0xff) {
      * |   case 0: condition_code = 0b1000;
-     * |   case i if i < 0: condition_code = 0b0100;
-     * |   case i if i > 0: condition_code = 0b0010;
+     * |   case 0xff: condition_code = 0b0001;
+     * |   case _: condition_code = 0b0100;
      * | }
      * |
      * | if (condition_code & mask) {
@@ -295,16 +315,38 @@ static bool branch_cond(u8 reg, i64 offset, comp_mask mask, sized_buf *dst) {
      *
      * */
 
-    /* CFI aux, 0 {RIL-a}; BRCL mask, offset; */
-    u8 i_bytes[2][6] = {ENCODE_RI_OP(0xc2d, aux), ENCODE_RI_OP(0xc04, mask)};
-    /* no need to serialize the immediate in the first instruction, as it's
-     * already initialized to zero. The offset, on the other hand, still needs
-     * to be set. Cast offset to u64 to avoid portability issues with signed
-     * bit shifts. */
-    ret &= serialize32be(((u64)offset >> 1), &i_bytes[1][2]) == 4 &&
-           append_obj(dst, &i_bytes, 12);
+    /* TMLL reg, 0xff {RI-a} */
+    u8 i_bytes[10] = ENCODE_RI_OP(0xa71, reg);
+    i_bytes[3] = 0xff;
+    /* BRC mask, offset {RI-c} or BRCL mask, offset {RIL-c}
+     *
+     * The offset is relative to the branch instruction itself, so the jump
+     * lands on the branch instruction for the other end of the loop, which
+     * falls through, as the condition code is unchanged and its mask is the
+     * opposite one. */
+    i_bytes[4] = short_jump ? 0xa7 : 0xc0;
+    i_bytes[5] = (mask << 4) | 0x4;
+    /* Cast offset to u64 to avoid portability issues with signed bit shifts */
+    if (short_jump) {
+        return serialize16be(((u64)offset >> 1), &i_bytes[6]) == 2 &&
+               append_obj(dst, &i_bytes, 8);
+    }
+    return serialize32be(((u64)offset >> 1), &i_bytes[6]) == 4 &&
+           append_obj(dst, &i_bytes, 10);
+}
 
-    return ret;
+/* LARL reg, offset {RIL-b}
+ * The offset is in halfwords, relative to the instruction itself. */
+static bool load_code_addr(u8 reg, i64 offset, sized_buf *dst_buf) {
+    if ((offset % 2) != 0) {
+        basic_err(
+            "INVALID_CODE_ADDRESS", "offset must be an even number of bytes"
+        );
+        return false;
+    }
+    u8 i_bytes[6] = ENCODE_RI_OP(0xc00, reg);
+    return serialize32be((u64)offset >> 1, &i_bytes[2]) == 4 &&
+           append_obj(dst_buf, &i_bytes, 6);
 }
 
 /* BRANCH ON CONDITION with all operands set to zero is used as a NO-OP.
@@ -314,17 +356,27 @@ static bool branch_cond(u8 reg, i64 offset, comp_mask mask, sized_buf *dst) {
 /* NOPR is an extended mnemonic for BCR 0, 0 {RR} */
 #define NOPR 0x07, 0x00
 
-static bool nop_loop_open(sized_buf *dst_buf) {
-    u8 i_bytes[18] = {NOP, NOP, NOP, NOP, NOPR};
-    return append_obj(dst_buf, &i_bytes, 18);
+static bool nop_loop_open(bool short_jump, sized_buf *dst_buf) {
+    u8 i_bytes[10] = {NOP, NOP, NOPR};
+    return append_obj(dst_buf, &i_bytes, short_jump ? 8 : 10);
 }
 
-static bool jump_zero(u8 reg, i64 offset, sized_buf *dst_buf) {
-    return branch_cond(reg, offset, MASK_EQ, dst_buf);
+/* as many NOPs as fit, then a NOPR if there are 2 bytes left over */
+static bool pad_nops(u8 sz, sized_buf *dst_buf) {
+    for (; sz >= 4; sz -= 4) {
+        if (!append_obj(dst_buf, (u8[]){NOP}, 4)) return false;
+    }
+    return sz == 0 || append_obj(dst_buf, (u8[]){NOPR}, 2);
 }
 
-static bool jump_not_zero(u8 reg, i64 offset, sized_buf *dst_buf) {
-    return branch_cond(reg, offset, MASK_NE, dst_buf);
+static bool jump_zero(u8 reg, i64 offset, bool short_jump, sized_buf *dst_buf) {
+    return branch_cond(reg, offset, short_jump, MASK_EQ, dst_buf);
+}
+
+static bool jump_not_zero(
+    u8 reg, i64 offset, bool short_jump, sized_buf *dst_buf
+) {
+    return branch_cond(reg, offset, short_jump, MASK_NE | MASK_ONES, dst_buf);
 }
 
 static bool add_reg(u8 reg, i64 imm, sized_buf *dst_buf) {
@@ -383,14 +435,6 @@ static bool add_byte(u8 reg, i8 imm8, sized_buf *dst_buf) {
     return ret;
 }
 
-static bool sub_byte(u8 reg, i8 imm8, sized_buf *dst_buf) {
-    u8 aux = aux_reg(reg);
-    bool ret = load_from_byte(reg, aux, dst_buf);
-    ret &= add_reg(aux, -imm8, dst_buf);
-    ret &= store_to_byte(reg, aux, dst_buf);
-    return ret;
-}
-
 static bool inc_byte(u8 reg, sized_buf *dst_buf) {
     return add_byte(reg, 1, dst_buf);
 }
@@ -404,11 +448,313 @@ static bool zero_byte(u8 reg, sized_buf *dst_buf) {
     return store_to_byte(reg, 0, dst_buf);
 }
 
+/* r.reg is temporarily moved to the target cell, as that works for any offset
+ * without needing another register. */
+static bool mul_add_byte_at(
+    u8 reg, i64 offset, u8 factor, sized_buf *dst_buf
+) {
+    u8 aux = aux_reg(reg);
+    u8 aux2 = aux_reg(aux);
+    bool ret = load_from_byte(reg, aux, dst_buf);
+    if (factor != 1) {
+        /* MSFI aux, factor {RIL-a} */
+        u8 i_bytes[6] = ENCODE_RI_OP(0xc21, aux);
+        ret &= serialize32be(factor, &i_bytes[2]) == 4 &&
+               append_obj(dst_buf, &i_bytes, 6);
+    }
+    ret &= add_reg(reg, offset, dst_buf);
+    ret &= load_from_byte(reg, aux2, dst_buf);
+    /* AR aux2, aux {RR} */
+    ret &= append_obj(dst_buf, (u8[]){0x1a, (aux2 << 4) | aux}, 2);
+    ret &= store_to_byte(reg, aux2, dst_buf);
+    ret &= sub_reg(reg, offset, dst_buf);
+    return ret;
+}
+
+/* encode a 20-bit displacement in the order it's used in RXY-a instructions
+ * (dl, then dh). The first byte also contains the base register, so the
+ * register needs to be ORed into it. */
+#define DISP20(d) \
+    (((u32)(d) >> 8) & 0xf), ((u32)(d) & 0xff), (((u32)(d) >> 12) & 0xff)
+
+/* check if an offset fits in the 20-bit signed displacement of RXY instructions
+ */
+#define FITS_DISP20(d) ((d) >= -0x80000 && (d) <= 0x7ffff)
+
+static bool add_byte_at(u8 reg, i64 offset, i8 imm8, sized_buf *dst_buf) {
+    /* if it's too far for a displacement, move r.reg there and back instead */
+    if (!FITS_DISP20(offset)) {
+        return add_reg(reg, offset, dst_buf) && add_byte(reg, imm8, dst_buf) &&
+               sub_reg(reg, offset, dst_buf);
+    }
+    u8 aux = aux_reg(reg);
+    /* LLGC aux, offset(reg) {RXY-a} */
+    u8 load[6] = {0xe3, aux << 4, (reg << 4) | DISP20(offset), 0x90};
+    /* STCY aux, offset(reg) {RXY-a} */
+    u8 store[6] = {0xe3, aux << 4, (reg << 4) | DISP20(offset), 0x72};
+    return append_obj(dst_buf, &load, 6) && add_reg(aux, imm8, dst_buf) &&
+           append_obj(dst_buf, &store, 6);
+}
+
+static bool zero_byte_at(u8 reg, i64 offset, sized_buf *dst_buf) {
+    if (!FITS_DISP20(offset)) {
+        return add_reg(reg, offset, dst_buf) && zero_byte(reg, dst_buf) &&
+               sub_reg(reg, offset, dst_buf);
+    }
+    /* STCY 0, offset(reg) {RXY-a} */
+    u8 i_bytes[6] = {0xe3, 0x00, (reg << 4) | DISP20(offset), 0x72};
+    return append_obj(dst_buf, &i_bytes, 6);
+}
+
+static bool set_byte_at(u8 reg, i64 offset, u8 imm8, sized_buf *dst_buf) {
+    if (!FITS_DISP20(offset)) {
+        /* MVI 0(reg), imm8 {SI} */
+        u8 i_bytes[4] = {0x92, imm8, reg << 4, 0x00};
+        return add_reg(reg, offset, dst_buf) &&
+               append_obj(dst_buf, &i_bytes, 4) &&
+               sub_reg(reg, offset, dst_buf);
+    }
+    /* MVIY offset(reg), imm8 {SIY} */
+    u8 i_bytes[6] = {0xeb, imm8, (reg << 4) | DISP20(offset), 0x52};
+    return append_obj(dst_buf, &i_bytes, 6);
+}
+
+/* check if an offset fits in the 12-bit unsigned displacement of SS
+ * instructions */
+#define FITS_DISP12(d) ((d) >= 0 && (d) <= 0xfff)
+
+/* write an SS-a format instruction with the opcode op to dst_buf, acting on the
+ * count bytes at d1(b1) and d2(b2) */
+static bool storage_op(
+    u8 op, u8 count, u8 b1, u16 d1, u8 b2, u16 d2, sized_buf *dst_buf
+) {
+    u8 i_bytes[6] = {
+        op,
+        count - 1,
+        (b1 << 4) | (d1 >> 8),
+        d1 & 0xff,
+        (b2 << 4) | (d2 >> 8),
+        d2 & 0xff,
+    };
+    return append_obj(dst_buf, &i_bytes, 6);
+}
+
+static bool zero_bytes_at(u8 reg, i64 offset, u8 count, sized_buf *dst_buf) {
+    if (!FITS_DISP12(offset)) {
+        return add_reg(reg, offset, dst_buf) &&
+               zero_bytes_at(reg, 0, count, dst_buf) &&
+               sub_reg(reg, offset, dst_buf);
+    }
+    /* XC offset(count, reg), offset(reg) {SS-a} */
+    return storage_op(0xd7, count, reg, offset, reg, offset, dst_buf);
+}
+
+static bool copy_bytes_at(
+    u8 reg, i64 offset, u8 src, u8 count, sized_buf *dst_buf
+) {
+    if (!FITS_DISP12(offset)) {
+        return add_reg(reg, offset, dst_buf) &&
+               copy_bytes_at(reg, 0, src, count, dst_buf) &&
+               sub_reg(reg, offset, dst_buf);
+    }
+    /* MVC offset(count, reg), 0(src) {SS-a} */
+    return storage_op(0xd2, count, reg, offset, src, 0, dst_buf);
+}
+
+static bool inc_counter(i64 addr, sized_buf *dst_buf) {
+    u8 aux = aux_reg(0);
+    /* AGSI 0(aux), 1 {SIY} */
+    u8 i_bytes[6] = {0xeb, 0x01, aux << 4, 0x00, 0x00, 0x7a};
+    return set_reg(aux, addr, dst_buf) && append_obj(dst_buf, &i_bytes, 6);
+}
+
+/* Forward scans with a stride of 1 use SEARCH STRING, which looks for the byte
+ * stored in r0 - zero, in this case. Its end address is set to zero so that it
+ * only stops early when the CPU decides to pause it, in which case it's
+ * resumed. Other scans use a tight loop, one cell at a time. */
+static bool scan_zero(u8 reg, i64 stride, sized_buf *dst_buf) {
+    u8 aux = aux_reg(reg);
+    u8 aux2 = aux_reg(aux);
+    if (stride == 1) {
+        bool ret = reg_copy(aux, 0, dst_buf) && reg_copy(aux2, reg, dst_buf);
+        /* loop: SRST aux, aux2 {RRE}; BRC 1, loop {RI-c} */
+        u8 i_bytes[8] = {
+            0xb2, 0x5e, 0x00, (aux << 4) | aux2, 0xa7, 0x14, 0xff, 0xfe
+        };
+        return ret && append_obj(dst_buf, &i_bytes, 8) &&
+               reg_copy(reg, aux, dst_buf);
+    }
+    /* BRC 15, test {RI-c} (will replace the jump offset) */
+    size_t start = dst_buf->sz;
+    u8 brc[4] = ENCODE_RI_OP(0xa74, 15);
+    if (!append_obj(dst_buf, &brc, 4)) return false;
+    /* loop: AGFI reg, stride (or equivalent) */
+    if (!add_reg(reg, stride, dst_buf)) return false;
+    i64 offset = dst_buf->sz - start;
+    serialize16be(offset >> 1, &(((u8 *)dst_buf->buf)[start + 2]));
+    /* test: CLI 0(reg), 0 {SI}; BRC MASK_NE, loop {RI-c} */
+    u8 i_bytes[8] = {0x95, 0x00, reg << 4, 0x00, 0xa7, (MASK_NE << 4) | 4};
+    serialize16be((u64)(-offset) >> 1, &i_bytes[6]);
+    return append_obj(dst_buf, &i_bytes, 8);
+}
+
+/* Both buffered output functions keep the address of the output buffer in r3
+ * and the number of bytes stored in it in r4, as those are the registers the
+ * write system call expects them in. */
+
+/* size of the sequence written by flush_tail, in bytes */
+#define FLUSH_TAIL_SZ 16
+
+/* write FLUSH_TAIL_SZ bytes of machine code to dst to write r4 bytes from r3 to
+ * stdout, then set the stored byte count to zero. */
+static bool flush_tail(sized_buf *dst_buf) {
+    u8 i_bytes[FLUSH_TAIL_SZ] = {
+        /* LGHI r1, 4 (write system call number) {RI-a} */
+        0xa7, 0x19, 0x00, 0x04,
+        /* LGHI r2, 1 (stdout file descriptor) {RI-a} */
+        0xa7, 0x29, 0x00, 0x01,
+        /* SVC 0 {I} */
+        0x0a, 0x00,
+        /* STG r0, OUTBUF_LEN_OFFSET(r3) {RXY-a} */
+        0xe3, 0x00, 0x30 | DISP20(OUTBUF_LEN_OFFSET), 0x24,
+    };
+    return append_obj(dst_buf, &i_bytes, FLUSH_TAIL_SZ);
+}
+
+static bool buffered_write(u8 reg, i64 io_addr, sized_buf *dst_buf) {
+    u8 i_bytes[32] = {
+        /* LG r4, OUTBUF_LEN_OFFSET(r3) {RXY-a} */
+        0xe3, 0x40, 0x30 | DISP20(OUTBUF_LEN_OFFSET), 0x04,
+        /* LLGC r5, 0(reg) {RXY-a} */
+        0xe3, 0x50 | reg, 0x00, 0x00, 0x00, 0x90,
+        /* STC r5, 0(r4, r3) {RX-a} */
+        0x42, 0x54, 0x30, 0x00,
+        /* AGHI r4, 1 {RI-a} */
+        0xa7, 0x4b, 0x00, 0x01,
+        /* STG r4, OUTBUF_LEN_OFFSET(r3) {RXY-a} */
+        0xe3, 0x40, 0x30 | DISP20(OUTBUF_LEN_OFFSET), 0x24,
+        /* CGFI r4, OUTBUF_SZ {RIL-a} */
+        0xc2, 0x4c, 0x00, 0x00, 0x00, 0x00,
+    };
+    /* BRC MASK_NE, past the flush (offset is in halfwords) {RI-c} */
+    u8 branch[4] = {0xa7, 0x64, 0x00, (4 + FLUSH_TAIL_SZ) / 2};
+    return set_reg(3, io_addr, dst_buf) &&
+           serialize32be(OUTBUF_SZ, &(i_bytes[28])) == 4 &&
+           append_obj(dst_buf, &i_bytes, 32) &&
+           append_obj(dst_buf, &branch, 4) && flush_tail(dst_buf);
+}
+
+/* size of the sequence written by flush_body, in bytes */
+#define FLUSH_SZ (10 + FLUSH_TAIL_SZ)
+
+/* write FLUSH_SZ bytes of machine code to dst to write out the contents of the
+ * output buffer at the address in r3, if it is not empty. */
+static bool flush_body(sized_buf *dst_buf) {
+    u8 i_bytes[10] = {
+        /* LTG r4, OUTBUF_LEN_OFFSET(r3) {RXY-a} */
+        0xe3, 0x40, 0x30 | DISP20(OUTBUF_LEN_OFFSET), 0x02,
+        /* BRC MASK_EQ, past the flush (offset is in halfwords) {RI-c} */
+        0xa7, 0x84, 0x00, (4 + FLUSH_TAIL_SZ) / 2,
+    };
+    return append_obj(dst_buf, &i_bytes, 10) && flush_tail(dst_buf);
+}
+
+static bool flush_output(i64 io_addr, sized_buf *dst_buf) {
+    return set_reg(3, io_addr, dst_buf) && flush_body(dst_buf);
+}
+
+/* sizes of the parts of the sequence written by buffered_read, in bytes */
+#define REFILL_SZ (FLUSH_SZ + 44)
+#define LOAD_SZ 20
+
+/* The buffered input function keeps the address of the I/O segment in r3, and
+ * the index of the next unread byte in r4. The refill path temporarily moves r3
+ * to the input buffer, as the read system call expects it there. */
+static bool buffered_read(u8 reg, i64 io_addr, sized_buf *dst_buf) {
+    u8 check_bytes[16] = {
+        /* LG r4, INBUF_POS_OFFSET(r3) {RXY-a} */
+        0xe3, 0x40, 0x30 | DISP20(INBUF_POS_OFFSET), 0x04,
+        /* CG r4, INBUF_LEN_OFFSET(r3) {RXY-a} */
+        0xe3, 0x40, 0x30 | DISP20(INBUF_LEN_OFFSET), 0x20,
+        /* BRC MASK_NE, past the refill (offset is in halfwords) {RI-c} */
+        0xa7, 0x64, 0x00, (4 + REFILL_SZ) / 2,
+    };
+    u8 refill_bytes[44] = {
+        /* LAY r3, INBUF_OFFSET(r3) {RXY-a} */
+        0xe3, 0x30, 0x30 | DISP20(INBUF_OFFSET), 0x71,
+        /* LGHI r1, 3 (read system call number) {RI-a} */
+        0xa7, 0x19, 0x00, 0x03,
+        /* LGHI r2, 0 (stdin file descriptor) {RI-a} */
+        0xa7, 0x29, 0x00, 0x00,
+        /* LGHI r4, INBUF_SZ {RI-a} */
+        0xa7, 0x49, INBUF_SZ >> 8, INBUF_SZ & 0xff,
+        /* SVC 0 {I} */
+        0x0a, 0x00,
+        /* LAY r3, -INBUF_OFFSET(r3) {RXY-a} */
+        0xe3, 0x30, 0x30 | DISP20(-INBUF_OFFSET), 0x71,
+        /* LTGR r2, r2 {RRE} */
+        0xb9, 0x02, 0x00, 0x22,
+        /* BRC MASK_EQ | MASK_LT, past the end (offset in halfwords) {RI-c} */
+        0xa7, 0xc4, 0x00, (4 + 10 + LOAD_SZ) / 2,
+        /* STG r2, INBUF_LEN_OFFSET(r3) {RXY-a} */
+        0xe3, 0x20, 0x30 | DISP20(INBUF_LEN_OFFSET), 0x24,
+        /* LGR r4, r0 {RRE} */
+        0xb9, 0x04, 0x00, 0x40,
+    };
+    u8 load_bytes[LOAD_SZ] = {
+        /* LLGC r5, INBUF_OFFSET(r4, r3) {RXY-a} */
+        0xe3, 0x54, 0x30 | DISP20(INBUF_OFFSET), 0x90,
+        /* STC r5, 0(reg) {RX-a} */
+        0x42, 0x50 | reg, 0x00, 0x00,
+        /* AGHI r4, 1 {RI-a} */
+        0xa7, 0x4b, 0x00, 0x01,
+        /* STG r4, INBUF_POS_OFFSET(r3) {RXY-a} */
+        0xe3, 0x40, 0x30 | DISP20(INBUF_POS_OFFSET), 0x24,
+    };
+    return set_reg(3, io_addr, dst_buf) &&
+           append_obj(dst_buf, &check_bytes, 16) && flush_body(dst_buf) &&
+           append_obj(dst_buf, &refill_bytes, 44) &&
+           append_obj(dst_buf, &load_bytes, LOAD_SZ);
+}
+
+/* r8 and r9 are saved in their slots in the register save area that the caller
+ * provides at the bottom of its stack frame, and r0 is zeroed, as the rest of
+ * the code assumes that it's zero. */
+static bool jit_prologue(sized_buf *dst_buf) {
+    return append_obj(
+        dst_buf,
+        (u8[]){
+            /* STMG r8, r9, 64(r15) {RSY-a} */
+            0xeb, 0x89, 0xf0, 0x40, 0x00, 0x24,
+            /* XGR r0, r0 {RRE} */
+            0xb9, 0x82, 0x00, 0x00,
+        },
+        10
+    );
+}
+
+static bool jit_epilogue(sized_buf *dst_buf) {
+    return append_obj(
+        dst_buf,
+        (u8[]){
+            /* LMG r8, r9, 64(r15) {RSY-a} */
+            0xeb, 0x89, 0xf0, 0x40, 0x00, 0x04,
+            /* BR r14 {RR} */
+            0x07, 0xfe,
+        },
+        8
+    );
+}
+
 static const arch_funcs FUNCS = {
     set_reg,
     reg_copy,
+    load_from_byte,
+    store_to_byte,
     syscall,
+    load_code_addr,
     nop_loop_open,
+    pad_nops,
     jump_zero,
     jump_not_zero,
     inc_reg,
@@ -417,15 +763,26 @@ static const arch_funcs FUNCS = {
     dec_byte,
     add_reg,
     sub_reg,
-    add_byte,
-    sub_byte,
-    zero_byte,
+    mul_add_byte_at,
+    scan_zero,
+    add_byte_at,
+    zero_byte_at,
+    set_byte_at,
+    zero_bytes_at,
+    copy_bytes_at,
+    inc_counter,
+    buffered_write,
+    flush_output,
+    buffered_read,
+    jit_prologue,
+    jit_epilogue,
 };
 
 static const arch_sc_nums SC_NUMS = {
     .read = 3,
     .write = 4,
     .exit = 1,
+    .madvise = 219,
 };
 
 static const arch_registers REGS = {
@@ -438,12 +795,34 @@ static const arch_registers REGS = {
      * for syscall args, not r8, so it should be fine to use.
      * See https://www.kernel.org/doc/html/v5.3/s390/debugging390.html */
     .bf_ptr = 8,
+    /* for the same reasons, r9 should be fine to use too. */
+    .cell = 9,
+};
+
+static const arch_max_sizes MAX_SIZES = {
+    .move = 14,
+    .add = 32,
+    .zero = 22,
+    .set = 22,
+    .zero_range = 18,
+    .set_range = 24,
+    .mul_add = 42,
+    .scan = 20,
+    .jump = 10,
+    .counter = 18,
+    .io = 116,
+    .output_const = 58,
+    .cell = 10,
 };
 
 const arch_inter S390X_INTER = {
     .FUNCS = &FUNCS,
     .SC_NUMS = &SC_NUMS,
     .REGS = &REGS,
+    .MAX_SIZES = &MAX_SIZES,
+    /* the most that a BRC can jump forwards */
+    .SHORT_JUMP_MAX = 0xfffe,
+    .LOOP_ALIGN = 16,
     .FLAGS = 0 /* no flags are defined for this architecture */,
     .ELF_ARCH = EM_S390,
     .ELF_DATA = ELFDATA2MSB,
@@ -3,13 +3,16 @@
  * SPDX-License-Identifier: GPL-3.0-only
  *
  * This file provides the arch_inter for the x86_64 architecture. */
+/* C99 */
+#include <stddef.h> /* NULL */
+#include <string.h> /* memcpy, memmove */
 /* internal */
 #include "arch_inter.h" /* arch_{registers, sc_nums, funcs, inter} */
 #include "compat/elf.h" /* EM_X86_64, ELFDATA2LSB */
 #include "err.h" /* basic_err */
 #include "serialize.h" /* serialize* */
 #include "types.h" /* [iu]{8,16,32,64}, bool, size_t, off_t */
-#include "util.h" /* append_obj */
+#include "util.h" /* append_obj, reserve_obj, commit_obj */
 #if EAMBFC_TARGET_X86_64
 
 /* If there are more than 3 lines in common between similar ADD/SUB or JZ/JNZ
@@ -28,36 +31,62 @@
 /* most common values for opcodes in add/sub instructions */
 typedef enum { X64_OP_ADD = 0xc0, X64_OP_SUB = 0xe8 } arith_op;
 
-/* TEST byte [reg], 0xff; Jcc|tttn offset */
-static bool test_jcc(char tttn, u8 reg, i64 offset, sized_buf *dst_buf) {
-    if (offset > INT32_MAX || offset < INT32_MIN) {
+/* TEST reg8, reg8; Jcc|tttn offset
+ * If short_jump is true, the 2-byte Jcc with an 8-bit offset is used, and
+ * otherwise, the 6-byte one with a 32-bit offset is. */
+static bool test_jcc(
+    char tttn, u8 reg, i64 offset, bool short_jump, sized_buf *dst_buf
+) {
+    i64 min = short_jump ? INT8_MIN : INT32_MIN;
+    i64 max = short_jump ? INT8_MAX : INT32_MAX;
+    if (offset > max || offset < min) {
         basic_err(
             "JUMP_TOO_LONG",
-            "offset is outside the range of possible 32-bit signed values"
+            short_jump ? "offset is outside the range of 8-bit signed values"
+                       : "offset is outside the range of 32-bit signed values"
         );
         return false;
     }
-    u8 i_bytes[9] = {
-        /* TEST byte [reg], 0xff */
-        INSTRUCTION(0xf6, reg, 0xff),
-        /* Jcc|tttn 0x00000000 (will replace with jump offset) */
-        INSTRUCTION(0x0f, 0x80 | tttn, IMM32_PADDING),
-    };
-    if (serialize32le(offset, &(i_bytes[5])) != 4) return false;
-    return append_obj(dst_buf, &i_bytes, 9);
+    u8 sz = short_jump ? 5 : 9;
+    u8 *i_bytes = reserve_obj(dst_buf, sz);
+    if (i_bytes == NULL) return false;
+    /* TEST reg8, reg8 (the REX prefix selects SPL, BPL, SIL, and DIL, rather
+     * than AH, CH, DH, and BH) */
+    i_bytes[0] = 0x40;
+    i_bytes[1] = 0x84;
+    i_bytes[2] = 0xc0 | (reg << 3) | reg;
+    if (short_jump) {
+        /* Jcc|tttn offset (rel8) */
+        i_bytes[3] = 0x70 | tttn;
+        i_bytes[4] = offset;
+    } else {
+        /* Jcc|tttn offset (rel32) */
+        i_bytes[3] = 0x0f;
+        i_bytes[4] = 0x80 | tttn;
+        if (serialize32le(offset, &(i_bytes[5])) != 4) return false;
+    }
+    commit_obj(dst_buf, sz);
+    return true;
 }
 
 static bool reg_arith(u8 reg, i64 imm, arith_op op, sized_buf *dst_buf) {
     if (imm == 0) {
         return true;
-    } else if (imm >= INT8_MIN && imm <= INT8_MAX) {
-        /* ADD/SUB reg, byte imm */
-        return append_obj(dst_buf, (u8[]){0x83, op + reg, imm}, 3);
     } else if (imm >= INT32_MIN && imm <= INT32_MAX) {
-        /* ADD/SUB reg, imm */
-        u8 i_bytes[6] = {INSTRUCTION(0x81, op + reg, IMM32_PADDING)};
-        if (serialize32le(imm, &(i_bytes[2])) != 4) return false;
-        return append_obj(dst_buf, &i_bytes, 6);
+        /* ADD/SUB reg, imm, using a byte imm if it fits in one */
+        bool imm8 = imm >= INT8_MIN && imm <= INT8_MAX;
+        u8 *i_bytes = reserve_obj(dst_buf, imm8 ? 4 : 7);
+        if (i_bytes == NULL) return false;
+        i_bytes[0] = 0x48;
+        i_bytes[1] = imm8 ? 0x83 : 0x81;
+        i_bytes[2] = op + reg;
+        if (imm8) {
+            i_bytes[3] = imm;
+        } else if (serialize32le(imm, &(i_bytes[3])) != 4) {
+            return false;
+        }
+        commit_obj(dst_buf, imm8 ? 4 : 7);
+        return true;
     } else {
         /* There are no instructions to add or subtract a 64-bit immediate.
          * Instead, the approach  to use is first PUSH the value of a different
@@ -86,18 +115,23 @@ static bool reg_arith(u8 reg, i64 imm, arith_op op, sized_buf *dst_buf) {
  *
  * `+` is INC byte [reg], which is encoded as 0xfe reg
  * `-` is DEC byte [reg], which is encoded as 0xfe 0x08|reg
- * `>` is INC reg, which is encoded as 0xff 0xc0|reg
- * `<` is DEC reg, which is encoded as 0xff 0xc8|reg
+ * `>` is INC reg, which is encoded as 0x48 0xff 0xc0|reg
+ * `<` is DEC reg, which is encoded as 0x48 0xff 0xc8|reg
  *
  * Therefore, setting op to 0 for INC and 8 for DEC and adm (Address Mode) to 3
  * when working on registers and 0 when working on memory, then doing some messy
- * bitwise hackery, the following function can be used. */
+ * bitwise hackery, the following function can be used. When working on
+ * registers, a REX.W prefix (0x48) is added, so that the whole 64-bit register
+ * is used, as the tape isn't always within the lowest 4 GiB of memory. */
 static bool x86_offset(char op, u8 adm, u8 reg, sized_buf *dst_buf) {
-    return append_obj(
-        dst_buf,
-        (u8[]){INSTRUCTION(0xfe | (adm & 1), (op | reg | (adm << 6)))},
-        2
-    );
+    u8 sz = (adm == 3) ? 3 : 2;
+    u8 *i_bytes = reserve_obj(dst_buf, sz);
+    if (i_bytes == NULL) return false;
+    if (adm == 3) *(i_bytes++) = 0x48;
+    i_bytes[0] = 0xfe | (adm & 1);
+    i_bytes[1] = op | reg | (adm << 6);
+    commit_obj(dst_buf, sz);
+    return true;
 }
 
 /* now, the functions exposed through X86_64_INTER */
@@ -124,7 +158,21 @@ static bool set_reg(u8 reg, i64 imm, sized_buf *dst_buf) {
 /* MOV rs, rd */
 static bool reg_copy(u8 dst, u8 src, sized_buf *dst_buf) {
     return append_obj(
-        dst_buf, (u8[]){INSTRUCTION(0x89, 0xc0 + (src << 3) + dst)}, 2
+        dst_buf, (u8[]){INSTRUCTION(0x48, 0x89, 0xc0 + (src << 3) + dst)}, 3
+    );
+}
+
+/* MOVZX dst32, byte [reg] */
+static bool load_byte(u8 reg, u8 dst, sized_buf *dst_buf) {
+    return append_obj(
+        dst_buf, (u8[]){INSTRUCTION(0x0f, 0xb6, (dst << 3) | reg)}, 3
+    );
+}
+
+/* MOV byte [reg], src8 */
+static bool store_byte(u8 reg, u8 src, sized_buf *dst_buf) {
+    return append_obj(
+        dst_buf, (u8[]){INSTRUCTION(0x40, 0x88, (src << 3) | reg)}, 3
     );
 }
 
@@ -133,27 +181,61 @@ static bool syscall(sized_buf *dst_buf) {
     return append_obj(dst_buf, (u8[]){INSTRUCTION(0x0f, 0x05)}, 2);
 }
 
+/* LEA reg, [RIP + (offset - 7)]
+ * RIP points to the end of the instruction, which is 7 bytes long. */
+static bool load_code_addr(u8 reg, i64 offset, sized_buf *dst_buf) {
+    u8 i_bytes[7] = {INSTRUCTION(0x48, 0x8d, 0x05 | (reg << 3), IMM32_PADDING)};
+    if (serialize32le(offset - 7, &(i_bytes[3])) != 4) return false;
+    return append_obj(dst_buf, &i_bytes, 7);
+}
+
 /* In this backend, `[` and `]` are both compiled to TEST (3 bytes), followed by
- * a Jcc instruction (6 bytes). When encountering a `[` instruction, fill 9
- * * bytes with NOP instructins to leave room for it. */
+ * a Jcc instruction (2 bytes for short jumps, 6 bytes otherwise). When
+ * encountering a `[` instruction, fill 5 or 9 bytes with NOP instructions to
+ * leave room for it. */
 #define NOP 0x90
 
-/* times 9 NOP */
-static bool nop_loop_open(sized_buf *dst_buf) {
+/* times 5 NOP or times 9 NOP */
+static bool nop_loop_open(bool short_jump, sized_buf *dst_buf) {
     u8 nops[9] = {NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP};
-    return append_obj(dst_buf, &nops, 9);
+    return append_obj(dst_buf, &nops, short_jump ? 5 : 9);
 }
 
-/* TEST byte [reg], 0xff; JZ jmp_offset */
-static bool jump_zero(u8 reg, i64 offset, sized_buf *dst_buf) {
+/* The multi-byte NOP instructions recommended by Intel, by size. Each one is a
+ * single instruction, so a sequence of them is decoded more quickly than the
+ * same number of single-byte NOPs. */
+static const u8 MULTI_NOPS[9][9] = {
+    {NOP},
+    {0x66, NOP},
+    {0x0f, 0x1f, 0x00},
+    {0x0f, 0x1f, 0x40, 0x00},
+    {0x0f, 0x1f, 0x44, 0x00, 0x00},
+    {0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00},
+    {0x0f, 0x1f, 0x80, 0x00, 0x00, 0x00, 0x00},
+    {0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+    {0x66, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+};
+
+/* as many 9-byte NOPs as fit, then one more NOP for whatever's left */
+static bool pad_nops(u8 sz, sized_buf *dst_buf) {
+    for (; sz > 9; sz -= 9) {
+        if (!append_obj(dst_buf, MULTI_NOPS[8], 9)) return false;
+    }
+    return sz == 0 || append_obj(dst_buf, MULTI_NOPS[sz - 1], sz);
+}
+
+/* TEST reg8, reg8; JZ jmp_offset */
+static bool jump_zero(u8 reg, i64 offset, bool short_jump, sized_buf *dst_buf) {
     /* Jcc with tttn=0b0100 is JZ or JE, so use 4 for tttn */
-    return test_jcc(0x4, reg, offset, dst_buf);
+    return test_jcc(0x4, reg, offset, short_jump, dst_buf);
 }
 
-/* TEST byte [reg], 0xff; JNZ jmp_offset */
-static bool jump_not_zero(u8 reg, i64 offset, sized_buf *dst_buf) {
+/* TEST reg8, reg8; JNZ jmp_offset */
+static bool jump_not_zero(
+    u8 reg, i64 offset, bool short_jump, sized_buf *dst_buf
+) {
     /* Jcc with tttn=0b0101 is JNZ or JNE, so use 5 for tttn */
-    return test_jcc(0x5, reg, offset, dst_buf);
+    return test_jcc(0x5, reg, offset, short_jump, dst_buf);
 }
 
 /* INC reg */
@@ -188,26 +270,409 @@ static bool sub_reg(u8 reg, i64 imm, sized_buf *dst_buf) {
     return reg_arith(reg, imm, X64_OP_SUB, dst_buf);
 }
 
-static bool add_byte(u8 reg, i8 imm8, sized_buf *dst_buf) {
-    /* ADD byte [reg], imm8 */
-    return append_obj(dst_buf, (u8[]){INSTRUCTION(0x80, reg, imm8)}, 3);
+static bool mul_add_byte_at(
+    u8 reg, i64 offset, u8 factor, sized_buf *dst_buf
+) {
+    u8 i_bytes[12] = {
+        /* MOVZX EAX, byte [reg] */
+        INSTRUCTION(0x0f, 0xb6, reg),
+        /* IMUL EAX, EAX, imm8 (as only AL is used, sign extension is fine) */
+        INSTRUCTION(0x6b, 0xc0, factor),
+        /* ADD byte [reg + offset], AL */
+        INSTRUCTION(0x00, 0x80 | reg, IMM32_PADDING),
+    };
+    if (serialize32le(offset, &(i_bytes[8])) != 4) return false;
+    /* if factor is 1, IMUL can be skipped */
+    if (factor == 1) {
+        memmove(&(i_bytes[3]), &(i_bytes[6]), 6);
+        return append_obj(dst_buf, &i_bytes, 9);
+    }
+    return append_obj(dst_buf, &i_bytes, 12);
+}
+
+/* write an instruction with opcode op and ModR/M reg field (or opcode
+ * extension) op_ext, which acts on the byte at [reg + offset] with the
+ * immediate imm8, using a shorter 8-bit displacement if offset fits in one. */
+static bool byte_at_imm(
+    u8 op, u8 op_ext, u8 reg, i64 offset, u8 imm8, sized_buf *dst_buf
+) {
+    bool disp8 = offset >= INT8_MIN && offset <= INT8_MAX;
+    u8 sz = disp8 ? 4 : 7;
+    u8 *i_bytes = reserve_obj(dst_buf, sz);
+    if (i_bytes == NULL) return false;
+    i_bytes[0] = op;
+    i_bytes[1] = (disp8 ? 0x40 : 0x80) | (op_ext << 3) | reg;
+    if (disp8) {
+        i_bytes[2] = offset;
+    } else if (serialize32le(offset, &(i_bytes[2])) != 4) {
+        return false;
+    }
+    i_bytes[sz - 1] = imm8;
+    commit_obj(dst_buf, sz);
+    return true;
 }
 
-static bool sub_byte(u8 reg, i8 imm8, sized_buf *dst_buf) {
-    /* SUB byte [reg], imm8 */
-    return append_obj(dst_buf, (u8[]){INSTRUCTION(0x80, 0x28 + reg, imm8)}, 3);
+static bool add_byte_at(u8 reg, i64 offset, i8 imm8, sized_buf *dst_buf) {
+    /* ADD byte [reg + offset], imm8 */
+    return byte_at_imm(0x80, 0, reg, offset, imm8, dst_buf);
 }
 
-static bool zero_byte(u8 reg, sized_buf *dst_buf) {
-    /* MOV byte [reg], 0 */
-    return append_obj(dst_buf, (u8[]){INSTRUCTION(0x67, 0xc6, reg, 0x00)}, 4);
+static bool zero_byte_at(u8 reg, i64 offset, sized_buf *dst_buf) {
+    /* MOV byte [reg + offset], 0 */
+    return byte_at_imm(0xc6, 0, reg, offset, 0, dst_buf);
+}
+
+static bool set_byte_at(u8 reg, i64 offset, u8 imm8, sized_buf *dst_buf) {
+    /* MOV byte [reg + offset], imm8 */
+    return byte_at_imm(0xc6, 0, reg, offset, imm8, dst_buf);
+}
+
+/* Runs of bytes are set one chunk at a time, using the largest of 1, 2, 4, 8,
+ * or 16 bytes that isn't larger than the run. If the run isn't a multiple of
+ * that size, the last chunk is moved back to end at the end of the run, so that
+ * it overlaps the one before it, so runs of up to 32 bytes take 2 at most. */
+static u8 chunk_size(u8 count) {
+    u8 size = 16;
+    while (size > count) size >>= 1;
+    return size;
+}
+
+/* move *pos from one chunk of a run of count bytes to the next one, returning
+ * false if there isn't one */
+static bool next_chunk(u8 *pos, u8 size, u8 count) {
+    if (*pos + size >= count) return false;
+    *pos += size;
+    if (*pos + size > count) *pos = count - size;
+    return true;
+}
+
+/* write an instruction to dst_buf to move a size-byte chunk at [reg + offset]
+ * into AL, AX, EAX, RAX, or XMM0, depending on size, if load is true, or from
+ * there into [reg + offset] otherwise, using a shorter 8-bit displacement if
+ * offset fits in one. */
+static bool move_chunk(
+    bool load, u8 size, u8 reg, i64 offset, sized_buf *dst_buf
+) {
+    u8 i_bytes[7];
+    u8 sz = 0;
+    if (size == 16) {
+        /* MOVUPS XMM0, [reg + offset] or MOVUPS [reg + offset], XMM0 */
+        i_bytes[sz++] = 0x0f;
+        i_bytes[sz++] = load ? 0x10 : 0x11;
+    } else {
+        /* MOV (AL|AX|EAX|RAX), [reg + offset], or the other way around */
+        if (size == 2) i_bytes[sz++] = 0x66;
+        if (size == 8) i_bytes[sz++] = 0x48;
+        i_bytes[sz++] = (load ? 0x8a : 0x88) | (size != 1);
+    }
+    bool disp8 = offset >= INT8_MIN && offset <= INT8_MAX;
+    i_bytes[sz++] = (disp8 ? 0x40 : 0x80) | reg;
+    if (disp8) {
+        i_bytes[sz++] = offset;
+    } else {
+        if (serialize32le(offset, &(i_bytes[sz])) != 4) return false;
+        sz += 4;
+    }
+    return append_obj(dst_buf, &i_bytes, sz);
+}
+
+static bool zero_bytes_at(u8 reg, i64 offset, u8 count, sized_buf *dst_buf) {
+    u8 size = chunk_size(count);
+    u8 pos = 0;
+    /* XORPS XMM0, XMM0 or XOR EAX, EAX */
+    if (!((size == 16)
+              ? append_obj(dst_buf, (u8[]){INSTRUCTION(0x0f, 0x57, 0xc0)}, 3)
+              : append_obj(dst_buf, (u8[]){INSTRUCTION(0x31, 0xc0)}, 2))) {
+        return false;
+    }
+    do {
+        if (!move_chunk(false, size, reg, offset + pos, dst_buf)) return false;
+    } while (next_chunk(&pos, size, count));
+    return true;
+}
+
+static bool copy_bytes_at(
+    u8 reg, i64 offset, u8 src, u8 count, sized_buf *dst_buf
+) {
+    u8 size = chunk_size(count);
+    u8 pos = 0;
+    do {
+        if (!move_chunk(true, size, src, pos, dst_buf) ||
+            !move_chunk(false, size, reg, offset + pos, dst_buf)) {
+            return false;
+        }
+    } while (next_chunk(&pos, size, count));
+    return true;
+}
+
+static bool inc_counter(i64 addr, sized_buf *dst_buf) {
+    if (addr >= INT32_MIN && addr <= INT32_MAX) {
+        /* INC qword [addr] */
+        u8 i_bytes[8] = {INSTRUCTION(0x48, 0xff, 0x04, 0x25, IMM32_PADDING)};
+        return serialize32le(addr, &(i_bytes[4])) == 4 &&
+               append_obj(dst_buf, &i_bytes, 8);
+    }
+    /* MOV RAX, addr; INC qword [RAX] */
+    return set_reg(0, addr, dst_buf) &&
+           append_obj(dst_buf, (u8[]){INSTRUCTION(0x48, 0xff, 0x00)}, 3);
+}
+
+/* For strides of 1 and -1, 16 bytes are checked at a time with SSE2, which is
+ * part of the baseline x86_64 instruction set. The 16-byte blocks are aligned,
+ * so they never cross into a page that the bytes being checked aren't in. Each
+ * block is compared with a zeroed XMM0, and the bits of the resulting mask are
+ * used to find which byte was zero. Bits for bytes in the first block which
+ * are on the wrong side of the starting point are shifted out. */
+static bool scan_zero(u8 reg, i64 stride, sized_buf *dst_buf) {
+    if (stride == 1) {
+        u8 i_bytes[64] = {
+            /* MOV RCX, reg; AND ECX, 15 */
+            INSTRUCTION(0x48, 0x89, 0xc1 | (reg << 3)),
+            INSTRUCTION(0x83, 0xe1, 0x0f),
+            /* MOV RDX, reg; AND RDX, -16 */
+            INSTRUCTION(0x48, 0x89, 0xc2 | (reg << 3)),
+            INSTRUCTION(0x48, 0x83, 0xe2, 0xf0),
+            /* PXOR XMM0, XMM0 */
+            INSTRUCTION(0x66, 0x0f, 0xef, 0xc0),
+            /* MOVDQA XMM1, [RDX]; PCMPEQB XMM1, XMM0; PMOVMSKB EAX, XMM1 */
+            INSTRUCTION(0x66, 0x0f, 0x6f, 0x0a),
+            INSTRUCTION(0x66, 0x0f, 0x74, 0xc8),
+            INSTRUCTION(0x66, 0x0f, 0xd7, 0xc1),
+            /* SHR EAX, CL (drop bits for bytes before reg) */
+            INSTRUCTION(0xd3, 0xe8),
+            /* TEST EAX, EAX; JNZ found */
+            INSTRUCTION(0x85, 0xc0),
+            INSTRUCTION(0x75, 23),
+            /* loop: ADD RDX, 16 */
+            INSTRUCTION(0x48, 0x83, 0xc2, 0x10),
+            /* MOVDQA XMM1, [RDX]; PCMPEQB XMM1, XMM0; PMOVMSKB EAX, XMM1 */
+            INSTRUCTION(0x66, 0x0f, 0x6f, 0x0a),
+            INSTRUCTION(0x66, 0x0f, 0x74, 0xc8),
+            INSTRUCTION(0x66, 0x0f, 0xd7, 0xc1),
+            /* TEST EAX, EAX; JZ loop */
+            INSTRUCTION(0x85, 0xc0),
+            INSTRUCTION(0x74, -20),
+            /* MOV reg, RDX */
+            INSTRUCTION(0x48, 0x89, 0xd0 | reg),
+            /* found: BSF EAX, EAX; ADD reg, RAX */
+            INSTRUCTION(0x0f, 0xbc, 0xc0),
+            INSTRUCTION(0x48, 0x01, 0xc0 | reg),
+        };
+        return append_obj(dst_buf, &i_bytes, 64);
+    } else if (stride == -1) {
+        u8 i_bytes[73] = {
+            /* MOV RCX, reg; AND ECX, 15; XOR ECX, 15 */
+            INSTRUCTION(0x48, 0x89, 0xc1 | (reg << 3)),
+            INSTRUCTION(0x83, 0xe1, 0x0f),
+            INSTRUCTION(0x83, 0xf1, 0x0f),
+            /* MOV RDX, reg; AND RDX, -16 */
+            INSTRUCTION(0x48, 0x89, 0xc2 | (reg << 3)),
+            INSTRUCTION(0x48, 0x83, 0xe2, 0xf0),
+            /* PXOR XMM0, XMM0 */
+            INSTRUCTION(0x66, 0x0f, 0xef, 0xc0),
+            /* MOVDQA XMM1, [RDX]; PCMPEQB XMM1, XMM0; PMOVMSKB EAX, XMM1 */
+            INSTRUCTION(0x66, 0x0f, 0x6f, 0x0a),
+            INSTRUCTION(0x66, 0x0f, 0x74, 0xc8),
+            INSTRUCTION(0x66, 0x0f, 0xd7, 0xc1),
+            /* SHL EAX, CL; MOVZX EAX, AX (drop bits for bytes after reg) */
+            INSTRUCTION(0xd3, 0xe0),
+            INSTRUCTION(0x0f, 0xb7, 0xc0),
+            /* TEST EAX, EAX; JNZ found */
+            INSTRUCTION(0x85, 0xc0),
+            INSTRUCTION(0x75, 24),
+            /* loop: SUB RDX, 16 */
+            INSTRUCTION(0x48, 0x83, 0xea, 0x10),
+            /* MOVDQA XMM1, [RDX]; PCMPEQB XMM1, XMM0; PMOVMSKB EAX, XMM1 */
+            INSTRUCTION(0x66, 0x0f, 0x6f, 0x0a),
+            INSTRUCTION(0x66, 0x0f, 0x74, 0xc8),
+            INSTRUCTION(0x66, 0x0f, 0xd7, 0xc1),
+            /* TEST EAX, EAX; JZ loop */
+            INSTRUCTION(0x85, 0xc0),
+            INSTRUCTION(0x74, -20),
+            /* LEA reg, [RDX + 15] */
+            INSTRUCTION(0x48, 0x8d, 0x42 | (reg << 3), 0x0f),
+            /* found: BSR EAX, EAX; LEA reg, [reg + RAX - 15] */
+            INSTRUCTION(0x0f, 0xbd, 0xc0),
+            INSTRUCTION(0x48, 0x8d, 0x44 | (reg << 3), reg, -15),
+        };
+        return append_obj(dst_buf, &i_bytes, 73);
+    }
+    /* For other strides, fall back to a tight loop, one cell at a time. */
+    /* JMP test (will replace the jump offset) */
+    size_t start = dst_buf->sz;
+    if (!append_obj(dst_buf, (u8[]){INSTRUCTION(0xeb, 0x00)}, 2)) return false;
+    /* loop: ADD reg, stride */
+    if (!add_reg(reg, stride, dst_buf)) return false;
+    ((u8 *)dst_buf->buf)[start + 1] = dst_buf->sz - (start + 2);
+    /* test: CMP byte [reg], 0; JNE loop */
+    u8 i_bytes[5] = {
+        INSTRUCTION(0x80, 0x38 | reg, 0x00),
+        INSTRUCTION(0x75, (start + 2) - (dst_buf->sz + 5)),
+    };
+    return append_obj(dst_buf, &i_bytes, 5);
+}
+
+/* Both buffered output functions keep the address of the output buffer in RSI
+ * and the number of bytes stored in it in RDX, as those are the registers the
+ * write system call expects them in. RSI is not clobbered by the system call,
+ * so the count can be reset through it afterwards. */
+#define FLUSH_TAIL_SZ 23
+
+/* write FLUSH_TAIL_SZ bytes of machine code to dst to write RDX bytes from RSI
+ * to stdout, then set the stored byte count to zero. */
+static bool flush_tail(u8 *dst) {
+    /* MOV EAX, 1 (write system call number) */
+    dst[0] = 0xb8;
+    /* MOV EDI, 1 (stdout file descriptor) */
+    dst[5] = 0xbf;
+    /* SYSCALL */
+    dst[10] = 0x0f;
+    dst[11] = 0x05;
+    /* MOV qword [RSI + OUTBUF_LEN_OFFSET], 0 */
+    dst[12] = 0x48;
+    dst[13] = 0xc7;
+    dst[14] = 0x86;
+    return serialize32le(1, &(dst[1])) == 4 &&
+           serialize32le(1, &(dst[6])) == 4 &&
+           serialize32le(OUTBUF_LEN_OFFSET, &(dst[15])) == 4 &&
+           serialize32le(0, &(dst[19])) == 4;
+}
+
+static bool buffered_write(u8 reg, i64 io_addr, sized_buf *dst_buf) {
+    /* MOV ESI, io_addr (or MOV RSI, io_addr if it doesn't fit in 32 bits) */
+    if (!set_reg(06 /* RSI */, io_addr, dst_buf)) return false;
+    u8 i_bytes[31 + FLUSH_TAIL_SZ] = {
+        /* MOV RDX, qword [RSI + OUTBUF_LEN_OFFSET] */
+        INSTRUCTION(0x48, 0x8b, 0x96, IMM32_PADDING),
+        /* MOV AL, byte [reg] */
+        INSTRUCTION(0x8a, reg),
+        /* MOV byte [RSI + RDX], AL */
+        INSTRUCTION(0x88, 0x04, 0x16),
+        /* INC RDX */
+        INSTRUCTION(0x48, 0xff, 0xc2),
+        /* MOV qword [RSI + OUTBUF_LEN_OFFSET], RDX */
+        INSTRUCTION(0x48, 0x89, 0x96, IMM32_PADDING),
+        /* CMP RDX, OUTBUF_SZ */
+        INSTRUCTION(0x48, 0x81, 0xfa, IMM32_PADDING),
+        /* JNE past the flush */
+        INSTRUCTION(0x75, FLUSH_TAIL_SZ),
+    };
+    if (serialize32le(OUTBUF_LEN_OFFSET, &(i_bytes[3])) != 4) return false;
+    if (serialize32le(OUTBUF_LEN_OFFSET, &(i_bytes[18])) != 4) return false;
+    if (serialize32le(OUTBUF_SZ, &(i_bytes[25])) != 4) return false;
+    if (!flush_tail(&(i_bytes[31]))) return false;
+    return append_obj(dst_buf, &i_bytes, 31 + FLUSH_TAIL_SZ);
+}
+
+/* size of the sequence written by flush_body */
+#define FLUSH_SZ (12 + FLUSH_TAIL_SZ)
+
+/* write FLUSH_SZ bytes of machine code to dst to write out the contents of the
+ * output buffer at the address in RSI, if it is not empty. */
+static bool flush_body(u8 *dst) {
+    /* MOV RDX, qword [RSI + OUTBUF_LEN_OFFSET] */
+    dst[0] = 0x48;
+    dst[1] = 0x8b;
+    dst[2] = 0x96;
+    /* TEST RDX, RDX */
+    dst[7] = 0x48;
+    dst[8] = 0x85;
+    dst[9] = 0xd2;
+    /* JZ past the flush */
+    dst[10] = 0x74;
+    dst[11] = FLUSH_TAIL_SZ;
+    return serialize32le(OUTBUF_LEN_OFFSET, &(dst[3])) == 4 &&
+           flush_tail(&(dst[12]));
+}
+
+static bool flush_output(i64 io_addr, sized_buf *dst_buf) {
+    u8 i_bytes[FLUSH_SZ];
+    /* MOV ESI, io_addr (or MOV RSI, io_addr if it doesn't fit in 32 bits) */
+    return set_reg(06 /* RSI */, io_addr, dst_buf) && flush_body(i_bytes) &&
+           append_obj(dst_buf, &i_bytes, FLUSH_SZ);
+}
+
+/* The buffered input function keeps the address of the I/O segment in RSI and
+ * the index of the next unread byte in RDX. The refill path temporarily moves
+ * RSI to the input buffer, as the read system call expects it there. */
+static bool buffered_read(u8 reg, i64 io_addr, sized_buf *dst_buf) {
+    u8 i_bytes[16 + FLUSH_SZ + 39 + 19] = {
+        /* MOV RDX, qword [RSI + INBUF_POS_OFFSET] */
+        INSTRUCTION(0x48, 0x8b, 0x96, IMM32_PADDING),
+        /* CMP RDX, qword [RSI + INBUF_LEN_OFFSET] */
+        INSTRUCTION(0x48, 0x3b, 0x96, IMM32_PADDING),
+        /* JNE past the refill */
+        INSTRUCTION(0x75, FLUSH_SZ + 39),
+    };
+    u8 *refill = &(i_bytes[16 + FLUSH_SZ]);
+    u8 *load = &(refill[39]);
+    const u8 refill_bytes[39] = {
+        /* LEA RSI, [RSI + INBUF_OFFSET] */
+        INSTRUCTION(0x48, 0x8d, 0xb6, IMM32_PADDING),
+        /* XOR EAX, EAX (read system call number) */
+        INSTRUCTION(0x31, 0xc0),
+        /* XOR EDI, EDI (stdin file descriptor) */
+        INSTRUCTION(0x31, 0xff),
+        /* MOV EDX, INBUF_SZ */
+        INSTRUCTION(0xba, IMM32_PADDING),
+        /* SYSCALL */
+        INSTRUCTION(0x0f, 0x05),
+        /* LEA RSI, [RSI - INBUF_OFFSET] */
+        INSTRUCTION(0x48, 0x8d, 0xb6, IMM32_PADDING),
+        /* TEST RAX, RAX */
+        INSTRUCTION(0x48, 0x85, 0xc0),
+        /* JLE past the end (nothing was read) */
+        INSTRUCTION(0x7e, 9 + 19),
+        /* MOV qword [RSI + INBUF_LEN_OFFSET], RAX */
+        INSTRUCTION(0x48, 0x89, 0x86, IMM32_PADDING),
+        /* XOR EDX, EDX */
+        INSTRUCTION(0x31, 0xd2),
+    };
+    const u8 load_bytes[19] = {
+        /* MOV AL, byte [RSI + RDX + INBUF_OFFSET] */
+        INSTRUCTION(0x8a, 0x84, 0x16, IMM32_PADDING),
+        /* MOV byte [reg], AL */
+        INSTRUCTION(0x88, reg),
+        /* INC RDX */
+        INSTRUCTION(0x48, 0xff, 0xc2),
+        /* MOV qword [RSI + INBUF_POS_OFFSET], RDX */
+        INSTRUCTION(0x48, 0x89, 0x96, IMM32_PADDING),
+    };
+    memcpy(refill, refill_bytes, 39);
+    memcpy(load, load_bytes, 19);
+    /* MOV ESI, io_addr (or MOV RSI, io_addr if it doesn't fit in 32 bits) */
+    return set_reg(06 /* RSI */, io_addr, dst_buf) &&
+           serialize32le(INBUF_POS_OFFSET, &(i_bytes[3])) == 4 &&
+           serialize32le(INBUF_LEN_OFFSET, &(i_bytes[10])) == 4 &&
+           flush_body(&(i_bytes[16])) &&
+           serialize32le(INBUF_OFFSET, &(refill[3])) == 4 &&
+           serialize32le(INBUF_SZ, &(refill[12])) == 4 &&
+           serialize32le(-INBUF_OFFSET, &(refill[21])) == 4 &&
+           serialize32le(INBUF_LEN_OFFSET, &(refill[33])) == 4 &&
+           serialize32le(INBUF_OFFSET, &(load[3])) == 4 &&
+           serialize32le(INBUF_POS_OFFSET, &(load[15])) == 4 &&
+           append_obj(dst_buf, &i_bytes, sizeof(i_bytes));
+}
+
+static bool jit_prologue(sized_buf *dst_buf) {
+    /* PUSH RBX; PUSH RBP */
+    return append_obj(dst_buf, (u8[]){0x53, 0x55}, 2);
+}
+
+static bool jit_epilogue(sized_buf *dst_buf) {
+    /* POP RBP; POP RBX; RET */
+    return append_obj(dst_buf, (u8[]){0x5d, 0x5b, 0xc3}, 3);
 }
 
 static const arch_funcs FUNCS = {
     set_reg,
     reg_copy,
+    load_byte,
+    store_byte,
     syscall,
+    load_code_addr,
     nop_loop_open,
+    pad_nops,
     jump_zero,
     jump_not_zero,
     inc_reg,
@@ -216,12 +681,27 @@ static const arch_funcs FUNCS = {
     dec_byte,
     add_reg,
     sub_reg,
-    add_byte,
-    sub_byte,
-    zero_byte,
+    mul_add_byte_at,
+    scan_zero,
+    add_byte_at,
+    zero_byte_at,
+    set_byte_at,
+    zero_bytes_at,
+    copy_bytes_at,
+    inc_counter,
+    buffered_write,
+    flush_output,
+    buffered_read,
+    jit_prologue,
+    jit_epilogue,
 };
 
-static const arch_sc_nums SC_NUMS = {.read = 0, .write = 1, .exit = 60};
+static const arch_sc_nums SC_NUMS = {
+    .read = 0,
+    .write = 1,
+    .exit = 60,
+    .madvise = 28,
+};
 
 static const arch_registers REGS = {
     .sc_num = 00 /* RAX */,
@@ -229,12 +709,35 @@ static const arch_registers REGS = {
     .arg2 = 06 /* RSI */,
     .arg3 = 02 /* RDX */,
     .bf_ptr = 03 /* RBX */,
+    .cell = 05 /* RBP, used as a general-purpose register */,
+};
+
+static const arch_max_sizes MAX_SIZES = {
+    .move = 13,
+    .add = 7,
+    .zero = 7,
+    .set = 7,
+    .zero_range = 17,
+    .set_range = 29,
+    .mul_add = 12,
+    .scan = 73,
+    .jump = 9,
+    .counter = 13,
+    .io = 119,
+    .output_const = 69,
+    .cell = 6,
 };
 
 const arch_inter X86_64_INTER = {
     .FUNCS = &FUNCS,
     .SC_NUMS = &SC_NUMS,
     .REGS = &REGS,
+    .MAX_SIZES = &MAX_SIZES,
+    /* a rel8 JZ can jump 127 bytes forwards, and a rel8 JNZ 128 back */
+    .SHORT_JUMP_MAX = INT8_MAX,
+    /* the size of the fetch blocks that Zen and recent Intel CPUs decode and
+     * cache instructions in */
+    .LOOP_ALIGN = 32,
     .FLAGS = 0 /* no flags are defined for this architecture */,
     .ELF_ARCH = EM_X86_64,
     .ELF_DATA = ELFDATA2LSB,
@@ -0,0 +1,94 @@
+/* SPDX-FileCopyrightText: 2025 Eli Array Minkoff
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * A benchmark for the eambfc executable, which compiles each source file it's
+ * passed for every architecture enabled in config.h, with and without -O,
+ * several times each, and prints a tab-separated table with a row for each
+ * combination, with the size of the source and the output, how long the fastest
+ * compilation took, and the most memory any of them used. */
+
+/* C99 */
+#include <stdio.h> /* fputs, printf, fprintf, remove */
+#include <stdlib.h> /* EXIT_FAILURE, EXIT_SUCCESS, malloc, free */
+#include <string.h> /* strcpy, strlen, strcmp */
+/* POSIX */
+#include <sys/stat.h> /* stat, struct stat */
+/* internal */
+#include "../types.h" /* bool */
+#include "harness.h" /* ARCHES, ARCH_CT, measure, run_result */
+
+/* number of times to compile each combination */
+#define RUNS 5
+
+/* compile src for arch, RUNS times, with optimization if opt_flag isn't NULL,
+ * then print a row of the table with the results. out is where the output
+ * goes. Returns true if every compilation worked, and false otherwise. */
+static bool bench_one(
+    char *eambfc, char *src, const char *out, char *arch, char *opt_flag
+) {
+    char *argv[] = {eambfc, "-q", "-a", arch, src, NULL, NULL};
+    if (opt_flag != NULL) {
+        argv[4] = opt_flag;
+        argv[5] = src;
+    }
+    unsigned long long best = 0;
+    long peak = 0;
+    for (int i = 0; i < RUNS; i++) {
+        run_result res;
+        if (!measure(argv, &res) || !res.ok) {
+            fprintf(stderr, "Failed to compile %s for %s.\n", src, arch);
+            return false;
+        }
+        if (i == 0 || res.usecs < best) best = res.usecs;
+        if (res.rss_kib > peak) peak = res.rss_kib;
+    }
+    struct stat src_st, out_st;
+    if (stat(src, &src_st) != 0 || stat(out, &out_st) != 0) {
+        fprintf(stderr, "Failed to get the size of %s or %s.\n", src, out);
+        return false;
+    }
+    remove(out);
+    printf(
+        "%s\t%s\t%s\t%lld\t%lld\t%llu\t%ld\n",
+        src,
+        arch,
+        opt_flag != NULL ? opt_flag : "-",
+        (long long)src_st.st_size,
+        (long long)out_st.st_size,
+        best,
+        peak
+    );
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fputs("Usage: compile_bench eambfc file.bf [file2.bf ...]\n", stderr);
+        return EXIT_FAILURE;
+    }
+    int ret = EXIT_SUCCESS;
+    printf("source\tarch\tflags\tsource_bytes\toutput_bytes\tusecs\tkib\n");
+    for (int i = 2; i < argc; i++) {
+        size_t len = strlen(argv[i]);
+        if (len <= 3 || strcmp(&argv[i][len - 3], ".bf") != 0) {
+            fprintf(stderr, "%s does not end with .bf.\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        char *out = malloc(len + 1);
+        if (out == NULL) {
+            fputs("Failed to allocate memory.\n", stderr);
+            return EXIT_FAILURE;
+        }
+        strcpy(out, argv[i]);
+        out[len - 3] = '\0';
+        for (size_t arch = 0; arch < ARCH_CT; arch++) {
+            if (!bench_one(argv[1], argv[i], out, ARCHES[arch], NULL) ||
+                !bench_one(argv[1], argv[i], out, ARCHES[arch], "-O")) {
+                ret = EXIT_FAILURE;
+            }
+        }
+        free(out);
+    }
+    return ret;
+}
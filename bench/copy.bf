@@ -0,0 +1,11 @@
+Multiply loops within counting loops for the runtime benchmark
+
+The outer loops run 4 times then 255 times then 255 times and each time
+through the innermost one adds 3 to a cell then copies 1 2 and 3 times
+that cell into the next three and moves the second of them back
+Without optimization each of those is a loop of its own
+
+++++[>-[>-[>+++[>+>++>+++<<<-]>[-]>[<<+>>-]>[-]<<<<-]<-]<-]
+
+Print the last value of the cell that was copied so that the result is used
+>>>.
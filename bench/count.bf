@@ -0,0 +1,7 @@
+Counting loops nested four deep for the runtime benchmark
+
+The outermost loop runs 16 times and each loop within it runs 255 times
+The innermost loop clears a cell each time through so that it can't be
+replaced with arithmetic and its jumps are all actually run
+
+++++++++++++++++[>-[>-[>-[->+[-]<]<-]<-]<-]
@@ -0,0 +1,86 @@
+/* SPDX-FileCopyrightText: 2025 Eli Array Minkoff
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * Code shared by the benchmarks, to run programs and measure how long they
+ * take and how much memory they use, and to list the architectures to
+ * benchmark. */
+
+/* C99 */
+#include <stdlib.h> /* EXIT_FAILURE, EXIT_SUCCESS */
+/* POSIX */
+#include <fcntl.h> /* open, O_RDWR */
+#include <sys/resource.h> /* getrusage, RUSAGE_CHILDREN, struct rusage */
+#include <sys/wait.h> /* waitpid, WIFEXITED, WEXITSTATUS */
+#include <time.h> /* clock_gettime, CLOCK_MONOTONIC, struct timespec */
+#include <unistd.h> /* _exit, close, dup2, execvp, fork, pipe, read, write */
+/* internal */
+#include "../config.h" /* EAMBFC_TARGET_* */
+#include "../types.h" /* bool, size_t */
+#include "harness.h" /* run_result */
+
+/* __BACKENDS__ add the name of the architecture here */
+char *const ARCHES[] = {
+#if EAMBFC_TARGET_ARM64
+    "arm64",
+#endif /* EAMBFC_TARGET_ARM64 */
+#if EAMBFC_TARGET_S390X
+    "s390x",
+#endif /* EAMBFC_TARGET_S390X */
+#if EAMBFC_TARGET_X86_64
+    "x86_64",
+#endif /* EAMBFC_TARGET_X86_64 */
+};
+
+const size_t ARCH_CT = sizeof(ARCHES) / sizeof(ARCHES[0]);
+
+/* return the number of microseconds since an arbitrary point in time */
+static unsigned long long now_usecs(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) return 0;
+    return (unsigned long long)ts.tv_sec * 1000000 +
+           (unsigned long long)ts.tv_nsec / 1000;
+}
+
+/* within the helper process, run argv, then write how it went to fd */
+static void helper(char *argv[], int fd) {
+    run_result res = {false, 0, 0};
+    unsigned long long start = now_usecs();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_RDWR);
+        if (null_fd < 0 || dup2(null_fd, STDIN_FILENO) < 0 ||
+            dup2(null_fd, STDOUT_FILENO) < 0 ||
+            dup2(null_fd, STDERR_FILENO) < 0) {
+            _exit(EXIT_FAILURE);
+        }
+        execvp(argv[0], argv);
+        _exit(EXIT_FAILURE);
+    }
+    int status;
+    if (pid > 0 && waitpid(pid, &status, 0) == pid) {
+        res.usecs = now_usecs() - start;
+        res.ok = WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+        struct rusage usage;
+        if (getrusage(RUSAGE_CHILDREN, &usage) == 0) {
+            res.rss_kib = usage.ru_maxrss;
+        }
+    }
+    if (write(fd, &res, sizeof(res)) != sizeof(res)) _exit(EXIT_FAILURE);
+    _exit(EXIT_SUCCESS);
+}
+
+bool measure(char *argv[], run_result *res) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        helper(argv, fds[1]);
+    }
+    close(fds[1]);
+    bool ok = pid > 0 && read(fds[0], res, sizeof(*res)) == sizeof(*res);
+    close(fds[0]);
+    if (pid > 0) waitpid(pid, NULL, 0);
+    return ok;
+}
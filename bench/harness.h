@@ -0,0 +1,41 @@
+/* SPDX-FileCopyrightText: 2025 Eli Array Minkoff
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * Provides an interface to harness.c, which has the code shared by the
+ * benchmarks, to run programs and measure how long they take and how much
+ * memory they use, and to list the architectures to benchmark. */
+
+#ifndef EAMBFC_BENCH_HARNESS_H
+#define EAMBFC_BENCH_HARNESS_H 1
+/* internal */
+#include "../types.h" /* bool, size_t */
+
+/* the names of the architectures enabled in config.h, as passed to -a */
+extern char *const ARCHES[];
+extern const size_t ARCH_CT;
+
+/* how a program run by measure went */
+typedef struct {
+    /* whether it ran and exited successfully */
+    bool ok;
+    /* how many microseconds it took from start to finish */
+    unsigned long long usecs;
+    /* the most memory it used at once, in KiB */
+    long rss_kib;
+} run_result;
+
+/* Run the program at argv[0], searching PATH for it if it has no slashes, with
+ * the arguments in argv, which ends with a null pointer, with its standard
+ * input, output, and error all redirected to /dev/null, and store how it went
+ * in res.
+ *
+ * It runs in a new process, with a helper process in between, so that the peak
+ * memory use of the helper's children is that of the program alone. That comes
+ * from ru_maxrss, which isn't part of POSIX, but is provided in KiB by Linux
+ * and the BSDs, and is reported as 0 elsewhere.
+ *
+ * Returns false if the helper couldn't be started. */
+bool measure(char *argv[], run_result *res);
+
+#endif /* EAMBFC_BENCH_HARNESS_H */
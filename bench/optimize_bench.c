@@ -0,0 +1,130 @@
+/* SPDX-FileCopyrightText: 2025 Eli Array Minkoff
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * A regression benchmark for the optimizer, which compiles large synthetic
+ * sources full of code for it to remove or replace, each twice the size of the
+ * last, and fails if the time taken per byte grows too much, which would mean
+ * that some part of the optimization process takes more than linear time. */
+
+/* C99 */
+#include <stdio.h> /* fclose, fflush, fileno, fputs, fwrite, printf, tmpfile */
+#include <stdlib.h> /* EXIT_FAILURE, EXIT_SUCCESS, atexit, exit */
+/* POSIX */
+#include <fcntl.h> /* O_WRONLY */
+#include <time.h> /* clock_gettime, CLOCK_MONOTONIC, struct timespec */
+#include <unistd.h> /* lseek, SEEK_SET */
+/* internal */
+#include "../arch_inter.h" /* X86_64_INTER */
+#include "../compile.h" /* bf_*, bf_compile_ctx */
+#include "../resource_mgr.h" /* register_mgr, mgr_open, mgr_close */
+
+/* A chunk of code with cancelling instructions, dead loops, `[-]`, multiply
+ * loops, and scan loops. It's balanced and starts with a `+`, so that any
+ * number of copies of it in a row is a valid program where no loop is dead
+ * unless it's meant to be. */
+static const char CHUNK[] =
+    "+[->>+<<]>><<+-<>[-]+[>]<>[.][,]-+\n"
+    ">>>>+++<<<<----++++>>>><<<<-+-+-+[-][+]><><<<>>\n"
+    "+[>>+>+<<<-]>>>[<<<+>>>-]+-+-[<][[]]<<>>\n";
+
+/* size of the smallest source, in copies of CHUNK */
+#define BASE_REPS 0x20000
+/* number of sources to compile, each twice the size of the last */
+#define ROUNDS 3
+/* maximum allowed ratio between the time taken per byte of the largest and
+ * smallest sources. Linear scaling would stay around 1. */
+#define MAX_RATIO 2.0
+
+static FILE *src_file;
+
+static void close_src_file(void) {
+    if (src_file != NULL) fclose(src_file);
+    src_file = NULL;
+}
+
+/* return the number of seconds since an arbitrary point in time */
+static double now(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+        fputs("Failed to get the current time.\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+    register_mgr();
+    if (atexit(close_src_file)) {
+        fputs("Could not register close_src_file with atexit.\n", stderr);
+        return EXIT_FAILURE;
+    }
+    int out_fd = mgr_open("/dev/null", O_WRONLY);
+    if (out_fd == -1) {
+        fputs("Failed to open /dev/null for writing.\n", stderr);
+        return EXIT_FAILURE;
+    }
+    bf_compile_ctx ctx;
+    bf_ctx_init(&ctx);
+    double first_rate = 0.0;
+    double rate = 0.0;
+    unsigned long reps = BASE_REPS;
+    for (int round = 0; round < ROUNDS; round++, reps *= 2) {
+        if ((src_file = tmpfile()) == NULL) {
+            fputs("Failed to open tmpfile.\n", stderr);
+            return EXIT_FAILURE;
+        }
+        for (unsigned long i = 0; i < reps; i++) {
+            if (fwrite(CHUNK, 1, sizeof(CHUNK) - 1, src_file) !=
+                sizeof(CHUNK) - 1) {
+                fputs("Failed to write synthetic source.\n", stderr);
+                return EXIT_FAILURE;
+            }
+        }
+        if (fflush(src_file) != 0 ||
+            lseek(fileno(src_file), 0, SEEK_SET) != 0) {
+            fputs("Failed to rewind synthetic source.\n", stderr);
+            return EXIT_FAILURE;
+        }
+        double size = (double)(reps * (sizeof(CHUNK) - 1));
+        const bf_source src = {.fd = fileno(src_file), .buf = NULL, .sz = 0};
+        bf_dest dst = {.fd = out_fd, .buf = NULL};
+        double start = now();
+        if (!bf_compile(
+                &ctx,
+                &X86_64_INTER,
+                &src,
+                &dst,
+                true,
+                8,
+                false,
+                false,
+                false,
+                false,
+                false,
+                NULL,
+                false
+            )) {
+            fputs("Failed to compile synthetic source.\n", stderr);
+            return EXIT_FAILURE;
+        }
+        double elapsed = now() - start;
+        close_src_file();
+        rate = elapsed / size;
+        if (round == 0) first_rate = rate;
+        printf(
+            "%8.2f MiB: %7.3f s (%7.2f MiB/s)\n",
+            size / 0x100000,
+            elapsed,
+            size / 0x100000 / elapsed
+        );
+    }
+    bf_ctx_cleanup(&ctx);
+    mgr_close(out_fd);
+    if (rate > first_rate * MAX_RATIO) {
+        fputs("FAIL - compile time grew faster than source size.\n", stderr);
+        return EXIT_FAILURE;
+    }
+    printf("SUCCESS - compile time grew linearly with source size.\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,7 @@
+Writes a single byte 1044480 times for the runtime benchmark
+
+Set the fourth cell to 65 which is a capital A using the fifth
+>>>>++++++++[<++++++++>-]<+<<<
+
+Then write it from within loops that run 16 then 255 then 255 times
+++++++++++++++++[>-[>-[>.<-]<-]<-]
@@ -0,0 +1,228 @@
+/* SPDX-FileCopyrightText: 2025 Eli Array Minkoff
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * A benchmark for the code that eambfc generates, which compiles each source
+ * file it's passed for every architecture enabled in config.h, with each set of
+ * flags in FLAG_SETS, then runs the result several times, and prints a
+ * tab-separated table with a row for each combination, with how long the
+ * fastest run took and the most memory any of them used.
+ *
+ * If `perf stat` works, each program is run once more under it, to count the
+ * instructions it retired, the branches it mispredicted, and the system calls
+ * it made, as far as the system supports counting them. Otherwise, those are
+ * left as "-".
+ *
+ * Programs for other architectures are run if the system can run them, such as
+ * with qemu-user and binfmt_misc, like the test suite, and skipped otherwise.
+ * When emulated, the counts include the work done by the emulator, so the
+ * table says which programs were run natively. */
+
+/* C99 */
+#include <stdio.h> /* FILE, fclose, fgets, fopen, fputs, fprintf, printf... */
+#include <stdlib.h> /* EXIT_FAILURE, EXIT_SUCCESS, malloc, free */
+#include <string.h> /* memcpy, strcat, strchr, strcmp, strcpy, strlen... */
+/* POSIX */
+#include <sys/utsname.h> /* uname, struct utsname */
+/* internal */
+#include "../types.h" /* bool, size_t */
+#include "harness.h" /* ARCHES, ARCH_CT, measure, run_result */
+
+/* number of times to run each program */
+#define RUNS 5
+
+/* the flags to compile each program with, other than the architecture */
+static char *const FLAG_SETS[] = {NULL, "-O", "-Ob"};
+#define FLAG_SET_CT (sizeof(FLAG_SETS) / sizeof(FLAG_SETS[0]))
+
+/* where perf writes its counts */
+#define PERF_OUT "perf.out"
+
+/* the events to count with perf, and the same without counting system calls,
+ * as not every system allows tracing them */
+#define PERF_EVENTS "instructions,branch-misses,raw_syscalls:sys_enter"
+#define PERF_EVENTS_NO_SC "instructions,branch-misses"
+
+/* which events perf can count, which is found out the first time it's run */
+static enum {
+    PERF_UNKNOWN,
+    PERF_ALL,
+    PERF_NO_SYSCALLS,
+    PERF_UNAVAILABLE
+} perf_mode = PERF_UNKNOWN;
+
+/* the counts from perf for a single run, as written by perf */
+typedef struct {
+    char instructions[32];
+    char branch_misses[32];
+    char syscalls[32];
+} perf_counts;
+
+/* Returns true if arch is the architecture this is running on. */
+static bool is_native(const char *arch) {
+    struct utsname name;
+    if (uname(&name) != 0) return false;
+    /* __BACKENDS__ add any other names the system could use here */
+    if (strcmp(arch, "arm64") == 0) {
+        return strcmp(name.machine, "aarch64") == 0 ||
+               strcmp(name.machine, "arm64") == 0;
+    }
+    if (strcmp(arch, "x86_64") == 0) {
+        return strcmp(name.machine, "x86_64") == 0 ||
+               strcmp(name.machine, "amd64") == 0;
+    }
+    return strcmp(arch, name.machine) == 0;
+}
+
+/* copy the count at the start of the line from perf's CSV output to dst, if
+ * the event in its third column starts with event */
+static void read_count(const char *line, const char *event, char dst[32]) {
+    const char *unit = strchr(line, ',');
+    const char *name = (unit != NULL) ? strchr(unit + 1, ',') : NULL;
+    if (name == NULL || strncmp(name + 1, event, strlen(event)) != 0) return;
+    size_t len = (size_t)(unit - line);
+    /* leave it as "-" if it's empty or something like "<not counted>" */
+    if (len == 0 || len > 31 || line[0] == '<') return;
+    memcpy(dst, line, len);
+    dst[len] = '\0';
+}
+
+/* run prog under perf stat, counting events, and store the counts in counts.
+ * Returns false if perf failed. */
+static bool perf_run(char *prog, char *events, perf_counts *counts) {
+    char *argv[] = {
+        "perf", "stat", "-x", ",", "-o", PERF_OUT, "-e", events, prog, NULL
+    };
+    run_result res;
+    if (!measure(argv, &res) || !res.ok) return false;
+    FILE *f = fopen(PERF_OUT, "r");
+    if (f == NULL) return false;
+    char line[256];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        read_count(line, "instructions", counts->instructions);
+        read_count(line, "branch-misses", counts->branch_misses);
+        read_count(line, "raw_syscalls:sys_enter", counts->syscalls);
+    }
+    fclose(f);
+    remove(PERF_OUT);
+    return true;
+}
+
+/* count events in a run of prog with perf, if possible, storing the counts in
+ * counts, and leaving them as "-" if not. */
+static void count_events(char *prog, perf_counts *counts) {
+    strcpy(counts->instructions, "-");
+    strcpy(counts->branch_misses, "-");
+    strcpy(counts->syscalls, "-");
+    if (perf_mode == PERF_UNKNOWN || perf_mode == PERF_ALL) {
+        if (perf_run(prog, PERF_EVENTS, counts)) {
+            perf_mode = PERF_ALL;
+            return;
+        }
+        if (perf_mode == PERF_ALL) return;
+        perf_mode = PERF_NO_SYSCALLS;
+    }
+    if (perf_mode == PERF_NO_SYSCALLS &&
+        !perf_run(prog, PERF_EVENTS_NO_SC, counts)) {
+        fputs("Failed to run perf stat, so not counting events.\n", stderr);
+        perf_mode = PERF_UNAVAILABLE;
+    }
+}
+
+/* compile src to prog for arch, with flags if it's not NULL, then run it RUNS
+ * times and print a row of the table with the results. Sets *skip to true if
+ * prog can't be run because it's for another architecture. Returns true if it
+ * was compiled and run successfully, or skipped. */
+static bool bench_one(
+    char *eambfc, char *src, char *prog, char *arch, char *flags, bool *skip
+) {
+    char *compile_argv[] = {eambfc, "-q", "-a", arch, src, NULL, NULL};
+    if (flags != NULL) {
+        compile_argv[4] = flags;
+        compile_argv[5] = src;
+    }
+    run_result res;
+    if (!measure(compile_argv, &res) || !res.ok) {
+        fprintf(stderr, "Failed to compile %s for %s.\n", src, arch);
+        return false;
+    }
+    bool native = is_native(arch);
+    char *run_argv[] = {prog, NULL};
+    unsigned long long best = 0;
+    long peak = 0;
+    for (int i = 0; i < RUNS; i++) {
+        if (!measure(run_argv, &res) || !res.ok) {
+            if (i == 0 && !native) {
+                fprintf(stderr, "Skipping %s, as it can't run here.\n", arch);
+                *skip = true;
+                remove(prog);
+                return true;
+            }
+            fprintf(stderr, "Failed to run %s compiled for %s.\n", src, arch);
+            remove(prog);
+            return false;
+        }
+        if (i == 0 || res.usecs < best) best = res.usecs;
+        if (res.rss_kib > peak) peak = res.rss_kib;
+    }
+    perf_counts counts;
+    count_events(prog, &counts);
+    remove(prog);
+    printf(
+        "%s\t%s\t%s\t%s\t%llu\t%ld\t%s\t%s\t%s\n",
+        src,
+        arch,
+        flags != NULL ? flags : "-",
+        native ? "native" : "emulated",
+        best,
+        peak,
+        counts.instructions,
+        counts.branch_misses,
+        counts.syscalls
+    );
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fputs("Usage: run_bench eambfc file.bf [file2.bf ...]\n", stderr);
+        return EXIT_FAILURE;
+    }
+    int ret = EXIT_SUCCESS;
+    for (int i = 2; i < argc; i++) {
+        size_t len = strlen(argv[i]);
+        if (len <= 3 || strcmp(&argv[i][len - 3], ".bf") != 0) {
+            fprintf(stderr, "%s does not end with .bf.\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    printf(
+        "source\tarch\tflags\trunner\tusecs\tkib\tinstructions\t"
+        "branch_misses\tsyscalls\n"
+    );
+    for (size_t arch = 0; arch < ARCH_CT; arch++) {
+        bool skip = false;
+        for (int i = 2; !skip && i < argc; i++) {
+            /* the program needs a slash in its path, or measure would search
+             * PATH for it */
+            bool in_cwd = strchr(argv[i], '/') == NULL;
+            char *prog = malloc(strlen(argv[i]) + (in_cwd ? 3 : 1));
+            if (prog == NULL) {
+                fputs("Failed to allocate memory.\n", stderr);
+                return EXIT_FAILURE;
+            }
+            strcpy(prog, in_cwd ? "./" : "");
+            strcat(prog, argv[i]);
+            prog[strlen(prog) - 3] = '\0';
+            for (size_t j = 0; !skip && j < FLAG_SET_CT; j++) {
+                char *src = argv[i], *flags = FLAG_SETS[j];
+                char *arch_name = ARCHES[arch];
+                if (!bench_one(argv[1], src, prog, arch_name, flags, &skip)) {
+                    ret = EXIT_FAILURE;
+                }
+            }
+            free(prog);
+        }
+    }
+    return ret;
+}
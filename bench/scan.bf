@@ -0,0 +1,12 @@
+Scans back and forth across a stretch of nonzero cells for the runtime
+benchmark
+
+First set 4080 cells to 1 by adding a 1 past the end of the stretch one
+at a time with the counters in the first two cells
+++++++++++++++++[>-[>>[>]+[<]<-]<-]
+
+Then go from the start of the stretch to the end and back again 65025 times
+-[>-[>>[>]<[<]<-]<-]
+
+Print a newline at the end
+++++++++++.
@@ -0,0 +1,133 @@
+/* SPDX-FileCopyrightText: 2025 Eli Array Minkoff
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * Stores compiled programs in a cache directory, named after a hash of their
+ * source code and of the settings used to compile them.
+ *
+ * As different source code and settings can have the same hash, each entry
+ * starts with a header with the settings, including their null terminator,
+ * the size of the source code as a 64-bit little-endian integer, and the
+ * source code itself, which must all match for the program after it to be
+ * used. */
+
+/* C99 */
+#include <stdio.h> /* remove, rename, snprintf */
+#include <stdlib.h> /* mkstemp */
+#include <string.h> /* memcmp, memcpy, strlen */
+/* POSIX */
+#include <fcntl.h> /* O_RDONLY */
+#include <unistd.h> /* close */
+/* internal */
+#include "cache.h" /* cache_result */
+#include "err.h" /* param_err */
+#include "resource_mgr.h" /* mgr_malloc, mgr_free, mgr_open, mgr_close */
+#include "serialize.h" /* serialize64le */
+#include "types.h" /* bool, u8, u64, UINT64_C, size_t, sized_buf */
+#include "util.h" /* read_to_sized_buf, write_obj */
+
+/* the parameters of the 64-bit FNV-1a hash function */
+#define FNV_OFFSET_BASIS UINT64_C(0xcbf29ce484222325)
+#define FNV_PRIME UINT64_C(0x100000001b3)
+
+/* continue the FNV-1a hash with the value hash with the sz bytes at bytes */
+static u64 hash_bytes(u64 hash, const void *bytes, size_t sz) {
+    const u8 *p = bytes;
+    for (size_t i = 0; i < sz; i++) hash = (hash ^ p[i]) * FNV_PRIME;
+    return hash;
+}
+
+char *cache_path(const char *dir, const sized_buf *src, const char *settings) {
+    /* settings can't contain a null byte, so including the one at the end
+     * separates them from the source code */
+    u64 hash = hash_bytes(FNV_OFFSET_BASIS, settings, strlen(settings) + 1);
+    hash = hash_bytes(hash, src->buf, src->sz);
+    size_t dir_sz = strlen(dir);
+    /* a '/', then 16 hex digits and a null terminator */
+    char *path = mgr_malloc(dir_sz + 18);
+    memcpy(path, dir, dir_sz);
+    snprintf(path + dir_sz, 18, "/%016llx", (unsigned long long)hash);
+    return path;
+}
+
+/* Return the size of the header of entry if it's the header for src compiled
+ * with settings, followed by a program, or 0 if it's not. */
+static size_t header_sz(
+    const sized_buf *entry, const sized_buf *src, const char *settings
+) {
+    size_t settings_sz = strlen(settings) + 1;
+    u8 src_sz[8];
+    serialize64le(src->sz, src_sz);
+    size_t hdr_sz = settings_sz + 8 + src->sz;
+    const u8 *hdr = entry->buf;
+    /* no compiled program is ever empty, so an entry without one isn't used */
+    if (entry->sz <= hdr_sz || memcmp(hdr, settings, settings_sz) != 0 ||
+        memcmp(hdr + settings_sz, src_sz, 8) != 0 ||
+        memcmp(hdr + settings_sz + 8, src->buf, src->sz) != 0) {
+        return 0;
+    }
+    return hdr_sz;
+}
+
+cache_result cache_fetch(
+    const char *path, const sized_buf *src, const char *settings, int dst_fd
+) {
+    int fd = mgr_open(path, O_RDONLY);
+    if (fd < 0) return CACHE_MISS;
+    sized_buf entry = read_to_sized_buf(fd);
+    mgr_close(fd);
+    if (entry.buf == NULL) return CACHE_MISS;
+    cache_result ret = CACHE_MISS;
+    size_t hdr_sz = header_sz(&entry, src, settings);
+    if (hdr_sz) {
+        const u8 *program = (const u8 *)entry.buf + hdr_sz;
+        ret = write_obj(dst_fd, program, entry.sz - hdr_sz) ? CACHE_HIT :
+                                                              CACHE_ERROR;
+    }
+    mgr_free(entry.buf);
+    return ret;
+}
+
+bool cache_store(
+    const char *path,
+    const sized_buf *src,
+    const char *settings,
+    const char *outname
+) {
+    int out_fd = mgr_open(outname, O_RDONLY);
+    if (out_fd < 0) {
+        param_err("OPEN_R_FAILED", "Failed to open {} for reading.", outname);
+        return false;
+    }
+    sized_buf out = read_to_sized_buf(out_fd);
+    mgr_close(out_fd);
+    if (out.buf == NULL) return false;
+
+    size_t path_sz = strlen(path);
+    char *tmp_path = mgr_malloc(path_sz + sizeof(".XXXXXX"));
+    memcpy(tmp_path, path, path_sz);
+    memcpy(tmp_path + path_sz, ".XXXXXX", sizeof(".XXXXXX"));
+    int tmp_fd = mkstemp(tmp_path);
+    u8 src_sz[8];
+    serialize64le(src->sz, src_sz);
+    bool ret = tmp_fd >= 0 &&
+               write_obj(tmp_fd, settings, strlen(settings) + 1) &&
+               write_obj(tmp_fd, src_sz, 8) &&
+               write_obj(tmp_fd, src->buf, src->sz) &&
+               write_obj(tmp_fd, out.buf, out.sz);
+    if (tmp_fd >= 0) {
+        if (close(tmp_fd) != 0) ret = false;
+        if (ret) ret = rename(tmp_path, path) == 0;
+        if (!ret) remove(tmp_path);
+    }
+    if (!ret) {
+        param_err(
+            "CACHE_STORE_FAILED",
+            "Failed to store {} in the compilation cache.",
+            outname
+        );
+    }
+    mgr_free(tmp_path);
+    mgr_free(out.buf);
+    return ret;
+}
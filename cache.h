@@ -0,0 +1,64 @@
+/* SPDX-FileCopyrightText: 2025 Eli Array Minkoff
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * Provides an interface to cache.c, which stores compiled programs in a cache
+ * directory, so that compiling the same source code with the same settings
+ * again can copy the stored program instead. */
+
+#ifndef EAMBFC_CACHE_H
+#define EAMBFC_CACHE_H 1
+/* internal */
+#include "types.h" /* bool, sized_buf */
+
+/* the result of looking up a program in the cache */
+typedef enum {
+    /* there's no program stored for the source code and settings */
+    CACHE_MISS,
+    /* the stored program was copied to the destination */
+    CACHE_HIT,
+    /* there was a stored program, but copying it failed, and an error was
+     * printed */
+    CACHE_ERROR
+} cache_result;
+
+/* Return the path of the entry in the cache directory dir for the source code
+ * in src, compiled with the given settings, as a string allocated with
+ * mgr_malloc.
+ *
+ * Entries are named after a 64-bit FNV-1a hash of settings followed by src,
+ * written in hexadecimal. settings must contain everything other than the
+ * source code that affects the compiled program, including the version of
+ * eambfc itself. */
+char *cache_path(const char *dir, const sized_buf *src, const char *settings);
+
+/* If there's a program stored in the cache entry at path for the source code in
+ * src compiled with settings, write it to dst_fd. The whole of src and settings
+ * are stored in the entry and compared, so a program stored for other source
+ * code or settings with the same hash is never used.
+ *
+ * Returns CACHE_HIT if it was written, CACHE_MISS if there wasn't one, and
+ * CACHE_ERROR if writing it to dst_fd failed, in which case dst_fd may have
+ * been partially written to. */
+cache_result cache_fetch(
+    const char *path, const sized_buf *src, const char *settings, int dst_fd
+);
+
+/* Store the compiled program in the file outname in the cache entry at path,
+ * along with the source code in src and the settings it was compiled with.
+ *
+ * It's written to a new temporary file in the cache directory, which then
+ * replaces any existing entry in a single rename, so that other processes
+ * using the same cache directory at the same time never see a partially-written
+ * entry.
+ *
+ * Returns true if it was stored, and prints an error and returns false if not.
+ * Either way, the file outname is left as it was. */
+bool cache_store(
+    const char *path,
+    const sized_buf *src,
+    const char *settings,
+    const char *outname
+);
+
+#endif /* EAMBFC_CACHE_H */
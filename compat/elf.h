@@ -143,4 +143,54 @@ typedef struct {
 #define PF_W    2    /* Segment is writable */
 #define PF_R    4    /* Segment is readable */
 
+/* Section header.  */
+
+typedef struct {
+    Elf64_Word  sh_name;      /* Section name (string tbl index) */
+    Elf64_Word  sh_type;      /* Section type */
+    Elf64_Xword sh_flags;     /* Section flags */
+    Elf64_Addr  sh_addr;      /* Section virtual addr at execution */
+    Elf64_Off   sh_offset;    /* Section file offset */
+    Elf64_Xword sh_size;      /* Section size in bytes */
+    Elf64_Word  sh_link;      /* Link to another section */
+    Elf64_Word  sh_info;      /* Additional section information */
+    Elf64_Xword sh_addralign; /* Section alignment */
+    Elf64_Xword sh_entsize;   /* Entry size if section holds table */
+} Elf64_Shdr;
+
+/* values used for sh_type (section type).  */
+
+#define SHT_NULL     0 /* Section header table entry unused */
+#define SHT_PROGBITS 1 /* Program data */
+#define SHT_SYMTAB   2 /* Symbol table */
+#define SHT_STRTAB   3 /* String table */
+
+/* values used for sh_flags (section flags).  */
+
+#define SHF_ALLOC     2 /* Occupies memory during execution */
+#define SHF_EXECINSTR 4 /* Executable */
+
+/* Symbol table entry.  */
+
+typedef struct {
+    Elf64_Word    st_name;  /* Symbol name (string tbl index) */
+    unsigned char st_info;  /* Symbol type and binding */
+    unsigned char st_other; /* Symbol visibility */
+    Elf64_Half    st_shndx; /* Section index */
+    Elf64_Addr    st_value; /* Symbol value */
+    Elf64_Xword   st_size;  /* Symbol size */
+} Elf64_Sym;
+
+/* How to construct st_info from a symbol's binding and type.  */
+
+#define ELF64_ST_INFO(bind, type) (((bind) << 4) + ((type) & 0xf))
+
+/* value used for the binding in st_info (symbol binding).  */
+
+#define STB_LOCAL 0 /* Local symbol */
+
+/* value used for the type in st_info (symbol type).  */
+
+#define STT_FUNC 2 /* Symbol is a code object */
+
 #endif  /* elf.h */
@@ -6,27 +6,37 @@
  * It is by far the most significant part of the EAMBFC codebase. */
 
 /* C99 */
-#include <stdio.h> /* sscanf */
-#include <string.h> /* memcpy */
+#include <stdint.h> /* SIZE_MAX */
+#include <stdio.h> /* snprintf */
+#include <stdlib.h> /* qsort */
+#include <string.h> /* memchr, memcpy */
 /* POSIX */
-#include <unistd.h> /* off_t, read, write, STD*_FILENO*/
+#include <sys/uio.h> /* struct iovec */
+#include <unistd.h> /* read, STD*_FILENO */
 /* internal */
-#include "arch_inter.h" /* arch_registers, arch_sc_nums, arch_inter */
-#include "compat/elf.h" /* Elf64_Ehdr, Elf64_Phdr, ELFDATA2[LM]SB */
+#include "arch_inter.h" /* arch_inter, arch_max_sizes */
+#include "compat/elf.h" /* Elf64_*, ELFDATA2[LM]SB, S[HT][TFBN]_*, ... */
+#include "compile.h" /* bf_compile_ctx, jump_loc */
 #include "err.h" /* *_err */
-#include "optimize.h" /* to_ir */
+#include "optimize.h" /* ir_instr, IR_*, partial_eval, to_ir */
+#include "profile.h" /* loop_is_hot, loop_profile */
 #include "resource_mgr.h" /* mgr_* */
-#include "serialize.h" /* serialize_*hdr64_[bl]e */
-#include "types.h" /* bool, [iu]{8,16,32,64}, SCNx64, sized_buf */
-#include "util.h" /* read_to_sized_buf, write_obj */
+#include "serialize.h" /* serialize{32,64,_*hdr64_,_sym64_}[bl]e */
+#include "types.h" /* bool, [iu]{8,16,32,64}, ssize_t, sized_buf */
+#include "util.h" /* *_sized_buf, *_obj, time_ns */
 
 /* virtual memory address of the tape - cannot overlap with the machine code.
  * 0 is invalid as it's the null address, so this is an arbitrarily-chosen
- * starting point that's easy to reason about. */
-#define TAPE_ADDRESS 0x10000
+ * starting point that's easy to reason about, or if placing the tape for huge
+ * pages, the first huge page boundary after it. */
+#define TAPE_ADDRESS(huge) ((huge) ? HUGE_PAGE_SZ : 0x10000)
 
-/* number of entries in program and section header tables respectively */
-#define PHNUM 2 /* one for the tape, and one for the code. */
+/* maximum number of entries in the program header table - one for the tape,
+ * one for the code, one for the buffered I/O segment, if it's used, and one for
+ * the loop counters, if profiling. */
+#define MAX_PHNUM 4
+/* number of entries in the program header table for a given compilation. */
+#define PHNUM(buffered, profiled) (2 + !!(buffered) + !!(profiled))
 
 /* size of the Ehdr struct, once serialized. */
 #define EHDR_SIZE 64
@@ -34,35 +44,108 @@
 /* Sizes of a single PHDR table entry */
 #define PHDR_SIZE 56
 /* sizes of the full program header table */
-#define PHTB_SIZE (PHNUM * PHDR_SIZE)
+#define PHTB_SIZE(phnum) ((phnum) * PHDR_SIZE)
+
+/* the number of entries in the section header table, and the indexes of the
+ * sections in it, if the output file has symbols */
+#define SHNUM 6
+#define SHNDX_TEXT 1
+#define SHNDX_SYMTAB 2
+#define SHNDX_STRTAB 3
+#define SHNDX_LINES 4
+#define SHNDX_SHSTRTAB 5
+
+/* size of a section header table entry, symbol table entry, and .bf_lines
+ * entry */
+#define SHDR_SIZE 64
+#define SYM_SIZE 24
+#define LINE_SIZE 16
 
 #define TAPE_SIZE(tb) (tb * 0x1000)
+
+/* the advice values for madvise that are used for the tape, which are the same
+ * for every architecture Linux supports */
+#define MADV_SEQUENTIAL 2
+#define MADV_HUGEPAGE 14
+
+/* virtual address of the buffered I/O segment - leave an unmapped 4 KiB page
+ * between it and the end of the tape, so that running off of the end of the
+ * tape segfaults instead of silently corrupting the buffers. */
+#define IO_ADDRESS(tb, huge) (TAPE_ADDRESS(huge) + TAPE_SIZE(tb) + 0x1000)
+
+/* end of the tape, or of the I/O segment, if it's used */
+#define DATA_END(tb, huge, buffered) \
+    ((buffered) ? IO_ADDRESS(tb, huge) + IO_SEG_SZ \
+                : TAPE_ADDRESS(huge) + TAPE_SIZE(tb))
+
+/* virtual address of the loop counters, if profiling - like the I/O segment,
+ * leave an unmapped page before it. */
+#define PROFILE_ADDRESS(tb, huge, buffered) \
+    (DATA_END(tb, huge, buffered) + 0x1000)
+
+/* size of the segment with the loop counters for a given number of loops,
+ * which is never empty */
+#define PROFILE_SEG_SZ(loops) (((loops) ? (loops) : 1) * 8)
+
+/* end of the last segment loaded before the machine code, given the size of the
+ * loop counters' segment, or 0 if not profiling */
+#define SEGS_END(tb, huge, buffered, profile_sz) \
+    ((profile_sz) ? PROFILE_ADDRESS(tb, huge, buffered) + (profile_sz) \
+                  : DATA_END(tb, huge, buffered))
+
 /* virtual address of the section containing the machine code
- * should be after the tape ends to avoid overlapping with the tape.
+ * should be after the tape and other writable segments end to avoid
+ * overlapping with them.
  *
- * Zero out the lowest 2 bytes of the end of the tape and add 0x10000 to ensure
- * that there is enough room. */
-#define LOAD_VADDR(tb) (((TAPE_ADDRESS + TAPE_SIZE(tb)) & (~0xffff)) + 0x10000)
+ * Zero out the lowest 2 bytes of the end of the last segment and add 0x10000 to
+ * ensure that there is enough room. */
+#define LOAD_VADDR(tb, huge, buffered, profile_sz) \
+    ((SEGS_END(tb, huge, buffered, profile_sz) & (~0xffff)) + 0x10000)
 
-/* physical address of the starting instruction
- * use the same technique as LOAD_VADDR to ensure that it is at a 256-byte
- * boundary. */
-#define START_PADDR (((EHDR_SIZE + PHTB_SIZE) & ~0xff) + 0x100)
+/* physical address of the starting instruction, given the number of entries in
+ * the program header table. Use the same technique as LOAD_VADDR to ensure that
+ * it is at a 256-byte boundary. */
+#define START_PADDR(phnum) \
+    (((EHDR_SIZE + PHTB_SIZE(phnum)) & ~0xff) + 0x100)
 
-/* number of padding bytes between the end of the Program Header Table and the
- * beginning of the machine code. */
-#define PAD_SZ (START_PADDR - (PHTB_SIZE + EHDR_SIZE))
+/* offset within the file of the initial tape contents, if there are any. It's
+ * after the end of the machine code, at the next 4-KiB boundary, as the offset
+ * must match TAPE_ADDRESS modulo the segment's alignment, which is 4 KiB when
+ * there are initial contents. */
+#define TAPE_INIT_OFFSET(phnum, code_sz) \
+    ((START_PADDR(phnum) + (code_sz) + 0xfff) & ~0xfff)
 
-static uint _line, _col;
+/* the most pieces that bf_compile splits the output file into */
+#define MAX_PARTS 5
+
+/* write the parts_ct buffers in parts to dst, in order, with a single writev
+ * call if possible, returning false after printing an error if that failed */
+static bool emit(bf_dest *dst, struct iovec *parts, int parts_ct) {
+    if (dst->buf == NULL) return writev_obj(dst->fd, parts, parts_ct);
+    bool ret = true;
+    for (int i = 0; ret && i < parts_ct; i++) {
+        ret = append_obj(dst->buf, parts[i].iov_base, parts[i].iov_len);
+    }
+    return ret;
+}
 
-/* Write the ELF header to the file descriptor fd. */
-static bool write_ehdr(int fd, u64 tape_blocks, const arch_inter *inter) {
+/* Serialize the ELF header into header_bytes. profile_sz is the size of the
+ * loop counters' segment, or 0 if not profiling, and shoff is the offset of the
+ * section header table, or 0 if there isn't one. */
+static void build_ehdr(
+    char header_bytes[EHDR_SIZE],
+    u64 tape_blocks,
+    bool huge_tape,
+    bool buffered,
+    u64 profile_sz,
+    u64 shoff,
+    const arch_inter *inter
+) {
     /* The format of the ELF header is well-defined and well-documented
      * elsewhere. The struct for it is defined in compat/elf.h, as are most
      * of the values used in here. */
 
     Elf64_Ehdr header;
-    char header_bytes[EHDR_SIZE];
 
     /* the first 4 bytes are "magic values" that are pre-defined and used to
      * identify the format. */
@@ -105,13 +188,13 @@ static bool write_ehdr(int fd, u64 tape_blocks, const arch_inter *inter) {
      * to make sense of them in this order. */
 
     /* the number of program and section table entries, respectively */
-    header.e_phnum = PHNUM;
-    header.e_shnum = 0;
+    header.e_phnum = PHNUM(buffered, profile_sz);
+    header.e_shnum = shoff ? SHNUM : 0;
 
     /* The offset within the file for the program and section header tables
      * respectively. */
     header.e_phoff = EHDR_SIZE; /* start right after the EHDR ends */
-    header.e_shoff = 0;
+    header.e_shoff = shoff;
 
     /* the size of the ELF header as a value within the ELF header, for some
      * reason. I don't make the rules about the format. */
@@ -121,16 +204,18 @@ static bool write_ehdr(int fd, u64 tape_blocks, const arch_inter *inter) {
      * program and section header tables respectively. If there are no entries
      * within a given table, the size should be set to 0. */
     header.e_phentsize = PHDR_SIZE;
-    header.e_shentsize = 0;
+    header.e_shentsize = shoff ? SHDR_SIZE : 0;
 
     /* Section header string table index - the index of the entry in the
      * section header table pointing to the names of each section.
-     * Because no such section exists, set it to SHN_UNDEF. */
-    header.e_shstrndx = SHN_UNDEF;
+     * If no such section exists, set it to SHN_UNDEF. */
+    header.e_shstrndx = shoff ? SHNDX_SHSTRTAB : SHN_UNDEF;
 
     /* e_entry is the virtual memory address of the program's entry point -
      * (i.e. the first instruction to execute). */
-    header.e_entry = LOAD_VADDR(tape_blocks) + START_PADDR;
+    header.e_entry =
+        LOAD_VADDR(tape_blocks, huge_tape, buffered, profile_sz) +
+        START_PADDR(header.e_phnum);
 
     /* e_flags has a processor-specific meaning. For x86_64, no values are
      * defined, and it should be set to 0. */
@@ -141,35 +226,46 @@ static bool write_ehdr(int fd, u64 tape_blocks, const arch_inter *inter) {
     } else {
         serialize_ehdr64_be(&header, header_bytes);
     }
-
-    return write_obj(fd, header_bytes, EHDR_SIZE);
 }
 
-/* Write the Program Header Table to the file descriptor fd
+/* Serialize the Program Header Table into phdr_table_bytes
  * This is a list of areas within memory to set up when starting the program. */
-static bool write_phtb(
-    int fd, size_t code_sz, u64 tape_blocks, const arch_inter *inter
+static void build_phtb(
+    char phdr_table_bytes[PHTB_SIZE(MAX_PHNUM)],
+    size_t code_sz,
+    size_t tape_init_sz,
+    u64 tape_blocks,
+    bool huge_tape,
+    bool buffered,
+    u64 profile_sz,
+    const arch_inter *inter
 ) {
-    Elf64_Phdr phdr_table[PHNUM];
-    char phdr_table_bytes[PHTB_SIZE];
+    int phnum = PHNUM(buffered, profile_sz);
+    Elf64_Phdr phdr_table[MAX_PHNUM];
 
     /* header for the tape contents section */
     phdr_table[0].p_type = PT_LOAD;
     /* It is readable and writable */
     phdr_table[0].p_flags = PF_R | PF_W;
     /* Load initial bytes from this offset within the file */
-    phdr_table[0].p_offset = 0;
+    phdr_table[0].p_offset =
+        tape_init_sz ? TAPE_INIT_OFFSET(phnum, code_sz) : 0;
     /* Start at this memory address */
-    phdr_table[0].p_vaddr = TAPE_ADDRESS;
+    phdr_table[0].p_vaddr = TAPE_ADDRESS(huge_tape);
     /* Load from this physical address */
     phdr_table[0].p_paddr = 0;
-    /* Size within the file on disk - 0, as the tape is empty. */
-    phdr_table[0].p_filesz = 0;
+    /* Size within the file on disk - 0 unless running part of the program at
+     * compile time left some cells nonzero, as the tape is empty otherwise. */
+    phdr_table[0].p_filesz = tape_init_sz;
     /* Size within memory - must be at least p_filesz.
      * In this case, it's the size of the tape itself. */
     phdr_table[0].p_memsz = TAPE_SIZE(tape_blocks);
-    /* supposed to be a power of 2, went with 2^12 */
-    phdr_table[0].p_align = 0x1000;
+    /* supposed to be a power of 2, went with 2^12, or the size of a huge page
+     * if placing the tape for them - but p_offset must match p_vaddr modulo
+     * p_align, and padding the initial contents to a huge page boundary within
+     * the file would waste too much space, so not if there are any. */
+    phdr_table[0].p_align =
+        (huge_tape && !tape_init_sz) ? HUGE_PAGE_SZ : 0x1000;
 
     /* header for the segment that contains the actual binary */
     phdr_table[1].p_type = PT_LOAD;
@@ -178,20 +274,46 @@ static bool write_phtb(
     /* Load initial bytes from this offset within the file */
     phdr_table[1].p_offset = 0;
     /* Start at this memory address */
-    phdr_table[1].p_vaddr = LOAD_VADDR(tape_blocks);
+    phdr_table[1].p_vaddr =
+        LOAD_VADDR(tape_blocks, huge_tape, buffered, profile_sz);
     /* Load from this physical address */
     phdr_table[1].p_paddr = 0;
     /* Size within the file on disk - the size of the whole file, as this
      * segment contains the whole thing. */
-    phdr_table[1].p_filesz = START_PADDR + code_sz;
+    phdr_table[1].p_filesz = START_PADDR(phnum) + code_sz;
     /* size within memory - must be at least p_filesz.
      * In this case, it's the size of the whole file, as the whole file is
      * loaded into this segment */
-    phdr_table[1].p_memsz = START_PADDR + code_sz;
+    phdr_table[1].p_memsz = START_PADDR(phnum) + code_sz;
     /* supposed to be a power of 2, went with 2^0 */
     phdr_table[1].p_align = 1;
 
-    for (int i = 0; i < PHNUM; i++) {
+    /* header for the buffered I/O segment, which, like the tape, is readable,
+     * writable, and starts out zeroed. */
+    phdr_table[2].p_type = PT_LOAD;
+    phdr_table[2].p_flags = PF_R | PF_W;
+    phdr_table[2].p_offset = 0;
+    phdr_table[2].p_vaddr = IO_ADDRESS(tape_blocks, huge_tape);
+    phdr_table[2].p_paddr = 0;
+    phdr_table[2].p_filesz = 0;
+    phdr_table[2].p_memsz = IO_SEG_SZ;
+    phdr_table[2].p_align = 0x1000;
+
+    /* header for the loop counters, which are also readable, writable, and
+     * start out zeroed. It comes right after the I/O segment if it's used. */
+    Elf64_Phdr *counters = &phdr_table[buffered ? 3 : 2];
+    if (profile_sz) {
+        counters->p_type = PT_LOAD;
+        counters->p_flags = PF_R | PF_W;
+        counters->p_offset = 0;
+        counters->p_vaddr = PROFILE_ADDRESS(tape_blocks, huge_tape, buffered);
+        counters->p_paddr = 0;
+        counters->p_filesz = 0;
+        counters->p_memsz = profile_sz;
+        counters->p_align = 0x1000;
+    }
+
+    for (int i = 0; i < phnum; i++) {
         if (inter->ELF_DATA == ELFDATA2LSB) {
             serialize_phdr64_le(
                 &(phdr_table[i]), &(phdr_table_bytes[i * PHDR_SIZE])
@@ -202,8 +324,6 @@ static bool write_phtb(
             );
         }
     }
-
-    return write_obj(fd, phdr_table_bytes, PHTB_SIZE);
 }
 
 /* The brainfuck instructions "." and "," are similar from an implementation
@@ -239,27 +359,141 @@ static bool bf_io(
 /* number of indexes in the jump stack to allocate for at a time */
 #define JUMP_CHUNK_SZ 64
 
-typedef struct jump_loc {
-    uint src_line; /* saved for error reporting. */
-    uint src_col; /* saved for error reporting. */
-    off_t dst_loc;
-} jump_loc;
+void bf_ctx_init(bf_compile_ctx *ctx) {
+    ctx->line = 1;
+    ctx->col = 0;
+    ctx->io_addr = 0;
+    ctx->profile_addr = 0;
+    ctx->profile_locs.sz = 0;
+    ctx->profile_locs.capacity = 4096;
+    ctx->profile_locs.buf = mgr_malloc(4096);
+    ctx->jump_stack.index = 0;
+    ctx->jump_stack.loc_sz = JUMP_CHUNK_SZ;
+    ctx->jump_stack.locations = mgr_malloc(JUMP_CHUNK_SZ * sizeof(jump_loc));
+    ctx->jump_mode = JUMPS_LONG;
+    ctx->loop_index = 0;
+    ctx->loop_flags.sz = 0;
+    ctx->loop_flags.capacity = 4096;
+    ctx->loop_flags.buf = mgr_malloc(4096);
+    ctx->align_loops = false;
+    ctx->inner_loops = 0;
+    ctx->guide = NULL;
+    ctx->cell_cached = false;
+    ctx->cell_dirty = false;
+    ctx->debug_info = false;
+    ctx->loop_regions.sz = 0;
+    ctx->loop_regions.capacity = 4096;
+    ctx->loop_regions.buf = mgr_malloc(4096);
+    ctx->src_locs.sz = 0;
+    ctx->src_locs.capacity = 4096;
+    ctx->src_locs.buf = mgr_malloc(4096);
+    ctx->const_refs.sz = 0;
+    ctx->const_refs.capacity = 4096;
+    ctx->const_refs.buf = mgr_malloc(4096);
+    ctx->tape_init.sz = 0;
+    ctx->tape_init.capacity = 4096;
+    ctx->tape_init.buf = mgr_malloc(4096);
+    ctx->obj_code.sz = 0;
+    ctx->obj_code.capacity = 4096;
+    ctx->obj_code.buf = mgr_malloc(4096);
+    ctx->stats = (compile_stats){0};
+}
+
+void bf_ctx_cleanup(bf_compile_ctx *ctx) {
+    mgr_free(ctx->jump_stack.locations);
+    if (ctx->profile_locs.buf != NULL) mgr_free(ctx->profile_locs.buf);
+    if (ctx->loop_flags.buf != NULL) mgr_free(ctx->loop_flags.buf);
+    if (ctx->loop_regions.buf != NULL) mgr_free(ctx->loop_regions.buf);
+    if (ctx->src_locs.buf != NULL) mgr_free(ctx->src_locs.buf);
+    if (ctx->const_refs.buf != NULL) mgr_free(ctx->const_refs.buf);
+    if (ctx->tape_init.buf != NULL) mgr_free(ctx->tape_init.buf);
+    if (ctx->obj_code.buf != NULL) mgr_free(ctx->obj_code.buf);
+    ctx->jump_stack.locations = NULL;
+    ctx->profile_locs.buf = NULL;
+    ctx->loop_flags.buf = NULL;
+    ctx->loop_regions.buf = NULL;
+    ctx->src_locs.buf = NULL;
+    ctx->const_refs.buf = NULL;
+    ctx->tape_init.buf = NULL;
+    ctx->obj_code.buf = NULL;
+}
+
+/* When optimizing, the current cell is kept in the cell register across
+ * straight-line code, so that runs of instructions that change it only load it
+ * once, and only store it once. It's written back before anything that reads it
+ * from the tape or moves bf_ptr, and loop tests always use the register, so at
+ * the start and end of every loop, it's loaded and matches the tape.
+ *
+ * store_cell writes it back if it changed, load_cell loads it if it isn't
+ * loaded already, and drop_cell writes it back, then forgets it. */
+static bool store_cell(bf_compile_ctx *ctx, const arch_inter *inter) {
+    if (!ctx->cell_dirty) return true;
+    ctx->cell_dirty = false;
+    return inter->FUNCS->store_byte(
+        inter->REGS->bf_ptr, inter->REGS->cell, &ctx->obj_code
+    );
+}
+
+static bool load_cell(bf_compile_ctx *ctx, const arch_inter *inter) {
+    if (ctx->cell_cached) return true;
+    ctx->cell_cached = true;
+    return inter->FUNCS->load_byte(
+        inter->REGS->bf_ptr, inter->REGS->cell, &ctx->obj_code
+    );
+}
+
+static bool drop_cell(bf_compile_ctx *ctx, const arch_inter *inter) {
+    ctx->cell_cached = false;
+    return store_cell(ctx, inter);
+}
+
+/* Serialize the 32-bit value v32 in the byte order of inter to dest */
+static void serialize32(const arch_inter *inter, u32 v32, void *dest) {
+    if (inter->ELF_DATA == ELFDATA2LSB) {
+        serialize32le(v32, dest);
+    } else {
+        serialize32be(v32, dest);
+    }
+}
+
+/* Same as serialize32, but for 64-bit values */
+static void serialize64(const arch_inter *inter, u64 v64, void *dest) {
+    if (inter->ELF_DATA == ELFDATA2LSB) {
+        serialize64le(v64, dest);
+    } else {
+        serialize64be(v64, dest);
+    }
+}
 
-static struct jump_stack {
-    size_t index;
-    size_t loc_sz;
-    jump_loc *locations;
-} jump_stack;
+/* When profiling, count another run of the body of the loop with the given
+ * index, recording its source location for the profile if it's the first time
+ * that loop has been compiled. */
+static bool count_loop(
+    bf_compile_ctx *ctx, const arch_inter *inter, size_t loop_index
+) {
+    if (!ctx->profile_addr) return true;
+    /* each loop's location takes up 8 bytes, as does its counter */
+    if (ctx->profile_locs.sz / 8 == loop_index) {
+        char loc[8];
+        serialize32(inter, ctx->line, loc);
+        serialize32(inter, ctx->col, &loc[4]);
+        if (!append_obj(&ctx->profile_locs, loc, 8)) return false;
+    }
+    return inter->FUNCS->inc_counter(
+        ctx->profile_addr + 8 * (i64)loop_index, &ctx->obj_code
+    );
+}
 
 /* prepare to compile the brainfuck `[` instruction to file descriptor fd.
  * doesn't actually write to the file yet, as the address of `]` is unknown.
  *
  * If too many nested loops are encountered, it exteds the jump stack. */
-static bool bf_jump_open(sized_buf *obj_code, const arch_inter *inter) {
+static bool bf_jump_open(bf_compile_ctx *ctx, const arch_inter *inter) {
+    struct jump_stack *jump_stack = &ctx->jump_stack;
     /* ensure that there are no more than the maximum nesting level */
-    if (jump_stack.index + 1 == jump_stack.loc_sz) {
-        if (jump_stack.loc_sz < SIZE_MAX - JUMP_CHUNK_SZ) {
-            jump_stack.loc_sz += JUMP_CHUNK_SZ;
+    if (jump_stack->index + 1 == jump_stack->loc_sz) {
+        if (jump_stack->loc_sz < SIZE_MAX - JUMP_CHUNK_SZ) {
+            jump_stack->loc_sz += JUMP_CHUNK_SZ;
         } else {
             basic_err(
                 "TOO_MANY_NESTED_LOOPS",
@@ -268,42 +502,102 @@ static bool bf_jump_open(sized_buf *obj_code, const arch_inter *inter) {
             return false;
         }
 
-        jump_stack.locations = mgr_realloc(
-            jump_stack.locations,
-            (jump_stack.index + 1 + JUMP_CHUNK_SZ) * sizeof(jump_loc)
+        jump_stack->locations = mgr_realloc(
+            jump_stack->locations,
+            (jump_stack->index + 1 + JUMP_CHUNK_SZ) * sizeof(jump_loc)
         );
     }
+    /* pick the jump encodings and alignment to use for this loop */
+    u8 flags = 0;
+    if (ctx->jump_mode == JUMPS_MEASURE) {
+        /* leave room to record them once the loop is closed */
+        if (!append_obj(&ctx->loop_flags, &flags, 1)) {
+            /* loop_flags is gone, so nothing more can be recorded */
+            ctx->jump_mode = JUMPS_LONG;
+            return false;
+        }
+    } else if (ctx->jump_mode == JUMPS_RELAXED) {
+        flags = ((u8 *)ctx->loop_flags.buf)[ctx->loop_index];
+    }
+    bool short_jump = flags & LOOP_SHORT;
+    /* the jump tests the cell register, so it must be up to date */
+    if (!store_cell(ctx, inter) || !load_cell(ctx, inter)) return false;
     /* push the current address onto the stack */
-    jump_stack.locations[jump_stack.index].src_line = _line;
-    jump_stack.locations[jump_stack.index].src_col = _col;
-    jump_stack.locations[jump_stack.index].dst_loc = obj_code->sz;
-    jump_stack.index++;
+    jump_loc *loc = &jump_stack->locations[jump_stack->index++];
+    loc->src_line = ctx->line;
+    loc->src_col = ctx->col;
+    loc->dst_loc = ctx->obj_code.sz;
+    loc->loop_index = ctx->loop_index++;
+    loc->inner_before = ctx->inner_loops;
+    loc->short_jump = short_jump;
     /* fill space jump open will take with NOP instructions of the same length,
-     * so that obj_code->sz remains properly sized. */
-    return inter->FUNCS->nop_loop_open(obj_code);
+     * so that obj_code.sz remains properly sized. */
+    if (!inter->FUNCS->nop_loop_open(short_jump, &ctx->obj_code)) return false;
+    /* The body of the loop starts right after the jump, so if it's not at a
+     * boundary, replace the jump with NOP padding to move it to the next one,
+     * followed by the jump. */
+    u8 pad = (inter->LOOP_ALIGN - ctx->obj_code.sz % inter->LOOP_ALIGN) %
+             inter->LOOP_ALIGN;
+    if ((flags & LOOP_ALIGNED) && pad != 0) {
+        ctx->obj_code.sz = loc->dst_loc;
+        loc->dst_loc += pad;
+        if (!inter->FUNCS->pad_nops(pad, &ctx->obj_code) ||
+            !inter->FUNCS->nop_loop_open(short_jump, &ctx->obj_code)) {
+            return false;
+        }
+    }
+    return count_loop(ctx, inter, loc->loop_index);
 }
 
 /* compile matching `[` and `]` instructions
  * called when `]` is the instruction to be compiled */
-static bool bf_jump_close(sized_buf *obj_code, const arch_inter *inter) {
-    off_t open_addr;
+static bool bf_jump_close(bf_compile_ctx *ctx, const arch_inter *inter) {
+    sized_buf *obj_code = &ctx->obj_code;
+    const jump_loc *open_loc;
+    size_t open_addr;
     i32 distance;
 
     /* ensure that the current index is in bounds */
-    if (jump_stack.index == 0) {
+    if (ctx->jump_stack.index == 0) {
         position_err(
             "UNMATCHED_CLOSE",
             "Found ']' without matching '['.",
             ']',
-            _line,
-            _col
+            ctx->line,
+            ctx->col
         );
         return false;
     }
+    /* both ends of the loop jump to just past the other's jump, so the cell
+     * register must match the tape before the jumps at both ends */
+    if (!store_cell(ctx, inter) || !load_cell(ctx, inter)) return false;
     /* pop the matching `[` instruction's location */
-    open_addr = jump_stack.locations[--jump_stack.index].dst_loc;
+    open_loc = &ctx->jump_stack.locations[--ctx->jump_stack.index];
+    open_addr = open_loc->dst_loc;
     distance = obj_code->sz - open_addr;
 
+    if (ctx->jump_mode == JUMPS_MEASURE) {
+        u8 *flags = &((u8 *)ctx->loop_flags.buf)[open_loc->loop_index];
+        /* record whether the loop is short enough for the short jump
+         * encodings. Making other loops use them can only ever shrink it
+         * further, but aligning the innermost loops within it can grow it by
+         * up to LOOP_ALIGN - 1 bytes each, so leave room for that. */
+        size_t inner = ctx->inner_loops - open_loc->inner_before;
+        if (inner <= (size_t)inter->SHORT_JUMP_MAX / inter->LOOP_ALIGN &&
+            distance + (i64)inner * (inter->LOOP_ALIGN - 1) <=
+                inter->SHORT_JUMP_MAX) {
+            *flags |= LOOP_SHORT;
+        }
+        /* if no loops were opened after this one, it's an innermost loop, and
+         * when there's a profile, it's only aligned if it's hot */
+        if (ctx->align_loops && open_loc->loop_index + 1 == ctx->loop_index &&
+            (ctx->guide == NULL ||
+             loop_is_hot(ctx->guide, open_loc->src_line, open_loc->src_col))) {
+            *flags |= LOOP_ALIGNED;
+            ctx->inner_loops++;
+        }
+    }
+
     /* This is messy, but cuts down the number of allocations massively.
      * Because the NOP padding added earlier is the same size as the jump point,
      * if it made it this far, then enough space is allocated. By reporting the
@@ -314,26 +608,169 @@ static bool bf_jump_close(sized_buf *obj_code, const arch_inter *inter) {
 
     sized_buf tmp_buf = {open_addr, obj_code->capacity, obj_code->buf};
 
-    if (!inter->FUNCS->jump_zero(inter->REGS->bf_ptr, distance, &tmp_buf)) {
+    if (!inter->FUNCS->jump_zero(
+            inter->REGS->cell, distance, open_loc->short_jump, &tmp_buf
+        )) {
         return false;
     }
 
     /* jumps to right after the `[` instruction, to skip a redundant check */
-    return inter->FUNCS->jump_not_zero(
-        inter->REGS->bf_ptr, -distance, obj_code
+    if (!inter->FUNCS->jump_not_zero(
+            inter->REGS->cell, -distance, open_loc->short_jump, obj_code
+        )) {
+        return false;
+    }
+    if (!ctx->debug_info) return true;
+    code_region region = {
+        .start = open_addr,
+        .end = obj_code->sz,
+        .line = open_loc->src_line,
+        .col = open_loc->src_col,
+    };
+    return append_obj(&ctx->loop_regions, &region, sizeof(code_region));
+}
+
+/* compile the brainfuck `.` instruction */
+static bool bf_output(bf_compile_ctx *ctx, const arch_inter *inter) {
+    /* if buffering I/O, append to the output buffer instead */
+    if (ctx->io_addr) {
+        return inter->FUNCS->buffered_write(
+            inter->REGS->bf_ptr, ctx->io_addr, &ctx->obj_code
+        );
+    }
+    return bf_io(
+        &ctx->obj_code, STDOUT_FILENO, inter->SC_NUMS->write, inter
+    );
+}
+
+/* compile the brainfuck `,` instruction */
+static bool bf_input(bf_compile_ctx *ctx, const arch_inter *inter) {
+    /* if buffering input, read from the buffer instead */
+    if (ctx->io_addr) {
+        return inter->FUNCS->buffered_read(
+            inter->REGS->bf_ptr, ctx->io_addr, &ctx->obj_code
+        );
+    }
+    return bf_io(&ctx->obj_code, STDIN_FILENO, inter->SC_NUMS->read, inter);
+}
+
+/* load the address of the constant data index bytes into the data stored after
+ * the code into the arg2 register. The address isn't known yet, so record where
+ * to fill it in once it is. */
+static bool load_const_addr(
+    bf_compile_ctx *ctx, const arch_inter *inter, size_t index
+) {
+    const_ref ref = {.code_loc = ctx->obj_code.sz, .data_index = index};
+    if (!append_obj(&ctx->const_refs, &ref, sizeof(const_ref))) return false;
+    return inter->FUNCS->load_code_addr(inter->REGS->arg2, 0, &ctx->obj_code);
+}
+
+/* compile an IR_OUTPUT_CONST instruction, which writes the len bytes of
+ * constant data starting at index within the data stored after the code. */
+static bool bf_output_const(
+    bf_compile_ctx *ctx, const arch_inter *inter, size_t index, size_t len
+) {
+    sized_buf *obj_code = &ctx->obj_code;
+    /* anything already in the output buffer needs to be written first */
+    if (ctx->io_addr &&
+        !inter->FUNCS->flush_output(ctx->io_addr, &ctx->obj_code)) {
+        return false;
+    }
+    return (
+        load_const_addr(ctx, inter, index) &&
+        inter->FUNCS->set_reg(
+            inter->REGS->sc_num, inter->SC_NUMS->write, obj_code
+        ) &&
+        inter->FUNCS->set_reg(inter->REGS->arg1, STDOUT_FILENO, obj_code) &&
+        inter->FUNCS->set_reg(inter->REGS->arg3, len, obj_code) &&
+        inter->FUNCS->syscall(obj_code)
     );
 }
 
+/* compile an IR_ZERO_RANGE or IR_SET_RANGE instruction */
+static bool bf_set_range(
+    const ir_instr *instr, bf_compile_ctx *ctx, const arch_inter *inter
+) {
+    /* any change to the current cell that's yet to be stored would otherwise
+     * overwrite its new value */
+    if (instr->offset <= 0 && instr->offset + (i64)instr->len > 0) {
+        ctx->cell_cached = false;
+        ctx->cell_dirty = false;
+    }
+    if (instr->op == IR_ZERO_RANGE) {
+        return inter->FUNCS->zero_bytes_at(
+            inter->REGS->bf_ptr, instr->offset, instr->len, &ctx->obj_code
+        );
+    }
+    return load_const_addr(ctx, inter, instr->arg) &&
+           inter->FUNCS->copy_bytes_at(
+               inter->REGS->bf_ptr,
+               instr->offset,
+               inter->REGS->arg2,
+               instr->len,
+               &ctx->obj_code
+           );
+}
+
+/* Append the constant data used by IR_OUTPUT_CONST and IR_SET_RANGE
+ * instructions to the machine code, then fill in its address in each of them.
+ */
+static bool append_consts(
+    bf_compile_ctx *ctx, const arch_inter *inter, const sized_buf *data
+) {
+    sized_buf *obj_code = &ctx->obj_code;
+    /* align the data, as not every architecture can load any address */
+    const u8 padding[4] = {0};
+    if (!append_obj(obj_code, padding, (4 - obj_code->sz % 4) % 4) ||
+        !append_obj(obj_code, data->buf, data->sz)) {
+        return false;
+    }
+    size_t data_start = obj_code->sz - data->sz;
+    const const_ref *refs = ctx->const_refs.buf;
+    for (size_t i = 0; i < ctx->const_refs.sz / sizeof(const_ref); i++) {
+        /* overwrite the placeholder in place, as bf_jump_close does */
+        sized_buf tmp_buf = {
+            refs[i].code_loc, obj_code->capacity, obj_code->buf
+        };
+        i64 offset = data_start + refs[i].data_index - refs[i].code_loc;
+        if (!inter->FUNCS->load_code_addr(
+                inter->REGS->arg2, offset, &tmp_buf
+            )) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* If recording debug info, record that the instruction at the current source
+ * location is compiled to the code starting at the end of ctx->obj_code. */
+static bool mark_src(bf_compile_ctx *ctx) {
+    if (!ctx->debug_info) return true;
+    src_loc loc = {ctx->obj_code.sz, ctx->line, ctx->col};
+    src_loc *locs = ctx->src_locs.buf;
+    size_t ct = ctx->src_locs.sz / sizeof(src_loc);
+    /* if the last instruction didn't produce any code, replace it */
+    if (ct && locs[ct - 1].code_loc == loc.code_loc) {
+        locs[ct - 1] = loc;
+        return true;
+    }
+    return append_obj(&ctx->src_locs, &loc, sizeof(src_loc));
+}
+
 /* 4 of the 8 brainfuck instructions can be compiled with instructions that take
  * the same set of parameters, so this expands to a call to the appropriate
  * function. */
-#define COMPILE_WITH(f) f(inter->REGS->bf_ptr, obj_code)
+#define COMPILE_WITH(f) f(inter->REGS->bf_ptr, &ctx->obj_code)
 
 /* compile an individual instruction (c), to the file descriptor fd.
  * passes fd along with the appropriate arguments to a function to compile that
  * particular instruction */
-static bool comp_instr(char c, sized_buf *obj_code, const arch_inter *inter) {
-    _col++;
+static bool comp_instr(char c, bf_compile_ctx *ctx, const arch_inter *inter) {
+    ctx->col++;
+    /* instructions are compiled one at a time here, so the cell register is
+     * only used for loop tests, and never kept from one to the next */
+    ctx->cell_cached = false;
+    if (memchr("+-<>.,[]", c, 8) != NULL && !mark_src(ctx)) return false;
     switch (c) {
     /* start with the simple cases handled with COMPILE_WITH */
     /* decrement the tape pointer register */
@@ -345,157 +782,800 @@ static bool comp_instr(char c, sized_buf *obj_code, const arch_inter *inter) {
     /* decrement the current tape value */
     case '-': return COMPILE_WITH(inter->FUNCS->dec_byte);
     /* write to stdout */
-    case '.':
-        return bf_io(obj_code, STDOUT_FILENO, inter->SC_NUMS->write, inter);
+    case '.': return bf_output(ctx, inter);
     /* read from stdin */
-    case ',': return bf_io(obj_code, STDIN_FILENO, inter->SC_NUMS->read, inter);
+    case ',': return bf_input(ctx, inter);
     /* `[` and `]` do their own error handling. */
-    case '[': return bf_jump_open(obj_code, inter);
-    case ']': return bf_jump_close(obj_code, inter);
+    case '[': return bf_jump_open(ctx, inter);
+    case ']': return bf_jump_close(ctx, inter);
     /* on a newline, add 1 to the line number and reset the column */
     case '\n':
-        _line++;
-        _col = 0;
+        ctx->line++;
+        ctx->col = 0;
         return true;
     /* any other characters are comments, so silently continue. */
     default: return true;
     }
 }
 
-/* similar to the above COMPILE_WITH, but with an extra parameter passed to the
- * function, so that can't be reused. */
-#define IR_COMPILE_WITH(f) f(inter->REGS->bf_ptr, ct, obj_code)
-
-/* Compile an ir instruction */
+/* Compile an IR instruction */
 static bool comp_ir_instr(
-    const char *p, sized_buf *obj_code, int *skip_ct_p, const arch_inter *inter
+    const ir_instr *instr, bf_compile_ctx *ctx, const arch_inter *inter
 ) {
-    u64 ct;
-    *skip_ct_p = 0;
-    switch (*p) {
-    /* if it's an unmodified brainfuck instruction, pass it to comp_instr */
-    case '+':
-    case '-':
-    case '<':
-    case '>':
-    case '.':
-    case ',':
-    case '[':
-    case ']':
-        return comp_instr(*p, obj_code, inter);
-        /* if it's @, then zero the byte pointed to by bf_ptr */
-    case '@': return inter->FUNCS->zero_byte(inter->REGS->bf_ptr, obj_code);
-    default:
-        /* if not one of the standalone instructions, parse out the number of
-         * consecutive instructions, and compile it with the appropriate
-         * function. */
-        if (sscanf(p + 1, "%" SCNx64 "%n", &ct, skip_ct_p) != 1) {
-            internal_err(
-                "IR_FAILED_SCAN", "Failed to get count for EAMBFC-IR op."
+    sized_buf *obj_code = &ctx->obj_code;
+    u8 reg = inter->REGS->bf_ptr;
+    i64 arg = instr->arg;
+    /* keep track of where it came from, for any error messages */
+    ctx->line = instr->line;
+    ctx->col = instr->col;
+    if (!mark_src(ctx)) return false;
+    u8 cell = inter->REGS->cell;
+    switch (instr->op) {
+    case IR_MOVE:
+        if (!drop_cell(ctx, inter)) return false;
+        if (arg == 1) return inter->FUNCS->inc_reg(reg, obj_code);
+        if (arg == -1) return inter->FUNCS->dec_reg(reg, obj_code);
+        return (arg > 0) ? inter->FUNCS->add_reg(reg, arg, obj_code)
+                         : inter->FUNCS->sub_reg(reg, -arg, obj_code);
+    case IR_ADD:
+        if (instr->offset != 0) {
+            return inter->FUNCS->add_byte_at(
+                reg, instr->offset, (i8)arg, obj_code
             );
-            return false;
-        } else {
-            switch (*p) {
-            case '#': return IR_COMPILE_WITH(inter->FUNCS->add_byte);
-            case '=': return IR_COMPILE_WITH(inter->FUNCS->sub_byte);
-            case '}': return IR_COMPILE_WITH(inter->FUNCS->add_reg);
-            case '{': return IR_COMPILE_WITH(inter->FUNCS->sub_reg);
-            default:
-                internal_err("INVALID_IR", "Invalid IR Opcode");
-                return false;
-            }
         }
+        if (!load_cell(ctx, inter)) return false;
+        ctx->cell_dirty = true;
+        if (arg == 1) return inter->FUNCS->inc_reg(cell, obj_code);
+        if (arg == 0xff) return inter->FUNCS->dec_reg(cell, obj_code);
+        if (arg < 0x80) return inter->FUNCS->add_reg(cell, arg, obj_code);
+        return inter->FUNCS->sub_reg(cell, 0x100 - arg, obj_code);
+    case IR_ZERO:
+        if (instr->offset != 0) {
+            return inter->FUNCS->zero_byte_at(reg, instr->offset, obj_code);
+        }
+        ctx->cell_cached = true;
+        ctx->cell_dirty = true;
+        return inter->FUNCS->set_reg(cell, 0, obj_code);
+    case IR_SET:
+        if (instr->offset != 0) {
+            return inter->FUNCS->set_byte_at(reg, instr->offset, arg, obj_code);
+        }
+        ctx->cell_cached = true;
+        ctx->cell_dirty = true;
+        return inter->FUNCS->set_reg(cell, arg, obj_code);
+    case IR_ZERO_RANGE:
+    case IR_SET_RANGE: return bf_set_range(instr, ctx, inter);
+    case IR_MUL_ADD:
+        if (!store_cell(ctx, inter)) return false;
+        return inter->FUNCS->mul_add_byte_at(
+            reg, instr->offset, (u8)arg, obj_code
+        );
+    case IR_SCAN:
+        if (!drop_cell(ctx, inter)) return false;
+        return inter->FUNCS->scan_zero(reg, arg, obj_code);
+    case IR_LOOP_OPEN: return bf_jump_open(ctx, inter);
+    case IR_LOOP_CLOSE: return bf_jump_close(ctx, inter);
+    case IR_OUTPUT:
+        return store_cell(ctx, inter) && bf_output(ctx, inter);
+    case IR_INPUT:
+        return drop_cell(ctx, inter) && bf_input(ctx, inter);
+    case IR_OUTPUT_CONST:
+        return bf_output_const(ctx, inter, arg, instr->len);
+    default: internal_err("INVALID_IR", "Invalid IR Opcode"); return false;
     }
 }
 
-/* Compile code in source file to destination file.
- * Parameters:
- * - inter is a pointer to the arch_inter backend used to provide the functions
- *   that compile brainfuck and EAMBFC-IR into machine code.
- * - in_fd is a brainfuck source file, open for reading.
- * - out_fd is the destination file, open for writing.
- * - optimize is a boolean indicating whether to optimize code before compiling.
- * - tape_blocks is the number of 4-KiB blocks to allocate for the tape.
- *
- * Returns true if compilation was successful, and false otherwise. */
-bool bf_compile(
+/* Estimate how much machine code compiling the ct instructions in instrs can
+ * produce, from the largest size inter declares for each of them, the most
+ * padding that aligning loops can add if align_loops is true, and the loop
+ * counters if profile is true. */
+static size_t estimate_size(
+    const ir_instr *instrs,
+    size_t ct,
     const arch_inter *inter,
-    int in_fd,
-    int out_fd,
+    bool align_loops,
+    bool profile
+) {
+    const arch_max_sizes *max = inter->MAX_SIZES;
+    size_t pad = align_loops ? inter->LOOP_ALIGN - 1 : 0;
+    if (profile) pad += max->counter;
+    /* every size is under 0x100, and at most 3 are added for each instruction,
+     * so this ensures the total can't overflow */
+    if (ct > SIZE_MAX / 0x300) return 0;
+    size_t total = 0;
+    for (size_t i = 0; i < ct; i++) {
+        switch (instrs[i].op) {
+        case IR_MOVE: total += max->move; break;
+        case IR_ADD: total += max->add; break;
+        case IR_ZERO: total += max->zero; break;
+        case IR_SET: total += max->set; break;
+        case IR_ZERO_RANGE: total += max->zero_range; break;
+        case IR_SET_RANGE: total += max->set_range; break;
+        case IR_MUL_ADD: total += max->mul_add; break;
+        case IR_SCAN: total += max->scan; break;
+        case IR_LOOP_OPEN: total += max->jump + pad; break;
+        case IR_LOOP_CLOSE: total += max->jump; break;
+        case IR_OUTPUT:
+        case IR_INPUT: total += max->io; break;
+        /* the constant data itself is appended later */
+        case IR_OUTPUT_CONST: total += max->output_const; break;
+        }
+        total += max->cell;
+    }
+    return total;
+}
+
+/* Compile code to write the profile to PROFILE_FD, adding its header to the
+ * constant data in const_data, which is allocated if it's not already. */
+static bool write_profile(
+    bf_compile_ctx *ctx, const arch_inter *inter, sized_buf *const_data
+) {
+    sized_buf *obj_code = &ctx->obj_code;
+    if (ctx->profile_locs.buf == NULL) return false;
+    if (const_data->buf == NULL) {
+        const_data->capacity = 4096;
+        const_data->buf = mgr_malloc(4096);
+        const_data->sz = 0;
+    }
+    u64 loops = ctx->profile_locs.sz / 8;
+    char header[16];
+    memcpy(header, PROFILE_MAGIC, 7);
+    header[7] = inter->ELF_DATA;
+    serialize64(inter, loops, &header[8]);
+    /* keep it at an even offset, which s390x needs to load its address */
+    const char pad = 0;
+    if (const_data->sz % 2 && !append_obj(const_data, &pad, 1)) return false;
+    size_t index = const_data->sz;
+    if (!append_obj(const_data, header, 16) ||
+        !append_obj(
+            const_data, ctx->profile_locs.buf, ctx->profile_locs.sz
+        )) {
+        return false;
+    }
+    /* If PROFILE_FD isn't open, the writes fail harmlessly. The counters are
+     * written with a second system call, straight from their segment. */
+    return load_const_addr(ctx, inter, index) &&
+           inter->FUNCS->set_reg(
+               inter->REGS->sc_num, inter->SC_NUMS->write, obj_code
+           ) &&
+           inter->FUNCS->set_reg(inter->REGS->arg1, PROFILE_FD, obj_code) &&
+           inter->FUNCS->set_reg(
+               inter->REGS->arg3, 16 + ctx->profile_locs.sz, obj_code
+           ) &&
+           inter->FUNCS->syscall(obj_code) &&
+           (loops == 0 ||
+            (inter->FUNCS->set_reg(
+                 inter->REGS->arg2, ctx->profile_addr, obj_code
+             ) &&
+             inter->FUNCS->set_reg(
+                 inter->REGS->sc_num, inter->SC_NUMS->write, obj_code
+             ) &&
+             inter->FUNCS->set_reg(inter->REGS->arg1, PROFILE_FD, obj_code) &&
+             inter->FUNCS->set_reg(inter->REGS->arg3, loops * 8, obj_code) &&
+             inter->FUNCS->syscall(obj_code)));
+}
+
+/* Compile code to make the madvise system call for the tape, with the given
+ * advice, which is one of the MADV_* values. If the kernel doesn't accept it,
+ * the call fails harmlessly. */
+static bool advise_tape(
+    const arch_inter *inter,
+    i64 tape_addr,
+    u64 tape_blocks,
+    i64 advice,
+    sized_buf *obj_code
+) {
+    return inter->FUNCS->set_reg(
+               inter->REGS->sc_num, inter->SC_NUMS->madvise, obj_code
+           ) &&
+           inter->FUNCS->set_reg(inter->REGS->arg1, tape_addr, obj_code) &&
+           inter->FUNCS->set_reg(
+               inter->REGS->arg2, (i64)TAPE_SIZE(tape_blocks), obj_code
+           ) &&
+           inter->FUNCS->set_reg(inter->REGS->arg3, advice, obj_code) &&
+           inter->FUNCS->syscall(obj_code);
+}
+
+/* Returns true if at least half of the loops in the ct instructions in instrs
+ * are scanning loops, so the tape is likely to be walked through in order. */
+static bool scan_heavy(const ir_instr *instrs, size_t ct) {
+    size_t scans = 0, loops = 0;
+    for (size_t i = 0; i < ct; i++) {
+        if (instrs[i].op == IR_SCAN) scans++;
+        if (instrs[i].op == IR_LOOP_OPEN) loops++;
+    }
+    return scans > 0 && scans >= loops;
+}
+
+/* mark the code in obj_code as unusable after an error that stopped it from
+ * being compiled at all, so that it isn't run or written out, and return false
+ * to pass along the failure. */
+static bool abandon(sized_buf *obj_code) {
+    obj_code->sz = 0;
+    return false;
+}
+
+/* Compile the code in src to machine code in ctx->obj_code. Parameters
+ * and return value are described in compile.h. */
+bool bf_compile_code(
+    bf_compile_ctx *ctx,
+    const arch_inter *inter,
+    const bf_source *src,
     bool optimize,
-    u64 tape_blocks
+    i64 tape_addr,
+    u64 tape_blocks,
+    bool huge_tape,
+    i64 io_addr,
+    i64 profile_addr,
+    bool jit,
+    bool align_loops,
+    bool eval,
+    const loop_profile *guide,
+    bool debug_info
 ) {
-    sized_buf src_code = read_to_sized_buf(in_fd);
-    /* Return immediately if a read failed */
-    if (src_code.buf == NULL) return false;
-    sized_buf obj_code = {.sz = 0, .capacity = 4096, .buf = mgr_malloc(4096)};
+    /* reuse the space left over from any previous compilation */
+    sized_buf *obj_code = &ctx->obj_code;
+    if (obj_code->buf == NULL) {
+        obj_code->capacity = 4096;
+        obj_code->buf = mgr_malloc(4096);
+    }
+    obj_code->sz = 0;
+    if (ctx->loop_flags.buf == NULL) {
+        ctx->loop_flags.capacity = 4096;
+        ctx->loop_flags.buf = mgr_malloc(4096);
+    }
+    if (ctx->const_refs.buf == NULL) {
+        ctx->const_refs.capacity = 4096;
+        ctx->const_refs.buf = mgr_malloc(4096);
+    }
+    ctx->const_refs.sz = 0;
+    if (ctx->tape_init.buf == NULL) {
+        ctx->tape_init.capacity = 4096;
+        ctx->tape_init.buf = mgr_malloc(4096);
+    }
+    ctx->tape_init.sz = 0;
+    if (ctx->profile_locs.buf == NULL) {
+        ctx->profile_locs.capacity = 4096;
+        ctx->profile_locs.buf = mgr_malloc(4096);
+    }
+    ctx->profile_locs.sz = 0;
+    if (ctx->loop_regions.buf == NULL) {
+        ctx->loop_regions.capacity = 4096;
+        ctx->loop_regions.buf = mgr_malloc(4096);
+    }
+    ctx->loop_regions.sz = 0;
+    if (ctx->src_locs.buf == NULL) {
+        ctx->src_locs.capacity = 4096;
+        ctx->src_locs.buf = mgr_malloc(4096);
+    }
+    ctx->src_locs.sz = 0;
+    /* the constant data for IR_OUTPUT_CONST and IR_SET_RANGE, which is only
+     * used if optimizing and added once the code is compiled */
+    sized_buf const_data = {.sz = 0, .capacity = 0, .buf = NULL};
 
     bool ret = true;
 
     /* reset the jump stack for the new file */
-    jump_stack.index = 0;
-    jump_stack.locations = mgr_malloc(JUMP_CHUNK_SZ * sizeof(jump_loc));
-    jump_stack.loc_sz = JUMP_CHUNK_SZ;
+    ctx->jump_stack.index = 0;
 
     /* reset the current line and column */
-    _line = 1;
-    _col = 0;
+    ctx->line = 1;
+    ctx->col = 0;
+
+    ctx->io_addr = io_addr;
+    ctx->profile_addr = jit ? 0 : profile_addr;
+    ctx->loop_index = 0;
+    ctx->align_loops = align_loops || guide != NULL;
+    ctx->guide = guide;
+    ctx->debug_info = debug_info;
+    ctx->cell_cached = false;
+    ctx->cell_dirty = false;
+    compile_stats *stats = &ctx->stats;
+    *stats = (compile_stats){0};
+    u64 start = time_ns();
+
+    /* when called as a function, save whatever the caller needs preserved */
+    if (jit) ret &= inter->FUNCS->jit_prologue(obj_code);
 
     /* set the bf_ptr register to the address of the start of the tape */
-    ret &= inter->FUNCS->set_reg(inter->REGS->bf_ptr, TAPE_ADDRESS, &obj_code);
+    ret &= inter->FUNCS->set_reg(inter->REGS->bf_ptr, tape_addr, obj_code);
+
+    if (huge_tape) {
+        ret &= advise_tape(
+            inter, tape_addr, tape_blocks, MADV_HUGEPAGE, obj_code
+        );
+    }
 
     /* compile the actual source code to object code */
     if (optimize) {
-        if (!to_ir(&src_code)) {
-            mgr_free(jump_stack.locations);
-            return false;
+        /* the optimizer needs the whole source code at once */
+        sized_buf mapped = {.sz = 0, .capacity = 0, .buf = NULL};
+        const char *code = src->buf;
+        size_t code_sz = src->sz;
+        if (code == NULL) {
+            mapped = map_to_sized_buf(src->fd);
+            /* Give up immediately if a read failed */
+            if (mapped.buf == NULL) return abandon(obj_code);
+            code = mapped.buf;
+            code_sz = mapped.sz;
+        }
+        stats->src_bytes = code_sz;
+        u64 read_end = time_ns();
+        stats->read_ns = read_end - start;
+        sized_buf ir;
+        bool converted = to_ir(code, code_sz, &ir, &const_data, &stats->opt);
+        if (mapped.buf != NULL) unmap_sized_buf(&mapped);
+        if (!converted) return abandon(obj_code);
+        u64 ir_end = time_ns();
+        stats->ir_ns = ir_end - read_end;
+        if (eval) {
+            /* the tape can't be larger than the address space anyway */
+            size_t tape_sz = (tape_blocks > SIZE_MAX / 0x1000)
+                                 ? SIZE_MAX
+                                 : TAPE_SIZE((size_t)tape_blocks);
+            if (!partial_eval(&ir, &const_data, &ctx->tape_init, tape_sz)) {
+                return abandon(obj_code);
+            }
+            stats->eval_ns = time_ns() - ir_end;
         }
 
-        char *p = src_code.buf;
-        int skip_ct;
-        while (*p) {
-            ret &= comp_ir_instr(p++, &obj_code, &skip_ct, inter);
-            p += skip_ct;
+        const ir_instr *instrs = ir.buf;
+        size_t ct = ir.sz / sizeof(ir_instr);
+        if (huge_tape && scan_heavy(instrs, ct)) {
+            ret &= advise_tape(
+                inter, tape_addr, tape_blocks, MADV_SEQUENTIAL, obj_code
+            );
+        }
+        /* reserve space for all of the code at once, so that it doesn't need
+         * to be reallocated over and over as it grows */
+        size_t estimate = estimate_size(
+            instrs, ct, inter, ctx->align_loops, ctx->profile_addr != 0
+        );
+        if (reserve_obj(obj_code, estimate) == NULL) {
+            mgr_free(ir.buf);
+            mgr_free(const_data.buf);
+            return abandon(obj_code);
+        }
+        size_t code_start = obj_code->sz;
+        /* The IR makes it possible to compile the code twice, to find out
+         * which loops can use the shorter jump encodings. The first time,
+         * every loop uses the longest ones, which gives an upper bound of the
+         * size of each loop. Any loop that fits within the range of the short
+         * encodings at that size can use them, as doing so can only shrink the
+         * loops, so the code is compiled again, this time using them wherever
+         * they were found to fit.
+         *
+         * The first pass is also where innermost loops are found, as those are
+         * the ones with no loops opened between their start and end, so if
+         * aligning loops, the padding for them is added in the second pass. */
+        ctx->jump_mode = JUMPS_MEASURE;
+        ctx->loop_index = 0;
+        ctx->inner_loops = 0;
+        ctx->loop_flags.sz = 0;
+        for (size_t i = 0; i < ct; i++) {
+            ret &= comp_ir_instr(&instrs[i], ctx, inter);
+        }
+        /* only compile it again if it worked the first time, so that errors
+         * aren't reported twice, and if there's anything to gain from it */
+        bool relax = false;
+        for (size_t i = 0; ret && !relax && i < ctx->loop_flags.sz; i++) {
+            relax = ((u8 *)ctx->loop_flags.buf)[i] != 0;
+        }
+        if (relax && obj_code->buf != NULL) {
+            ctx->jump_mode = JUMPS_RELAXED;
+            ctx->loop_index = 0;
+            ctx->jump_stack.index = 0;
+            ctx->const_refs.sz = 0;
+            ctx->loop_regions.sz = 0;
+            ctx->src_locs.sz = 0;
+            ctx->cell_cached = false;
+            ctx->cell_dirty = false;
+            obj_code->sz = code_start;
+            for (size_t i = 0; i < ct; i++) {
+                ret &= comp_ir_instr(&instrs[i], ctx, inter);
+            }
+        }
+        ctx->jump_mode = JUMPS_LONG;
+        mgr_free(ir.buf);
+        ret &= store_cell(ctx, inter);
+    } else if (src->buf != NULL) {
+        stats->src_bytes = src->sz;
+        for (size_t i = 0; i < src->sz; i++) {
+            ret &= comp_instr(src->buf[i], ctx, inter);
         }
     } else {
-        for (size_t i = 0; i < src_code.sz; i++) {
-            ret &= comp_instr(((char *)src_code.buf)[i], &obj_code, inter);
+        /* compile each chunk as it's read, so only the machine code needs to
+         * be kept in memory */
+        char chunk[4096];
+        ssize_t count;
+        u64 read_start = time_ns();
+        while ((count = read(src->fd, chunk, sizeof(chunk))) != 0) {
+            if (count < 0) {
+                basic_err("FAILED_READ", "Failed to read from file");
+                return abandon(obj_code);
+            }
+            u64 read_end = time_ns();
+            stats->read_ns += read_end - read_start;
+            stats->src_bytes += count;
+            for (ssize_t i = 0; i < count; i++) {
+                ret &= comp_instr(chunk[i], ctx, inter);
+            }
+            read_start = time_ns();
         }
     }
 
-    /* write code to perform the exit(0) syscall */
-    /* set system call register to exit system call number */
-    ret &= inter->FUNCS->set_reg(
-        inter->REGS->sc_num, inter->SC_NUMS->exit, &obj_code
-    );
-    /* set system call register to the desired exit code (0) */
-    ret &= inter->FUNCS->set_reg(inter->REGS->arg1, 0, &obj_code);
-    /* perform a system call */
-    ret &= inter->FUNCS->syscall(&obj_code);
-
-    /* now, obj_code size is known, so we can write the headers and padding */
-    ret &= write_ehdr(out_fd, tape_blocks, inter);
-    ret &= write_phtb(out_fd, obj_code.sz, tape_blocks, inter);
-    const char padding[PAD_SZ] = {0};
-    ret &= write_obj(out_fd, padding, PAD_SZ);
-    /* finally, write the code itself. */
-    ret &= write_obj(out_fd, obj_code.buf, obj_code.sz);
+    /* write any remaining buffered output before exiting */
+    if (io_addr) ret &= inter->FUNCS->flush_output(io_addr, obj_code);
+
+    if (jit) {
+        /* return to the caller */
+        ret &= inter->FUNCS->jit_epilogue(obj_code);
+    } else {
+        if (ctx->profile_addr) ret &= write_profile(ctx, inter, &const_data);
+        /* write code to perform the exit(0) syscall */
+        /* set system call register to exit system call number */
+        ret &= inter->FUNCS->set_reg(
+            inter->REGS->sc_num, inter->SC_NUMS->exit, obj_code
+        );
+        /* set system call register to the desired exit code (0) */
+        ret &= inter->FUNCS->set_reg(inter->REGS->arg1, 0, obj_code);
+        /* perform a system call */
+        ret &= inter->FUNCS->syscall(obj_code);
+    }
+
+    /* the constant data goes after the end of the code, where it's never run */
+    if (const_data.buf != NULL) {
+        if (obj_code->buf != NULL) {
+            ret &= append_consts(ctx, inter, &const_data);
+        }
+        mgr_free(const_data.buf);
+    }
 
     /* check if any unmatched loop openings were left over. */
-    if (jump_stack.index-- > 0) {
+    if (ctx->jump_stack.index-- > 0) {
         position_err(
             "UNMATCHED_OPEN",
             "Reached the end of the file with an unmatched '['.",
             '[',
-            jump_stack.locations[jump_stack.index].src_line,
-            jump_stack.locations[jump_stack.index].src_col
+            ctx->jump_stack.locations[ctx->jump_stack.index].src_line,
+            ctx->jump_stack.locations[ctx->jump_stack.index].src_col
         );
         ret = false;
     }
 
-    mgr_free(obj_code.buf);
-    mgr_free(src_code.buf);
-    mgr_free(jump_stack.locations);
+    /* everything that wasn't reading or optimizing the code was compiling it */
+    stats->code_bytes = obj_code->sz;
+    stats->codegen_ns = time_ns() - start - stats->read_ns - stats->ir_ns -
+                        stats->eval_ns;
+
+    /* if obj_code was freed after an error, there's nothing left to use */
+    return ret && obj_code->buf != NULL;
+}
+
+/* order code_region entries by where they start, for qsort */
+static int cmp_regions(const void *a, const void *b) {
+    const code_region *l = a, *r = b;
+    return (l->start > r->start) - (l->start < r->start);
+}
+
+/* append a code_region from start to end within the same loop as region to
+ * dst, unless it would be empty */
+static bool add_region(
+    sized_buf *dst, size_t start, size_t end, const code_region *region
+) {
+    if (start == end) return true;
+    code_region part = {start, end, region->line, region->col};
+    return append_obj(dst, &part, sizeof(code_region));
+}
+
+bool bf_code_regions(
+    const bf_compile_ctx *ctx, size_t code_sz, sized_buf *dst
+) {
+    size_t ct = ctx->loop_regions.sz / sizeof(code_region);
+    /* the first entry stands in for all of the code outside of any loop */
+    code_region *loops = mgr_malloc((ct + 1) * sizeof(code_region));
+    loops[0] = (code_region){.start = 0, .end = code_sz, .line = 0, .col = 0};
+    memcpy(&loops[1], ctx->loop_regions.buf, ct * sizeof(code_region));
+    qsort(&loops[1], ct, sizeof(code_region), cmp_regions);
+    /* indexes into loops of the ones containing pos, innermost last */
+    size_t *stack = mgr_malloc((ct + 1) * sizeof(size_t));
+    size_t depth = 0;
+    stack[depth++] = 0;
+    dst->sz = 0;
+    dst->capacity = 4096;
+    dst->buf = mgr_malloc(4096);
+    size_t pos = 0;
+    bool ret = true;
+    for (size_t i = 1; ret && depth; i++) {
+        size_t next = (i <= ct) ? loops[i].start : code_sz;
+        /* leave any loops that end before the next one starts */
+        while (ret && depth && loops[stack[depth - 1]].end <= next) {
+            const code_region *loop = &loops[stack[--depth]];
+            ret = add_region(dst, pos, loop->end, loop);
+            pos = loop->end;
+        }
+        if (!ret || i > ct) break;
+        ret = add_region(dst, pos, next, &loops[stack[depth - 1]]);
+        pos = next;
+        stack[depth++] = i;
+    }
+    mgr_free(stack);
+    mgr_free(loops);
+    return ret;
+}
+
+void bf_region_name(const code_region *region, char *name) {
+    if (region->line == 0) {
+        snprintf(name, REGION_NAME_SZ, "bf_main");
+    } else {
+        snprintf(
+            name, REGION_NAME_SZ, "bf_loop_L%u_C%u", region->line, region->col
+        );
+    }
+}
+
+/* Build the symbol table, .bf_lines table, their string tables, and the section
+ * header table that describes them, in that order, in dst, which is allocated
+ * with mgr_malloc. They're written to the output file starting at file_off,
+ * after everything else, and code_vaddr and code_off are the virtual address
+ * and file offset of the machine code. Sets *shoff to the file offset of the
+ * section header table. */
+static bool build_sections(
+    const bf_compile_ctx *ctx,
+    const arch_inter *inter,
+    u64 code_vaddr,
+    u64 code_off,
+    u64 file_off,
+    sized_buf *dst,
+    u64 *shoff
+) {
+    size_t code_sz = ctx->obj_code.sz;
+    sized_buf regions;
+    if (!bf_code_regions(ctx, code_sz, &regions)) return false;
+    const code_region *region = regions.buf;
+    size_t region_ct = regions.sz / sizeof(code_region);
+    size_t src_ct = ctx->src_locs.sz / sizeof(src_loc);
+    const src_loc *locs = ctx->src_locs.buf;
+    bool le = inter->ELF_DATA == ELFDATA2LSB;
+
+    /* the string table starts with an empty string for the null symbol */
+    sized_buf strtab = {.sz = 0, .capacity = 4096, .buf = mgr_malloc(4096)};
+    dst->sz = 0;
+    dst->capacity = 4096;
+    dst->buf = mgr_malloc(4096);
+    /* align the tables to 8 bytes within the file */
+    const char padding[8] = {0};
+    bool ret = append_obj(&strtab, "", 1) &&
+               append_obj(dst, padding, (8 - file_off % 8) % 8);
+    size_t symtab_start = dst->sz;
+    char sym_bytes[SYM_SIZE] = {0};
+    if (ret) ret = append_obj(dst, sym_bytes, SYM_SIZE);
+    for (size_t i = 0; ret && i < region_ct; i++) {
+        char name[REGION_NAME_SZ];
+        bf_region_name(&region[i], name);
+        Elf64_Sym sym = {
+            .st_name = strtab.sz,
+            .st_info = ELF64_ST_INFO(STB_LOCAL, STT_FUNC),
+            .st_other = 0,
+            .st_shndx = SHNDX_TEXT,
+            .st_value = code_vaddr + region[i].start,
+            .st_size = region[i].end - region[i].start,
+        };
+        if (le) {
+            serialize_sym64_le(&sym, sym_bytes);
+        } else {
+            serialize_sym64_be(&sym, sym_bytes);
+        }
+        ret = append_obj(&strtab, name, strlen(name) + 1) &&
+              append_obj(dst, sym_bytes, SYM_SIZE);
+    }
+    size_t lines_start = dst->sz;
+    for (size_t i = 0; ret && i < src_ct; i++) {
+        char line[LINE_SIZE];
+        serialize64(inter, code_vaddr + locs[i].code_loc, line);
+        serialize32(inter, locs[i].line, &line[8]);
+        serialize32(inter, locs[i].col, &line[12]);
+        ret = append_obj(dst, line, LINE_SIZE);
+    }
+    size_t strtab_start = dst->sz;
+    if (ret) ret = append_obj(dst, strtab.buf, strtab.sz);
+    if (strtab.buf != NULL) mgr_free(strtab.buf);
+    mgr_free(regions.buf);
+    /* names of the sections, at the offsets used for sh_name below */
+    const char shstrtab[] = "\0.text\0.symtab\0.strtab\0.bf_lines\0.shstrtab";
+    size_t shstrtab_start = dst->sz;
+    if (ret) {
+        ret = append_obj(dst, shstrtab, sizeof(shstrtab)) &&
+              append_obj(dst, padding, (8 - (file_off + dst->sz) % 8) % 8);
+    }
+    if (!ret) return false;
+
+    Elf64_Shdr shdrs[SHNUM] = {{0}};
+    shdrs[SHNDX_TEXT] = (Elf64_Shdr){
+        .sh_name = 1,
+        .sh_type = SHT_PROGBITS,
+        .sh_flags = SHF_ALLOC | SHF_EXECINSTR,
+        .sh_addr = code_vaddr,
+        .sh_offset = code_off,
+        .sh_size = code_sz,
+        .sh_addralign = 1,
+    };
+    shdrs[SHNDX_SYMTAB] = (Elf64_Shdr){
+        .sh_name = 7,
+        .sh_type = SHT_SYMTAB,
+        .sh_offset = file_off + symtab_start,
+        .sh_size = lines_start - symtab_start,
+        .sh_link = SHNDX_STRTAB,
+        /* every symbol is local, so the first global one would be last */
+        .sh_info = region_ct + 1,
+        .sh_addralign = 8,
+        .sh_entsize = SYM_SIZE,
+    };
+    shdrs[SHNDX_STRTAB] = (Elf64_Shdr){
+        .sh_name = 15,
+        .sh_type = SHT_STRTAB,
+        .sh_offset = file_off + strtab_start,
+        .sh_size = shstrtab_start - strtab_start,
+        .sh_addralign = 1,
+    };
+    shdrs[SHNDX_LINES] = (Elf64_Shdr){
+        .sh_name = 23,
+        .sh_type = SHT_PROGBITS,
+        .sh_offset = file_off + lines_start,
+        .sh_size = strtab_start - lines_start,
+        .sh_addralign = 8,
+        .sh_entsize = LINE_SIZE,
+    };
+    shdrs[SHNDX_SHSTRTAB] = (Elf64_Shdr){
+        .sh_name = 33,
+        .sh_type = SHT_STRTAB,
+        .sh_offset = file_off + shstrtab_start,
+        .sh_size = sizeof(shstrtab),
+        .sh_addralign = 1,
+    };
+    *shoff = file_off + dst->sz;
+    char shdr_bytes[SHDR_SIZE];
+    for (int i = 0; ret && i < SHNUM; i++) {
+        if (le) {
+            serialize_shdr64_le(&shdrs[i], shdr_bytes);
+        } else {
+            serialize_shdr64_be(&shdrs[i], shdr_bytes);
+        }
+        ret = append_obj(dst, shdr_bytes, SHDR_SIZE);
+    }
+    return ret;
+}
+
+/* Compile code in source file to destination file.
+ * Parameters:
+ * - ctx is a compilation context, already initialized with bf_ctx_init.
+ * - inter is a pointer to the arch_inter backend used to provide the functions
+ *   that compile brainfuck and EAMBFC IR into machine code.
+ * - src is the source code to compile.
+ * - dst is where to write the output.
+ * - optimize is a boolean indicating whether to optimize code before compiling.
+ * - tape_blocks is the number of 4-KiB blocks to allocate for the tape.
+ * - huge_tape is a boolean indicating whether to place the tape for huge pages.
+ * - buffered is a boolean indicating whether to buffer I/O in the output.
+ * - align_loops is a boolean indicating whether to align innermost loops.
+ * - eval is a boolean indicating whether to run as much of the code as
+ *   possible at compile time.
+ * - profile is a boolean indicating whether to count how many times each loop
+ *   runs, and write the counts out when exiting.
+ * - guide is a profile from an earlier profiled build, or NULL.
+ * - symbols is a boolean indicating whether to add symbols to the output.
+ *
+ * Returns true if compilation was successful, and false otherwise. */
+bool bf_compile(
+    bf_compile_ctx *ctx,
+    const arch_inter *inter,
+    const bf_source *src,
+    bf_dest *dst,
+    bool optimize,
+    u64 tape_blocks,
+    bool huge_tape,
+    bool buffered,
+    bool align_loops,
+    bool eval,
+    bool profile,
+    const loop_profile *guide,
+    bool symbols
+) {
+    bool ret = bf_compile_code(
+        ctx,
+        inter,
+        src,
+        optimize,
+        TAPE_ADDRESS(huge_tape),
+        tape_blocks,
+        huge_tape,
+        buffered ? IO_ADDRESS(tape_blocks, huge_tape) : 0,
+        profile ? PROFILE_ADDRESS(tape_blocks, huge_tape, buffered) : 0,
+        false,
+        align_loops,
+        eval,
+        guide,
+        symbols
+    );
+    sized_buf *obj_code = &ctx->obj_code;
+
+    /* if compilation was abandoned, there's nothing to write */
+    if (obj_code->buf == NULL || obj_code->sz == 0) return false;
+
+    /* there's a counter for each loop with its location in profile_locs */
+    u64 profile_sz = profile ? PROFILE_SEG_SZ(ctx->profile_locs.sz / 8) : 0;
+    int phnum = PHNUM(buffered, profile);
+    sized_buf *tape_init = &ctx->tape_init;
+
+    /* building the sections counts as part of writing the output */
+    u64 write_start = time_ns();
+    u64 file_end = START_PADDR(phnum) + obj_code->sz;
+    if (tape_init->sz) {
+        file_end = TAPE_INIT_OFFSET(phnum, obj_code->sz) + tape_init->sz;
+    }
+    /* the sections for the symbols go after everything that's loaded */
+    sized_buf sections = {.sz = 0, .capacity = 0, .buf = NULL};
+    u64 shoff = 0;
+    if (symbols) {
+        ret &= build_sections(
+            ctx,
+            inter,
+            LOAD_VADDR(tape_blocks, huge_tape, buffered, profile_sz) +
+                START_PADDR(phnum),
+            START_PADDR(phnum),
+            file_end,
+            &sections,
+            &shoff
+        );
+    }
+
+    /* now, obj_code size is known, so we can build the headers, which are
+     * followed by zeroed padding up to the start of the code */
+    char headers[START_PADDR(MAX_PHNUM)] = {0};
+    build_ehdr(
+        headers, tape_blocks, huge_tape, buffered, profile_sz, shoff, inter
+    );
+    build_phtb(
+        &headers[EHDR_SIZE],
+        obj_code->sz,
+        tape_init->sz,
+        tape_blocks,
+        huge_tape,
+        buffered,
+        profile_sz,
+        inter
+    );
+    /* then gather the parts of the file, to write them all at once - the
+     * headers, the code itself, the initial tape contents, if there are any,
+     * and lastly, the symbols, if there are any */
+    struct iovec parts[MAX_PARTS];
+    int parts_ct = 0;
+    parts[parts_ct++] = (struct iovec){
+        .iov_base = headers, .iov_len = START_PADDR(phnum)
+    };
+    parts[parts_ct++] = (struct iovec){
+        .iov_base = obj_code->buf, .iov_len = obj_code->sz
+    };
+    char tape_padding[0x1000] = {0};
+    if (tape_init->sz) {
+        size_t code_end = START_PADDR(phnum) + obj_code->sz;
+        parts[parts_ct++] = (struct iovec){
+            .iov_base = tape_padding,
+            .iov_len = TAPE_INIT_OFFSET(phnum, obj_code->sz) - code_end,
+        };
+        parts[parts_ct++] = (struct iovec){
+            .iov_base = tape_init->buf, .iov_len = tape_init->sz
+        };
+    }
+    if (sections.buf != NULL) {
+        parts[parts_ct++] = (struct iovec){
+            .iov_base = sections.buf, .iov_len = sections.sz
+        };
+    }
+    ret &= emit(dst, parts, parts_ct);
+    if (sections.buf != NULL) mgr_free(sections.buf);
+    ctx->stats.write_ns = time_ns() - write_start;
+    ctx->stats.file_bytes = file_end + sections.sz;
 
     return ret;
 }
@@ -8,37 +8,356 @@
 #define EAMBFC_COMPILE_H 1
 /* internal */
 #include "arch_inter.h" /* arch_inter */
-#include "types.h" /* bool, u64 */
+#include "optimize.h" /* opt_stats */
+#include "profile.h" /* loop_profile */
+#include "types.h" /* bool, i64, u64, uint, size_t, sized_buf */
 
-/* Compile code in source file to destination file.
+/* the location of an unmatched `[` instruction, in the source code and in the
+ * machine code compiled from it. */
+typedef struct jump_loc {
+    uint src_line; /* saved for error reporting. */
+    uint src_col; /* saved for error reporting. */
+    size_t dst_loc;
+    /* which loop this is, counting from 0 in the order they're opened */
+    size_t loop_index;
+    /* the number of innermost loops closed before this one was opened */
+    size_t inner_before;
+    /* the value of short_jump used for the loop's jump instructions */
+    bool short_jump;
+} jump_loc;
+
+/* the location of a load_code_addr instruction for an IR_OUTPUT_CONST or
+ * IR_SET_RANGE in the machine code, and of the constant data it needs the
+ * address of. */
+typedef struct const_ref {
+    size_t code_loc;
+    size_t data_index;
+} const_ref;
+
+/* A range of the machine code, from start up to but not including end, and
+ * the source location of the `[` instruction of the innermost loop it's within,
+ * or a line and column of 0 if it's not within any loop. */
+typedef struct code_region {
+    size_t start;
+    size_t end;
+    uint line;
+    uint col;
+} code_region;
+
+/* the location in the source code of the instruction compiled to the machine
+ * code starting at code_loc */
+typedef struct src_loc {
+    size_t code_loc;
+    uint line;
+    uint col;
+} src_loc;
+
+/* the size of the buffer needed for the name of a code_region */
+#define REGION_NAME_SZ 32
+
+/* Measurements of a single compilation, for reporting. Times are in
+ * nanoseconds, and are 0 for anything that wasn't done. */
+typedef struct compile_stats {
+    /* the size of the source code */
+    size_t src_bytes;
+    /* what the optimizer did, which is all zeroes if not optimizing */
+    opt_stats opt;
+    /* the size of the machine code, including its constant data, and of the
+     * whole output file */
+    size_t code_bytes;
+    size_t file_bytes;
+    /* time spent reading the source code, converting it to IR, running it
+     * ahead of time, compiling it to machine code, and writing the output.
+     * Without optimization, the source code is read in chunks between
+     * compiling them, so reading is timed one chunk at a time. */
+    u64 read_ns;
+    u64 ir_ns;
+    u64 eval_ns;
+    u64 codegen_ns;
+    u64 write_ns;
+} compile_stats;
+
+/* How a compilation picks which loops use short jump encodings and which ones
+ * are aligned - see bf_compile_code in compile.c for details. */
+typedef enum {
+    /* every loop uses the long encodings, and none are aligned */
+    JUMPS_LONG,
+    /* every loop uses the long encodings, and none are aligned, but whether
+     * each one could have used the short ones, and whether it's an innermost
+     * loop that should be aligned, are recorded */
+    JUMPS_MEASURE,
+    /* loops are compiled as recorded */
+    JUMPS_RELAXED
+} jump_mode;
+
+/* Programs compiled with profiling enabled write their profile to this file
+ * descriptor when they exit, if it's open. A profile consists of:
+ *
+ * - the 7 bytes "EAMBFCP", followed by the EI_DATA byte of the ELF header, to
+ *   identify the format and the byte order of the rest
+ * - the number of loops, as a 64-bit integer
+ * - for each loop, the source line and column of its `[` instruction, as
+ *   32-bit integers
+ * - for each loop, the number of times its body ran, as a 64-bit integer
+ *
+ * Integers are in the target architecture's byte order, and loops are in the
+ * order they were opened in the compiled code. Loops that the optimizer removed
+ * or ran ahead of time aren't included. */
+#define PROFILE_FD 3
+#define PROFILE_MAGIC "EAMBFCP"
+
+/* the size of a transparent huge page on the supported architectures, which
+ * the tape starts at a multiple of if huge_tape is set (see bf_compile) */
+#define HUGE_PAGE_SZ 0x200000
+
+/* bit flags recorded for each loop in JUMPS_MEASURE mode */
+#define LOOP_SHORT 0x1
+#define LOOP_ALIGNED 0x2
+
+/* The state of a compilation, which would otherwise be shared between any
+ * compilations running at the same time. Any number of them can exist at once,
+ * and each can be used for any number of compilations, one after another,
+ * reusing the space allocated for its buffers.
+ *
+ * The members are used internally by bf_compile, and should not be modified
+ * outside of bf_ctx_init and bf_ctx_cleanup. */
+typedef struct bf_compile_ctx {
+    /* source location of the instruction being compiled */
+    uint line;
+    uint col;
+    /* address of the buffered I/O segment, or 0 if I/O is not buffered. */
+    i64 io_addr;
+    /* address of the loop counters, or 0 if not profiling */
+    i64 profile_addr;
+    /* when profiling, the source line and column of each loop, as pairs of
+     * 32-bit integers in the target's byte order, for the profile */
+    sized_buf profile_locs;
+    /* locations of the currently-unmatched `[` instructions */
+    struct jump_stack {
+        size_t index;
+        size_t loc_sz;
+        jump_loc *locations;
+    } jump_stack;
+    /* how loops pick their jump encodings and alignment, and for each loop in
+     * the order they're opened, a byte with its LOOP_* flags */
+    jump_mode jump_mode;
+    size_t loop_index;
+    sized_buf loop_flags;
+    /* whether to align innermost loops, and how many have been closed */
+    bool align_loops;
+    size_t inner_loops;
+    /* if not NULL, only the innermost loops that are hot in this profile are
+     * aligned */
+    const loop_profile *guide;
+    /* whether the cell register holds a copy of the current cell, and whether
+     * that copy has changed since it was last stored to the tape */
+    bool cell_cached;
+    bool cell_dirty;
+    /* whether to record where each loop and instruction was compiled to */
+    bool debug_info;
+    /* if debug_info is set, a code_region for each loop compiled so far, in
+     * the order they were closed, and a src_loc for each instruction */
+    sized_buf loop_regions;
+    sized_buf src_locs;
+    /* const_ref entries for the IR_OUTPUT_CONST and IR_SET_RANGE instructions
+     * compiled so far, which are filled in once the constant data is added
+     * after the code */
+    sized_buf const_refs;
+    /* the initial contents of the tape, if running part of the program ahead
+     * of time left any cells nonzero, or an empty buffer otherwise */
+    sized_buf tape_init;
+    /* the machine code compiled so far. buf is NULL if it's been freed due to
+     * an error, in which case bf_compile allocates it again. */
+    sized_buf obj_code;
+    /* measurements of the last compilation, which are only complete if it was
+     * successful */
+    compile_stats stats;
+} bf_compile_ctx;
+
+/* Prepare ctx for use with bf_compile, allocating its buffers with the
+ * Resource Manager. */
+void bf_ctx_init(bf_compile_ctx *ctx);
+
+/* Free the buffers owned by ctx. It must be passed to bf_ctx_init before being
+ * used again. */
+void bf_ctx_cleanup(bf_compile_ctx *ctx);
+
+/* The brainfuck source code to compile - the sz bytes at buf, or if buf is
+ * NULL, the contents of the file descriptor fd, open for reading. */
+typedef struct bf_source {
+    int fd;
+    const char *buf;
+    size_t sz;
+} bf_source;
+
+/* Where to write a compiled program - appended to buf, which is allocated with
+ * mgr_malloc, or if buf is NULL, written to the file descriptor fd, open for
+ * writing. */
+typedef struct bf_dest {
+    int fd;
+    sized_buf *buf;
+} bf_dest;
+
+/* Compile brainfuck source code to an ELF executable.
  * Parameters:
+ * - ctx is a compilation context, already initialized with bf_ctx_init.
  * - inter is a pointer to the arch_inter backend used to provide the functions
- *   that compile brainfuck and EAMBFC-IR into machine code.
- * - in_fd is a brainfuck source file, open for reading.
- * - out_fd is the destination file, open for writing.
+ *   that compile brainfuck and EAMBFC IR into machine code.
+ * - src is the source code to compile.
+ * - dst is where to write the executable.
  * - optimize is a boolean indicating whether to optimize code before compiling.
  * - tape_blocks is the number of 4-KiB blocks to allocate for the tape.
+ * - huge_tape is a boolean indicating whether to place the tape for huge pages.
+ * - buffered is a boolean indicating whether to buffer I/O in the output.
+ * - align_loops is a boolean indicating whether to align innermost loops.
+ * - eval is a boolean indicating whether to run as much of the code as
+ *   possible at compile time.
+ * - profile is a boolean indicating whether to count how many times each loop
+ *   runs, and write the counts out when exiting.
+ * - guide is a profile written by an earlier build of the same program with
+ *   profile set to true, or NULL if there isn't one.
+ * - symbols is a boolean indicating whether to add a symbol table and a table
+ *   of source locations to the output file.
  *
  * Returns true if compilation was successful, and false if any issues occurred.
  *
- * It does not verify that in_fd and out_fd are valid file descriptors,
- * nor that they are open properly.
+ * It does not verify that the file descriptors in src and dst are valid, nor
+ * that they are open properly.
  *
  * If it runs into any problems, it prints an appropriate error message.
  * It will try to continue after hitting certain errors, so that the resulting
  * binary can still be examined and debugged. If that is not needed, the output
  * file can be deleted, as it is in main.c if bf_compile returns false.
  *
- * If optimize is set to true, it first converts the contents of in_fd to a
- * simple internal representation (EAMBFC-IR, which is a superset of brainfuck),
- * then compiles that, typically cutting the size of the output code by a decent
- * amount. */
+ * If optimize is set to true, it first converts the source code to an
+ * array of instructions in a simple internal representation (EAMBFC IR, which
+ * is described in optimize.h), then compiles that, typically cutting the size
+ * of the output code by a decent amount. That needs the whole source code at
+ * once, so if it's in a regular file, that's mapped into memory, and otherwise
+ * it's read in full. Without optimization, the source code is compiled as it's
+ * read, and never held in memory in full.
+ *
+ * If buffered is set to true, the output binary collects the bytes written by
+ * `.` instructions in a buffer within a dedicated segment, writing them all at
+ * once when the buffer fills, when input is needed, and before exiting, rather
+ * than making a separate system call for each `.` instruction. Similarly, `,`
+ * instructions take bytes from an input buffer, which is refilled with one
+ * large read whenever it runs out.
+ *
+ * If huge_tape is set to true, the tape starts at a multiple of HUGE_PAGE_SZ,
+ * and the output binary starts with a madvise system call asking the kernel to
+ * back it with transparent huge pages, cutting the TLB misses of programs that
+ * use a lot of it. Unless the tape has initial contents, its segment is also
+ * aligned to HUGE_PAGE_SZ in the program header table. If optimizing, and
+ * scanning loops make up at least half of the loops left, it also marks the
+ * tape as accessed sequentially. Kernels without transparent huge pages ignore
+ * or reject the advice, and the program runs the same either way.
+ *
+ * If align_loops is set to true, NOP instructions are inserted before each
+ * innermost loop (one with no other loops inside of it) as needed to make its
+ * body start at a multiple of inter->LOOP_ALIGN bytes. This only has any effect
+ * if optimize is also set to true, as the whole loop must be known in advance
+ * to find out whether it's an innermost loop.
+ *
+ * If eval is set to true, the optimized code is run at compile time until it
+ * needs input, finishes, or runs for too long (see partial_eval in optimize.h),
+ * and only what's left is compiled, after code to write the output produced so
+ * far. The tape's contents at that point are stored in the output file, to be
+ * loaded in as the initial tape contents. Like align_loops, this only has any
+ * effect if optimize is also set to true.
+ *
+ * If profile is set to true, the output binary has another segment, with a
+ * 64-bit counter for each loop, which is incremented at the start of the loop's
+ * body, and the binary writes a profile (described above PROFILE_FD) to
+ * PROFILE_FD before exiting.
+ *
+ * If guide is not NULL, the innermost loops that it shows to be hot are aligned
+ * as if align_loops were set to true, and the rest aren't aligned even if it
+ * is, to keep them compact. Loops are matched to the ones in guide by the
+ * source location of their `[` instruction, so the profile can still be used
+ * after small changes to the source code. Like align_loops, this only has any
+ * effect if optimize is also set to true.
+ *
+ * If symbols is set to true, the output file has a section header table, with
+ * a .text section for the machine code, and a .symtab section with a local
+ * function symbol for each code_region found by bf_code_regions, named by
+ * bf_region_name, so that profilers like perf can attribute time spent in the
+ * program to its loops. It also has a .bf_lines section, mapping the machine
+ * code back to the source code, with an entry for each instruction in the
+ * order they were compiled, consisting of the 64-bit virtual address of its
+ * machine code, then its line and column as 32-bit integers, all in the
+ * target's byte order. None of them are loaded into memory when the program
+ * runs. */
 bool bf_compile(
+    bf_compile_ctx *ctx,
     const arch_inter *inter,
-    int in_fd,
-    int out_fd,
+    const bf_source *src,
+    bf_dest *dst,
     bool optimize,
-    u64 tape_blocks
+    u64 tape_blocks,
+    bool huge_tape,
+    bool buffered,
+    bool align_loops,
+    bool eval,
+    bool profile,
+    const loop_profile *guide,
+    bool symbols
 );
 
+/* Compile the code in src to machine code in ctx->obj_code, without writing
+ * it anywhere. bf_compile uses this to generate the code it writes, and the JIT
+ * run mode uses it to generate code that it runs directly.
+ * Parameters:
+ * - ctx, inter, src, optimize, tape_blocks, align_loops, eval, and guide are
+ *   the same as for bf_compile.
+ * - tape_addr is the address of the start of the tape, which must be at a page
+ *   boundary if huge_tape is true.
+ * - huge_tape is a boolean indicating whether to start the code with the
+ *   madvise calls described for bf_compile.
+ * - io_addr is the address of the buffered I/O segment, or 0 to make a separate
+ *   system call for each `.` and `,` instruction.
+ * - profile_addr is the address of the loop counters, or 0 to not profile the
+ *   code. Profiling isn't possible if jit is true.
+ * - jit is a boolean indicating whether the code should be a function that
+ *   returns to its caller once it's done, rather than exiting the process.
+ * - debug_info is a boolean indicating whether to record the location of the
+ *   code compiled from each loop and instruction in ctx->loop_regions and
+ *   ctx->src_locs, for bf_code_regions.
+ *
+ * Returns true if compilation was successful, and false otherwise. If it was
+ * so unsuccessful that there's no usable code at all, ctx->obj_code.sz is set
+ * to 0. If eval is true, the caller must copy the contents of ctx->tape_init to
+ * the start of the tape before running the code. */
+bool bf_compile_code(
+    bf_compile_ctx *ctx,
+    const arch_inter *inter,
+    const bf_source *src,
+    bool optimize,
+    i64 tape_addr,
+    u64 tape_blocks,
+    bool huge_tape,
+    i64 io_addr,
+    i64 profile_addr,
+    bool jit,
+    bool align_loops,
+    bool eval,
+    const loop_profile *guide,
+    bool debug_info
+);
+
+/* After compiling code with debug_info set to true, split the first code_sz
+ * bytes of ctx->obj_code into code_region entries with no overlap, in order,
+ * stored in dst, which is allocated with mgr_malloc. The code within nested
+ * loops is split up into the parts within each loop and not any loop nested
+ * within it.
+ *
+ * Returns true if successful, and false if an allocation failed, in which case
+ * dst->buf is NULL. */
+bool bf_code_regions(const bf_compile_ctx *ctx, size_t code_sz, sized_buf *dst);
+
+/* Write the name of region to name, which must be at least REGION_NAME_SZ
+ * bytes. Loops are named "bf_loop_L<line>_C<col>", after the source location
+ * of their `[` instruction, and code outside of any loop is named "bf_main". */
+void bf_region_name(const code_region *region, char *name);
+
 #endif /* EAMBFC_COMPILE_H */
@@ -9,10 +9,14 @@
 #include <stdlib.h> /* malloc, realloc, free */
 #include <string.h> /* strlen, strcpy, strstr, memmove, memcpy */
 /* internal */
-#include "types.h" /* bool, uint */
+#include "err.h" /* report_field */
+#include "types.h" /* bool, uint, u64, size_t */
 
 static bool _quiet;
 static bool _json;
+static const char *_file;
+static void (*_handler)(const err_info *err, void *data);
+static void *_handler_data;
 
 /* the only external access to the variables is through these functions. */
 void quiet_mode(void) {
@@ -23,9 +27,37 @@ void json_mode(void) {
     _json = true;
 }
 
+void err_file(const char *file) {
+    _file = file;
+}
+
+void err_handler(void (*handler)(const err_info *err, void *data), void *data) {
+    _handler = handler;
+    _handler_data = data;
+}
+
+/* pass the error to the handler if there is one, returning false if not */
+static bool handled(
+    const char *id, const char *msg, char instr, uint line, uint col
+) {
+    if (_handler == NULL) return false;
+    err_info err = {id, msg, instr, line, col};
+    _handler(&err, _handler_data);
+    return true;
+}
+
 /* avoid using json_str for this special case, as malloc may fail again,
  * causing a loop of failures to generate json error messages properly. */
 void alloc_err(void) {
+    if (handled(
+            "ALLOC_FAILED",
+            "A call to malloc or realloc returned NULL.",
+            '\0',
+            0,
+            0
+        )) {
+        exit(EXIT_FAILURE);
+    }
     if (_json) {
         puts(
             "{\"errorId:\":\"ALLOC_FAILED\","
@@ -48,10 +80,10 @@ void alloc_err(void) {
 
 /* return a pointer to a JSON-escaped version of the input string
  * calling function is responsible for freeing it */
-static char *json_str(char *str) {
+static char *json_str(const char *str) {
     size_t bufsz = 4096; /* 16 for padding, more added as needed */
     size_t used = 0;
-    char *p = str;
+    const char *p = str;
     char *reallocator;
     char *json_escaped = malloc(bufsz);
     if (json_escaped == NULL) return NULL;
@@ -100,17 +132,33 @@ static char *json_str(char *str) {
 
 #undef BS_ESCAPE_APPEND
 
+/* start a JSON error message, with the file it's about, if one was set with
+ * err_file, as its first field */
+static void start_jerr(void) {
+    putchar('{');
+    if (_file == NULL) return;
+    char *file_json = json_str(_file);
+    if (file_json == NULL) {
+        alloc_err();
+        return;
+    }
+    printf("\"file\":\"%s\",", file_json);
+    free(file_json);
+}
+
 static void basic_jerr(const char *id, char *msg) {
     /* assume error id is json-safe, but don't assume that for msg. */
     if ((msg = json_str(msg)) == NULL) {
         alloc_err();
     } else {
-        printf("{\"errorId\":\"%s\",\"message\":\"%s\"}\n", id, msg);
+        start_jerr();
+        printf("\"errorId\":\"%s\",\"message\":\"%s\"}\n", id, msg);
         free(msg);
     }
 }
 
 void basic_err(const char *id, char *msg) {
+    if (handled(id, msg, '\0', 0, 0)) return;
     if (_json)
         basic_jerr(id, msg);
     else if (!_quiet)
@@ -133,8 +181,9 @@ static void pos_jerr(
         alloc_err();
         return;
     }
+    start_jerr();
     printf(
-        "{\"errorId\":\"%s\",\"message\":\"%s\",\"instruction\":\"%s\","
+        "\"errorId\":\"%s\",\"message\":\"%s\",\"instruction\":\"%s\","
         "\"line\":%u,\"column\":%u}\n",
         id,
         msg,
@@ -147,6 +196,7 @@ static void pos_jerr(
 }
 
 void position_err(const char *id, char *msg, char instr, uint line, uint col) {
+    if (handled(id, msg, instr, line, col)) return;
     if (_json)
         pos_jerr(id, msg, instr, line, col);
     else if (!_quiet) {
@@ -176,8 +226,9 @@ static void instr_jerr(const char *id, char *msg, char instr) {
         free(instr_json);
         return;
     }
+    start_jerr();
     printf(
-        "{\"errorId\":\"%s\",\"message\":\"%s\",\"instruction\":\"%s\"}\n",
+        "\"errorId\":\"%s\",\"message\":\"%s\",\"instruction\":\"%s\"}\n",
         id,
         msg,
         instr_json
@@ -187,6 +238,7 @@ static void instr_jerr(const char *id, char *msg, char instr) {
 }
 
 void instr_err(const char *id, char *msg, char instr) {
+    if (handled(id, msg, instr, 0, 0)) return;
     if (_json)
         instr_jerr(id, msg, instr);
     else if (!_quiet) {
@@ -243,3 +295,33 @@ void internal_err(const char *id, const char *msg) {
     basic_err(ice_id, ice_msg);
     exit(EXIT_FAILURE);
 }
+
+void stats_report(const char *file, const report_field *fields, size_t ct) {
+    if (_json) {
+        char *file_json = json_str(file);
+        if (file_json == NULL) {
+            alloc_err();
+            return;
+        }
+        printf("{\"file\":\"%s\"", file_json);
+        free(file_json);
+        for (size_t i = 0; i < ct; i++) {
+            printf(
+                ",\"%s\":%llu",
+                fields[i].key,
+                (unsigned long long)fields[i].val
+            );
+        }
+        puts("}");
+    } else {
+        fprintf(stderr, "Stats for %s:\n", file);
+        for (size_t i = 0; i < ct; i++) {
+            fprintf(
+                stderr,
+                "    %s: %llu\n",
+                fields[i].desc,
+                (unsigned long long)fields[i].val
+            );
+        }
+    }
+}
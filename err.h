@@ -6,7 +6,7 @@
 #ifndef EAMBFC_ERR_H
 #define EAMBFC_ERR_H 1
 /* internal */
-#include "types.h" /* uint */
+#include "types.h" /* uint, u64, size_t */
 
 /* enable quiet mode - this does not print error messages to stderr. Does not
  * affect JSON messages printed to stdout. */
@@ -14,6 +14,27 @@ void quiet_mode(void);
 /* enable JSON display mode - this prints JSON-formatted error messagess to
  * stdout instead of printing human-readable error messages to stderr. */
 void json_mode(void);
+/* include file as the "file" field of the JSON-formatted error messages after
+ * this, until it's called again, or leave it out if file is NULL */
+void err_file(const char *file);
+
+/* an error message, as passed to an error handler set with err_handler */
+typedef struct err_info {
+    const char *id;
+    const char *msg;
+    /* the instruction it's about, or '\0' if it's not about one */
+    char instr;
+    /* where that instruction is in the source code, or 0 for both if that's
+     * not known */
+    uint line;
+    uint col;
+} err_info;
+
+/* pass every error message after this to handler, along with data, instead of
+ * printing it, or go back to printing them if handler is NULL. The strings in
+ * the err_info are only valid until handler returns. Fatal errors are passed to
+ * it as well, before exiting. */
+void err_handler(void (*handler)(const err_info *err, void *data), void *data);
 
 /* functions to display error messages, depending on the current error mode. */
 
@@ -29,6 +50,21 @@ void position_err(const char *id, char *msg, char instr, uint line, uint col);
  * to basic_err */
 void param_err(const char *id, const char *proto, const char *arg);
 
+/* a number to include in a report printed by stats_report */
+typedef struct report_field {
+    /* its name in JSON mode, which is assumed not to need escaping */
+    const char *key;
+    /* its description otherwise */
+    const char *desc;
+    u64 val;
+} report_field;
+
+/* print a report about file that isn't an error, made up of the ct fields in
+ * fields. In JSON mode, it's a single JSON object printed to stdout, with file
+ * in its "file" member, and otherwise, it's printed to stderr, with a line for
+ * each field. Quiet mode doesn't affect it. */
+void stats_report(const char *file, const report_field *fields, size_t ct);
+
 /* FATAL ERRORS
  * these each call exit(EXIT_FAILURE) after printing the message. */
 
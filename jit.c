@@ -0,0 +1,235 @@
+/* SPDX-FileCopyrightText: 2025 Eli Array Minkoff
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * Compiles brainfuck code for the architecture eambfc is running on, and runs
+ * it as a function within the eambfc process. */
+
+/* C99 */
+#include <stdio.h> /* FILE, fclose, fflush, fopen, fprintf, snprintf, std* */
+#include <string.h> /* memcpy */
+/* POSIX */
+#include <fcntl.h> /* O_RDWR */
+#include <sys/mman.h> /* mmap, mprotect, munmap, MAP_*, PROT_* */
+#include <unistd.h> /* getpid, sysconf, _SC_PAGESIZE */
+/* internal */
+#include "arch_inter.h" /* arch_inter, *_INTER, IO_SEG_SZ */
+#include "compile.h" /* bf_*, code_region, HUGE_PAGE_SZ, REGION_NAME_SZ */
+#include "err.h" /* basic_err, param_err */
+#include "jit.h" /* bf_jit_run, jit_host_inter */
+#include "resource_mgr.h" /* mgr_open, mgr_close, mgr_free */
+#include "types.h" /* bool, i64, u64, size_t, SIZE_MAX */
+
+/* __BACKENDS__ add a block here */
+const arch_inter *jit_host_inter(void) {
+#if defined(__x86_64__) && EAMBFC_TARGET_X86_64
+    return &X86_64_INTER;
+#elif defined(__aarch64__) && EAMBFC_TARGET_ARM64
+    return &ARM64_INTER;
+#elif defined(__s390x__) && EAMBFC_TARGET_S390X
+    return &S390X_INTER;
+#else
+    return NULL;
+#endif
+}
+
+/* round sz up to a multiple of page_sz, which is a power of 2 */
+#define PAGE_ROUND(sz, page_sz) (((sz) + (page_sz) - 1) & ~((page_sz) - 1))
+
+/* map sz bytes of zeroed memory with the protection prot, returning MAP_FAILED
+ * on failure. MAP_ANONYMOUS is not part of POSIX.1-2008, so this privately maps
+ * /dev/zero instead. */
+static void *map_zeroed(size_t sz, int prot) {
+    int fd = mgr_open("/dev/zero", O_RDWR);
+    if (fd == -1) return MAP_FAILED;
+    void *map = mmap(NULL, sz, prot, MAP_PRIVATE, fd, 0);
+    mgr_close(fd);
+    return map;
+}
+
+/* map the memory used as the tape and buffered I/O segment, laid out as
+ * follows, with each part starting on a page boundary:
+ *  - an inaccessible guard page, extended up to the next multiple of
+ *    HUGE_PAGE_SZ if huge_tape is true
+ *  - the tape
+ *  - another inaccessible guard page
+ *  - the buffered I/O segment, if needed
+ *
+ * Sets *tape_addr and *io_addr to the addresses of the tape and I/O segment,
+ * and *map_sz to the size of the mapping, and returns the mapping, or returns
+ * NULL after printing an error if it failed. */
+static void *map_data(
+    u64 tape_blocks,
+    bool huge_tape,
+    bool buffered,
+    size_t page_sz,
+    i64 *tape_addr,
+    i64 *io_addr,
+    size_t *map_sz
+) {
+    if (tape_blocks > (SIZE_MAX - IO_SEG_SZ - HUGE_PAGE_SZ) / 0x1000 - 0x10) {
+        basic_err("JIT_TAPE_TOO_LARGE", "Tape is too large to map in memory");
+        return NULL;
+    }
+    size_t tape_sz = PAGE_ROUND((size_t)tape_blocks * 0x1000, page_sz);
+    size_t io_sz = buffered ? PAGE_ROUND(IO_SEG_SZ, page_sz) : 0;
+    /* with a huge page's worth of space before the tape, it can start at the
+     * first huge page boundary at least a page into the mapping */
+    size_t guard_sz = huge_tape ? HUGE_PAGE_SZ : page_sz;
+    *map_sz = guard_sz + tape_sz + page_sz + io_sz;
+    char *map = map_zeroed(*map_sz, PROT_NONE);
+    if (map == MAP_FAILED) {
+        basic_err("JIT_MMAP_FAILED", "Failed to map memory for the tape");
+        return NULL;
+    }
+    char *tape = map + page_sz;
+    if (huge_tape) {
+        tape += PAGE_ROUND((size_t)tape, HUGE_PAGE_SZ) - (size_t)tape;
+    }
+    char *io = tape + tape_sz + page_sz;
+    if (mprotect(tape, tape_sz, PROT_READ | PROT_WRITE) != 0 ||
+        (buffered && mprotect(io, io_sz, PROT_READ | PROT_WRITE) != 0)) {
+        basic_err("JIT_MPROTECT_FAILED", "Failed to make the tape writable");
+        munmap(map, *map_sz);
+        return NULL;
+    }
+    *tape_addr = (i64)(size_t)tape;
+    *io_addr = buffered ? (i64)(size_t)io : 0;
+    return map;
+}
+
+/* copy the machine code in obj_code into a new mapping, then make it
+ * executable but not writable. Returns the mapping, or NULL after printing an
+ * error if it failed. */
+static void *map_code(const sized_buf *obj_code, size_t code_sz) {
+    void *code = map_zeroed(code_sz, PROT_READ | PROT_WRITE);
+    if (code == MAP_FAILED) {
+        basic_err("JIT_MMAP_FAILED", "Failed to map memory for the code");
+        return NULL;
+    }
+    memcpy(code, obj_code->buf, obj_code->sz);
+    if (mprotect(code, code_sz, PROT_READ | PROT_EXEC) != 0) {
+        basic_err("JIT_MPROTECT_FAILED", "Failed to make the code executable");
+        munmap(code, code_sz);
+        return NULL;
+    }
+#ifdef __GNUC__
+    /* some architectures need their instruction caches flushed explicitly */
+    __builtin___clear_cache((char *)code, (char *)code + obj_code->sz);
+#endif /* __GNUC__ */
+    return code;
+}
+
+/* Append an entry for each code_region in the machine code in ctx, which was
+ * copied to code, to the perf map file for this process, which perf reads to
+ * name the functions in code that it can't find in any file. Returns true if
+ * successful, and prints an error and returns false otherwise. */
+static bool write_perf_map(const bf_compile_ctx *ctx, const void *code) {
+    sized_buf regions;
+    if (!bf_code_regions(ctx, ctx->obj_code.sz, &regions)) return false;
+    const code_region *region = regions.buf;
+    char path[48];
+    snprintf(path, sizeof(path), "/tmp/perf-%ld.map", (long)getpid());
+    /* append, as other programs may have already been run by this process */
+    FILE *map = fopen(path, "a");
+    bool ret = map != NULL;
+    for (size_t i = 0; ret && i < regions.sz / sizeof(code_region); i++) {
+        char name[REGION_NAME_SZ];
+        bf_region_name(&region[i], name);
+        ret = fprintf(
+                  map,
+                  "%llx %llx %s\n",
+                  (unsigned long long)((size_t)code + region[i].start),
+                  (unsigned long long)(region[i].end - region[i].start),
+                  name
+              ) >= 0;
+    }
+    if (map != NULL && fclose(map) != 0) ret = false;
+    if (!ret) param_err("JIT_PERF_MAP_FAILED", "Failed to write to {}.", path);
+    mgr_free(regions.buf);
+    return ret;
+}
+
+bool bf_jit_run(
+    bf_compile_ctx *ctx,
+    int in_fd,
+    bool optimize,
+    u64 tape_blocks,
+    bool huge_tape,
+    bool buffered,
+    bool align_loops,
+    bool eval,
+    const loop_profile *guide,
+    bool perf_map
+) {
+    const arch_inter *inter = jit_host_inter();
+    if (inter == NULL) {
+        basic_err(
+            "JIT_UNSUPPORTED",
+            "This build of eambfc can't run code on this architecture"
+        );
+        return false;
+    }
+    long page_sz = sysconf(_SC_PAGESIZE);
+    if (page_sz <= 0) page_sz = 0x1000;
+
+    i64 tape_addr, io_addr;
+    size_t data_sz;
+    const bf_source src = {.fd = in_fd, .buf = NULL, .sz = 0};
+    void *data = map_data(
+        tape_blocks,
+        huge_tape,
+        buffered,
+        (size_t)page_sz,
+        &tape_addr,
+        &io_addr,
+        &data_sz
+    );
+    if (data == NULL) return false;
+
+    if (!bf_compile_code(
+            ctx,
+            inter,
+            &src,
+            optimize,
+            tape_addr,
+            tape_blocks,
+            huge_tape,
+            io_addr,
+            0,
+            true,
+            align_loops,
+            eval,
+            guide,
+            perf_map
+        )) {
+        munmap(data, data_sz);
+        return false;
+    }
+    /* fill in whatever was left on the tape by running the code ahead of
+     * time */
+    memcpy((void *)(size_t)tape_addr, ctx->tape_init.buf, ctx->tape_init.sz);
+
+    size_t code_sz = PAGE_ROUND(ctx->obj_code.sz, (size_t)page_sz);
+    void *code = map_code(&ctx->obj_code, code_sz);
+    if (code == NULL || (perf_map && !write_perf_map(ctx, code))) {
+        if (code != NULL) munmap(code, code_sz);
+        munmap(data, data_sz);
+        return false;
+    }
+
+    /* ISO C doesn't allow converting object pointers to function pointers,
+     * but POSIX requires that they have the same representation. */
+    void (*run)(void);
+    memcpy(&run, &code, sizeof(run));
+
+    /* make sure that anything eambfc printed comes before the program's own
+     * output */
+    fflush(stdout);
+    fflush(stderr);
+    run();
+
+    munmap(code, code_sz);
+    munmap(data, data_sz);
+    return true;
+}
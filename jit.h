@@ -0,0 +1,65 @@
+/* SPDX-FileCopyrightText: 2025 Eli Array Minkoff
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * Provides an interface to jit.c, which runs brainfuck code within the eambfc
+ * process itself, instead of writing it out as an executable. */
+
+#ifndef EAMBFC_JIT_H
+#define EAMBFC_JIT_H 1
+/* internal */
+#include "arch_inter.h" /* arch_inter */
+#include "compile.h" /* bf_compile_ctx */
+#include "profile.h" /* loop_profile */
+#include "types.h" /* bool, u64 */
+
+/* Returns the backend for the architecture eambfc is running on, or NULL if
+ * this build of eambfc doesn't include one for it. */
+const arch_inter *jit_host_inter(void);
+
+/* Compile the brainfuck source code in in_fd to machine code for the
+ * architecture eambfc is running on, then run it within the current process.
+ * Parameters:
+ * - ctx is a compilation context, already initialized with bf_ctx_init.
+ * - in_fd is a brainfuck source file, open for reading.
+ * - optimize is a boolean indicating whether to optimize code before compiling.
+ * - tape_blocks is the number of 4-KiB blocks to allocate for the tape.
+ * - huge_tape is a boolean indicating whether to start the tape at a multiple
+ *   of HUGE_PAGE_SZ and ask the kernel to back it with huge pages - see
+ *   bf_compile in compile.h.
+ * - buffered is a boolean indicating whether to buffer I/O.
+ * - align_loops is a boolean indicating whether to align innermost loops.
+ * - eval is a boolean indicating whether to run as much of the code as
+ *   possible at compile time.
+ * - guide is a profile used to pick which loops to align, or NULL - see
+ *   bf_compile in compile.h.
+ * - perf_map is a boolean indicating whether to name the parts of the machine
+ *   code within each loop in /tmp/perf-<pid>.map, where perf can find them.
+ *
+ * The tape and buffered I/O segment are allocated with mmap, surrounded by
+ * inaccessible guard pages, and the machine code is copied into its own
+ * mapping, which is made executable only after it's no longer writable. The
+ * program uses the same standard input and output as eambfc, and any output
+ * already written to stdout or stderr through stdio is flushed before it
+ * starts.
+ *
+ * As the program runs as part of the eambfc process, a program that runs off of
+ * the end of the tape crashes eambfc itself with a segmentation fault.
+ *
+ * Returns true if the program was compiled and ran to completion, and false if
+ * compilation failed, the architecture is not supported, or the memory for the
+ * program could not be set up. If it runs into any problems, it prints an
+ * appropriate error message. */
+bool bf_jit_run(
+    bf_compile_ctx *ctx,
+    int in_fd,
+    bool optimize,
+    u64 tape_blocks,
+    bool huge_tape,
+    bool buffered,
+    bool align_loops,
+    bool eval,
+    const loop_profile *guide,
+    bool perf_map
+);
+#endif /* EAMBFC_JIT_H */
@@ -0,0 +1,225 @@
+/* SPDX-FileCopyrightText: 2025 Eli Array Minkoff
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * libeambfc's public interface, described in libeambfc.h, built on the same
+ * functions that eambfc itself uses to compile files. */
+
+/* C99 */
+#include <stdarg.h> /* va_* */
+#include <string.h> /* strcmp, strlen */
+/* internal */
+#include "arch_inter.h" /* arch_inter, *_INTER */
+#include "compile.h" /* bf_*, bf_compile_ctx, TAPE_ADDRESS */
+#include "config.h" /* EAMBFC_DEFAULT_INTER, EAMBFC_TARGET_* */
+#include "err.h" /* basic_err, err_handler, err_info */
+#include "libeambfc.h" /* eambfc_* */
+#include "resource_mgr.h" /* mgr_* */
+#include "types.h" /* bool, size_t, sized_buf, uint, UINT64_MAX */
+#include "util.h" /* append_obj */
+
+/* an error found during a compilation, with its strings stored as offsets into
+ * the compiler's error_text buffer, which can move as it grows */
+typedef struct {
+    size_t id;
+    size_t msg;
+    char instr;
+    uint line;
+    uint col;
+} stored_err;
+
+struct eambfc_compiler {
+    bf_compile_ctx ctx;
+    /* the ELF executable from the last compilation, if it was one */
+    sized_buf out;
+    /* the stored_err structs for the errors found in the last compilation,
+     * their strings, and the eambfc_error structs made from them at the end */
+    sized_buf stored;
+    sized_buf error_text;
+    sized_buf errors;
+};
+
+/* returns true if strcmp matches s to any strings in its argument,
+ * and false otherwise.
+ * normal safety concerns around strcmp apply. */
+static bool any_match(const char *s, int count, ...) {
+    va_list ap;
+    va_start(ap, count);
+    bool found = false;
+    for (int i = 0; i < count; i++) {
+        if (!strcmp(s, va_arg(ap, const char *))) {
+            found = true;
+            break;
+        }
+    }
+    va_end(ap);
+    return found;
+}
+
+const struct arch_inter *eambfc_arch(const char *name) {
+    if (name == NULL) return &EAMBFC_DEFAULT_INTER;
+    /* either a bunch of #if preprocessor stuff or this, and the former
+     * would need to have an `if (false)` to make sure it's valid.
+     * Instead, use the macros and trust the compiler to optimize out
+     * the constant check, and optimize out any disabled blocks. */
+    /* __BACKENDS__ add a block here */
+    if (EAMBFC_TARGET_X86_64 &&
+        any_match(name, 4, "x86_64", "x64", "amd64", "x86-64")) {
+        return &X86_64_INTER;
+    } else if (EAMBFC_TARGET_ARM64 && any_match(name, 2, "arm64", "aarch64")) {
+        return &ARM64_INTER;
+    } else if (EAMBFC_TARGET_S390X &&
+               any_match(name, 3, "s390x", "s390", "z/architecture")) {
+        return &S390X_INTER;
+    }
+    return NULL;
+}
+
+void eambfc_default_options(eambfc_options *opts) {
+    *opts = (eambfc_options){
+        .arch = eambfc_arch(NULL),
+        .tape_blocks = 8,
+        .optimize = false,
+        .buffered = false,
+        .align_loops = false,
+        .eval = false,
+        .huge_tape = false,
+        .profile = false,
+        .symbols = false,
+        .raw = false,
+        .tape_addr = 0,
+        .io_addr = 0,
+    };
+}
+
+/* allocate an empty sized_buf with the Resource Manager */
+static sized_buf new_buf(void) {
+    return (sized_buf){.sz = 0, .capacity = 4096, .buf = mgr_malloc(4096)};
+}
+
+eambfc_compiler *eambfc_new(void) {
+    eambfc_compiler *compiler = mgr_malloc(sizeof(eambfc_compiler));
+    bf_ctx_init(&compiler->ctx);
+    compiler->out = new_buf();
+    compiler->stored = new_buf();
+    compiler->error_text = new_buf();
+    compiler->errors = new_buf();
+    return compiler;
+}
+
+void eambfc_free(eambfc_compiler *compiler) {
+    bf_ctx_cleanup(&compiler->ctx);
+    mgr_free(compiler->out.buf);
+    mgr_free(compiler->stored.buf);
+    mgr_free(compiler->error_text.buf);
+    mgr_free(compiler->errors.buf);
+    mgr_free(compiler);
+}
+
+/* the error handler used while compiling, which stores a copy of each error in
+ * the compiler passed as data */
+static void store_err(const err_info *err, void *data) {
+    eambfc_compiler *compiler = data;
+    sized_buf *text = &compiler->error_text;
+    stored_err stored = {
+        .id = text->sz,
+        .msg = text->sz + strlen(err->id) + 1,
+        .instr = err->instr,
+        .line = err->line,
+        .col = err->col,
+    };
+    append_obj(text, err->id, strlen(err->id) + 1);
+    append_obj(text, err->msg, strlen(err->msg) + 1);
+    append_obj(&compiler->stored, &stored, sizeof(stored));
+}
+
+bool eambfc_compile(
+    eambfc_compiler *compiler,
+    const char *src,
+    size_t src_size,
+    const eambfc_options *opts,
+    eambfc_result *result
+) {
+    compiler->out.sz = 0;
+    compiler->stored.sz = 0;
+    compiler->error_text.sz = 0;
+    compiler->errors.sz = 0;
+    const bf_source source = {.fd = -1, .buf = src, .sz = src_size};
+    bf_compile_ctx *ctx = &compiler->ctx;
+
+    err_handler(store_err, compiler);
+    bool ret = false;
+    /* the same limits that eambfc's -t option has */
+    if (opts->tape_blocks == 0) {
+        basic_err("NO_TAPE", "tape_blocks must be at least 1");
+    } else if (opts->tape_blocks >= (UINT64_MAX >> 12)) {
+        basic_err(
+            "TAPE_TOO_LARGE",
+            "tape_blocks * 0x1000 exceeds the 64-bit integer limit."
+        );
+    } else if (opts->raw) {
+        ret = bf_compile_code(
+            ctx,
+            opts->arch,
+            &source,
+            opts->optimize,
+            (i64)opts->tape_addr,
+            opts->tape_blocks,
+            opts->huge_tape,
+            opts->buffered ? (i64)opts->io_addr : 0,
+            0,
+            false,
+            opts->align_loops,
+            opts->eval,
+            NULL,
+            false
+        );
+    } else {
+        bf_dest dst = {.fd = -1, .buf = &compiler->out};
+        ret = bf_compile(
+            ctx,
+            opts->arch,
+            &source,
+            &dst,
+            opts->optimize,
+            opts->tape_blocks,
+            opts->huge_tape,
+            opts->buffered,
+            opts->align_loops,
+            opts->eval,
+            opts->profile,
+            NULL,
+            opts->symbols
+        );
+    }
+    err_handler(NULL, NULL);
+
+    /* now that error_text won't move again, point the errors at their text */
+    const stored_err *stored = compiler->stored.buf;
+    size_t err_ct = compiler->stored.sz / sizeof(stored_err);
+    const char *text = compiler->error_text.buf;
+    for (size_t i = 0; i < err_ct; i++) {
+        eambfc_error err = {
+            .id = &text[stored[i].id],
+            .message = &text[stored[i].msg],
+            .instr = stored[i].instr,
+            .line = stored[i].line,
+            .col = stored[i].col,
+        };
+        append_obj(&compiler->errors, &err, sizeof(err));
+    }
+
+    const sized_buf *out = opts->raw ? &ctx->obj_code : &compiler->out;
+    const sized_buf *tape_init = &ctx->tape_init;
+    *result = (eambfc_result){
+        .bytes = out->buf,
+        .size = out->buf != NULL ? out->sz : 0,
+        .tape_init = (opts->raw && tape_init->buf != NULL) ? tape_init->buf
+                                                           : NULL,
+        .tape_init_size = (opts->raw && tape_init->buf != NULL) ? tape_init->sz
+                                                                : 0,
+        .errors = compiler->errors.buf,
+        .error_count = err_ct,
+    };
+    return ret;
+}
@@ -0,0 +1,111 @@
+/* SPDX-FileCopyrightText: 2025 Eli Array Minkoff
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * The public interface of libeambfc, which compiles brainfuck source code in
+ * memory to an ELF executable or raw machine code in memory, and returns any
+ * errors as data instead of printing them, so that programs can compile many
+ * files without starting a process or writing a temporary file for each.
+ *
+ * Programs using libeambfc.a should only use this header - the rest are
+ * internal to eambfc, and can change at any time. */
+
+#ifndef EAMBFC_LIBEAMBFC_H
+#define EAMBFC_LIBEAMBFC_H 1
+/* C99 */
+#include <stdbool.h> /* bool */
+#include <stddef.h> /* size_t */
+
+/* the backend for a target architecture, which is opaque outside of eambfc */
+struct arch_inter;
+
+/* Returns the backend for the architecture named name, which can be any name
+ * that eambfc's -a option accepts, or NULL if this build doesn't support it.
+ * If name is NULL, returns the backend for the default architecture. */
+const struct arch_inter *eambfc_arch(const char *name);
+
+/* options for a compilation */
+typedef struct eambfc_options {
+    /* the architecture to compile for */
+    const struct arch_inter *arch;
+    /* the number of 4-KiB blocks to allocate for the tape, which must be at
+     * least 1, and small enough that the tape's size in bytes fits in 64 bits,
+     * the same as with eambfc's -t option */
+    unsigned long long tape_blocks;
+    /* the same as eambfc's -O, -b, -l, -E, -H, -P, and -g options */
+    bool optimize;
+    bool buffered;
+    bool align_loops;
+    bool eval;
+    bool huge_tape;
+    bool profile;
+    bool symbols;
+    /* If raw is true, the output is only the machine code, which expects the
+     * tape to be at tape_addr, and if buffered is true, the buffered I/O
+     * segment (which must be zeroed) to be at io_addr. It exits the process
+     * once it's done. The profile and symbols options are ignored. */
+    bool raw;
+    unsigned long long tape_addr;
+    unsigned long long io_addr;
+} eambfc_options;
+
+/* Set *opts to the defaults, which match running eambfc with no options. */
+void eambfc_default_options(eambfc_options *opts);
+
+/* an error that was found while compiling */
+typedef struct eambfc_error {
+    /* an identifier for the kind of error, such as "UNMATCHED_CLOSE" */
+    const char *id;
+    /* a human-readable description of the error */
+    const char *message;
+    /* the instruction it's about, or '\0' if it's not about one */
+    char instr;
+    /* where that instruction is in the source code, or 0 for both if that's
+     * not known */
+    unsigned line;
+    unsigned col;
+} eambfc_error;
+
+/* the result of a compilation */
+typedef struct eambfc_result {
+    /* the ELF executable or raw machine code */
+    const unsigned char *bytes;
+    size_t size;
+    /* if raw is set and eval ran part of the program ahead of time, what must
+     * be copied to the start of the tape before running the code */
+    const unsigned char *tape_init;
+    size_t tape_init_size;
+    /* the errors found, in the order they were found */
+    const eambfc_error *errors;
+    size_t error_count;
+} eambfc_result;
+
+/* A compiler, which holds the buffers used for compilations, and the results
+ * of the last one. Each can be used for any number of compilations, one after
+ * another, but libeambfc is not thread-safe, so only one compilation can run
+ * at a time in a process. */
+typedef struct eambfc_compiler eambfc_compiler;
+
+/* Create a new compiler. Like the rest of libeambfc, it exits the process if
+ * it runs out of memory. */
+eambfc_compiler *eambfc_new(void);
+
+/* Free compiler, along with the results of its last compilation. */
+void eambfc_free(eambfc_compiler *compiler);
+
+/* Compile the src_size bytes of brainfuck source code at src with the options
+ * in opts, storing the result in *result, which stays valid until compiler is
+ * used again or freed. Nothing is printed.
+ *
+ * Returns true if it was successful. Otherwise, returns false, and the errors
+ * are in result->errors, while the output is whatever could still be compiled,
+ * for debugging, if anything. */
+bool eambfc_compile(
+    eambfc_compiler *compiler,
+    const char *src,
+    size_t src_size,
+    const eambfc_options *opts,
+    eambfc_result *result
+);
+
+#endif /* EAMBFC_LIBEAMBFC_H */
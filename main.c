@@ -5,21 +5,27 @@
  * A Brainfuck to x86_64 Linux ELF compiler. */
 
 /* C99 */
-#include <stdarg.h> /* va_* */
-#include <stdio.h> /* FILE, stderr, stdout, printf, fprintf */
-#include <stdlib.h> /* malloc, free, EXIT_*, strtoull */
+#include <stdio.h> /* FILE, stderr, stdout, printf, fprintf, fflush, tmpfile */
+#include <stdlib.h> /* malloc, free, getenv, EXIT_*, strtoull */
 #include <string.h> /* strncmp, strlen, strcpy */
 /* POSIX */
 #include <fcntl.h> /* O_*, mode_t */
-#include <unistd.h> /* getopt, optopt */
+#include <sys/stat.h> /* fstat, struct stat, S_ISREG */
+#include <sys/wait.h> /* pid_t, wait, WIFEXITED, WEXITSTATUS */
+#include <unistd.h> /* close, dup*, fork, getopt, lseek, optopt, STD*_FILENO */
 /* internal */
 #include "arch_inter.h" /* arch_inter, *_INTER */
+#include "cache.h" /* cache_* */
 #include "compat/elf.h" /* EM_* */
-#include "compile.h" /* bf_compile */
+#include "compile.h" /* bf_*, bf_compile_ctx, compile_stats */
 #include "config.h" /* EAMBFC_DEFAULT_*, EAMBFC_TARGET_* */
-#include "err.h" /* *_err */
+#include "err.h" /* *_err, report_field, stats_report */
+#include "jit.h" /* bf_jit_run, jit_host_inter */
+#include "libeambfc.h" /* eambfc_arch */
+#include "profile.h" /* free_profile, load_profile, loop_profile */
 #include "resource_mgr.h" /* mgr_*, register_mgr */
-#include "types.h" /* bool, u64, UINT64_MAX */
+#include "types.h" /* bool, uint, u64, UINT64_MAX, sized_buf */
+#include "util.h" /* *_sized_buf, write_obj */
 #include "version.h" /* EAMBFC_VERSION, EAMBFC_COMMIT */
 
 /* print the help message to outfile. progname should be argv[0]. */
@@ -33,15 +39,46 @@ static void show_help(FILE *outfile, const char *progname) {
         "             (assumes file names are UTF-8-encoded.)\n"
         " -q        - don't print errors unless -j was passed*\n"
         " -O        - enable optimization**.\n"
+        " -b        - buffer I/O within compiled programs, writing output\n"
+        "             when the buffer fills, before waiting for input, and\n"
+        "             before exiting, and reading input in large chunks\n"
+        " -l        - align the start of innermost loops in compiled\n"
+        "             programs (only when optimizing)\n"
+        " -H        - start the tape at a 2-MiB boundary, and have compiled\n"
+        "             programs ask the kernel to back it with transparent\n"
+        "             huge pages, for faster access to large tapes\n"
+        " -E        - run as much of each program as possible while\n"
+        "             compiling it (only when optimizing)\n"
+        " -g        - add a symbol for the code in each loop to compiled\n"
+        "             programs, and a table mapping their code to the source\n"
+        "             code, or with -x, write them to /tmp/perf-<pid>.map\n"
+        " -P        - count how many times each loop runs in compiled\n"
+        "             programs, and write the counts to file descriptor 3\n"
+        "             when they exit\n"
+        " -s        - after compiling each file, report what the optimizer\n"
+        "             did, how large the output is, and how long each step\n"
+        "             took (in JSON format to stdout if -j was passed)\n"
+        " -x        - run the programs within this process instead of\n"
+        "             writing executables, compiling them for the\n"
+        "             architecture this program is running on\n"
         " -k        - keep files that failed to compile (for debugging)\n"
         " -c        - continue to the next file instead of quitting if a\n"
         "             file fails to compile\n"
+        " -J count  - (only provide once) compile up to <count> files at\n"
+        "             the same time. (defaults to 1 if not specified)\n"
         " -t count  - (only provide once) allocate <count> 4-KiB blocks for\n"
         "             the tape. (defaults to 8 if not specified)\n"
         " -e ext    - (only provide once) use 'ext' as the extension for\n"
         "             source files instead of '.bf'\n"
         "             (This program will remove this at the end of the input\n"
         "             file to create the output file name)\n"
+        " -C dir    - (only provide once) store compiled programs in the\n"
+        "             cache directory 'dir', and copy them from there\n"
+        "             instead of compiling the same source code with the\n"
+        "             same options again (defaults to $EAMBFC_CACHE, if set)\n"
+        " -p file   - (only provide once) use the profile in 'file',\n"
+        "             written by a program compiled with -P, to align only\n"
+        "             its hot innermost loops (only when optimizing)\n"
         " -a arch   - compile for the specified architecture\n"
         "             (defaults to " EAMBFC_DEFAULT_ARCH_STR
         " if not specified)**\n"
@@ -58,23 +95,6 @@ static void show_help(FILE *outfile, const char *progname) {
     );
 }
 
-/* returns true if strcmp matches s to any strings in its argument,
- * and false otherwise.
- * normal safety concerns around strcmp apply. */
-static bool any_match(const char *s, int count, ...) {
-    va_list ap;
-    va_start(ap, count);
-    bool found = false;
-    for (int i = 0; i < count; i++) {
-        if (!strcmp(s, va_arg(ap, const char *))) {
-            found = true;
-            break;
-        }
-    }
-    va_end(ap);
-    return found;
-}
-
 /* remove ext from end of str. If str doesn't end with ext, return false. */
 static bool rm_ext(char *str, const char *ext) {
     size_t strsz = strlen(str);
@@ -90,16 +110,33 @@ static bool rm_ext(char *str, const char *ext) {
     return true;
 }
 
+/* the maximum number of files that can be compiled at the same time */
+#define MAX_JOBS 1024
+#define MAX_JOBS_STR "1024"
+
 typedef struct {
     arch_inter *inter;
     char *ext;
+    const char *cache_dir;
+    const char *profile_path;
+    /* the profile read from profile_path, if it was set */
+    const loop_profile *guide;
     u64 tape_blocks;
+    uint jobs;
     /* use bitfield booleans here */
     bool quiet    : 1;
     bool optimize : 1;
     bool keep     : 1;
     bool moveahead: 1;
     bool json     : 1;
+    bool buffered : 1;
+    bool align    : 1;
+    bool huge_tape: 1;
+    bool eval     : 1;
+    bool profile  : 1;
+    bool symbols  : 1;
+    bool stats    : 1;
+    bool run      : 1;
 } run_cfg;
 
 /* macro for use in parse_args function only.
@@ -110,19 +147,32 @@ typedef struct {
 
 static run_cfg parse_args(int argc, char *argv[]) {
     int opt;
+    char *endptr;
     char char_str_buf[2] = "";
     run_cfg rc = {
         .inter = NULL,
         .ext = NULL,
+        .cache_dir = NULL,
+        .profile_path = NULL,
+        .guide = NULL,
         .tape_blocks = 0,
+        .jobs = 0,
         .quiet = false,
         .optimize = false,
         .keep = false,
         .moveahead = false,
         .json = false,
+        .buffered = false,
+        .align = false,
+        .huge_tape = false,
+        .eval = false,
+        .profile = false,
+        .symbols = false,
+        .stats = false,
+        .run = false,
     };
 
-    while ((opt = getopt(argc, argv, ":hVqjOkmAa:e:t:")) != -1) {
+    while ((opt = getopt(argc, argv, ":hVqjOkmblHEPgsxAa:e:t:J:C:p:")) != -1) {
         switch (opt) {
         case 'h': show_help(stdout, argv[0]); exit(EXIT_SUCCESS);
         case 'V':
@@ -172,6 +222,14 @@ static run_cfg parse_args(int argc, char *argv[]) {
         case 'O': rc.optimize = true; break;
         case 'k': rc.keep = true; break;
         case 'm': rc.moveahead = true; break;
+        case 'b': rc.buffered = true; break;
+        case 'l': rc.align = true; break;
+        case 'H': rc.huge_tape = true; break;
+        case 'E': rc.eval = true; break;
+        case 'P': rc.profile = true; break;
+        case 'g': rc.symbols = true; break;
+        case 's': rc.stats = true; break;
+        case 'x': rc.run = true; break;
         case 'e':
             /* Print an error if ext was already set. */
             if (rc.ext != NULL) {
@@ -181,6 +239,22 @@ static run_cfg parse_args(int argc, char *argv[]) {
             }
             rc.ext = optarg;
             break;
+        case 'C':
+            if (rc.cache_dir != NULL) {
+                basic_err("MULTIPLE_CACHE_DIRS", "passed -C multiple times.");
+                SHOW_HINT();
+                exit(EXIT_FAILURE);
+            }
+            rc.cache_dir = optarg;
+            break;
+        case 'p':
+            if (rc.profile_path != NULL) {
+                basic_err("MULTIPLE_PROFILES", "passed -p multiple times.");
+                SHOW_HINT();
+                exit(EXIT_FAILURE);
+            }
+            rc.profile_path = optarg;
+            break;
         case 't':
             /* Print an error if tape_blocks has already been set */
             if (rc.tape_blocks != 0) {
@@ -190,7 +264,6 @@ static run_cfg parse_args(int argc, char *argv[]) {
                 SHOW_HINT();
                 exit(EXIT_FAILURE);
             }
-            char *endptr;
             /* casting unsigned long long instead of using scanf as scanf can
              * lead to undefined behavior if input isn't well-crafted, and
              * unsigned long long is guaranteed to be at least 64 bits. */
@@ -223,29 +296,47 @@ static run_cfg parse_args(int argc, char *argv[]) {
             }
             rc.tape_blocks = (u64)holder;
             break;
+        case 'J':
+            /* Print an error if jobs has already been set */
+            if (rc.jobs != 0) {
+                basic_err("MULTIPLE_JOB_COUNTS", "passed -J multiple times.");
+                SHOW_HINT();
+                exit(EXIT_FAILURE);
+            }
+            unsigned long long int job_ct = strtoull(optarg, &endptr, 10);
+            if (*endptr != '\0') {
+                param_err(
+                    "NOT_NUMERIC",
+                    "{} could not be parsed as a numeric value",
+                    optarg
+                );
+                SHOW_HINT();
+                exit(EXIT_FAILURE);
+            }
+            if (job_ct == 0) {
+                basic_err("NO_JOBS", "Job count for -J must be at least 1");
+                SHOW_HINT();
+                exit(EXIT_FAILURE);
+            }
+            if (job_ct > MAX_JOBS) {
+                param_err(
+                    "TOO_MANY_JOBS",
+                    "{} is more than the maximum of " MAX_JOBS_STR " jobs.",
+                    optarg
+                );
+                SHOW_HINT();
+                exit(EXIT_FAILURE);
+            }
+            rc.jobs = (uint)job_ct;
+            break;
         case 'a':
             if (rc.inter != NULL) {
                 basic_err("MULTIPLE_ARCHES", "passed -a multiple times.");
                 SHOW_HINT();
                 exit(EXIT_FAILURE);
             }
-            /* either a bunch of #if preprocessor stuff or this, and the former
-             * would need to have an `if (false)` to make sure it's valid.
-             * Instead, use the macros and trust the compiler to optimize out
-             * the constant check, and optimize out any disabled blocks. */
-            /* __BACKENDS__ add a block here */
-            if (EAMBFC_TARGET_X86_64 &&
-                any_match(optarg, 4, "x86_64", "x64", "amd64", "x86-64")) {
-                rc.inter = &X86_64_INTER;
-            } else if (EAMBFC_TARGET_ARM64 &&
-                       any_match(optarg, 2, "arm64", "aarch64")) {
-                rc.inter = &ARM64_INTER;
-            } else if (EAMBFC_TARGET_S390X &&
-                       any_match(
-                           optarg, 3, "s390x", "s390", "z/architecture"
-                       )) {
-                rc.inter = &S390X_INTER;
-            } else {
+            rc.inter = eambfc_arch(optarg);
+            if (rc.inter == NULL) {
                 param_err(
                     "UNKNOWN_ARCH",
                     "{} is not a recognized architecture",
@@ -255,7 +346,7 @@ static run_cfg parse_args(int argc, char *argv[]) {
                 exit(EXIT_FAILURE);
             }
             break;
-        case ':': /* one of -a, -e, or -t is missing an argument */
+        case ':': /* one of -a, -e, -t, -J, -C, or -p is missing an argument */
             char_str_buf[0] = (char)optopt;
             param_err(
                 "MISSING_OPERAND",
@@ -281,13 +372,138 @@ static run_cfg parse_args(int argc, char *argv[]) {
     /* if no tape size was specified, default to 8. */
     if (rc.tape_blocks == 0) rc.tape_blocks = 8;
 
+    /* if no cache directory was specified, use $EAMBFC_CACHE if it's set. */
+    if (rc.cache_dir == NULL) {
+        rc.cache_dir = getenv("EAMBFC_CACHE");
+        if (rc.cache_dir != NULL && rc.cache_dir[0] == '\0') {
+            rc.cache_dir = NULL;
+        }
+    }
+
+    /* if no job count was specified, compile one file at a time. */
+    if (rc.jobs == 0) rc.jobs = 1;
+
+    /* the JIT run mode can only run code for the architecture it's on */
+    if (rc.run) {
+        if (rc.profile) {
+            basic_err(
+                "JIT_PROFILE", "-P can't be used with -x, as nothing is written"
+            );
+            SHOW_HINT();
+            exit(EXIT_FAILURE);
+        }
+        const arch_inter *host = jit_host_inter();
+        if (host == NULL) {
+            basic_err(
+                "JIT_UNSUPPORTED",
+                "This build of eambfc can't run code on this architecture"
+            );
+            exit(EXIT_FAILURE);
+        }
+        if (rc.inter != NULL && rc.inter != host) {
+            basic_err(
+                "JIT_ARCH_MISMATCH",
+                "-x can't run code for a different architecture"
+            );
+            SHOW_HINT();
+            exit(EXIT_FAILURE);
+        }
+        rc.inter = host;
+    }
+
     /* if no architecture was specified, default to default value set above */
-    if (rc.inter == NULL) rc.inter = &EAMBFC_DEFAULT_INTER;
+    if (rc.inter == NULL) rc.inter = eambfc_arch(NULL);
     return rc;
 }
 
+/* the size of the buffer for the settings string written by cache_entry */
+#define CACHE_SETTINGS_SZ 256
+
+/* Return the path of the cache entry for the source code in src_fd compiled
+ * with the settings in rc, leaving src_fd at the start of the file again, and
+ * storing the source code in *src and the settings in settings, for checking
+ * and storing the entry. *src must be passed to unmap_sized_buf when done.
+ *
+ * If there's no cache directory, src_fd can't be read from the start again
+ * after reading it once (such as if it's a FIFO), dst_fd isn't a regular file
+ * (so the compiled program can't be read back from it to store it), or the
+ * output depends on a profile, which can change without its name changing,
+ * returns NULL instead, leaving *src and settings unset. */
+static char *cache_entry(
+    int src_fd, int dst_fd, const run_cfg *rc, sized_buf *src, char *settings
+) {
+    struct stat dst_st;
+    if (rc->cache_dir == NULL || rc->guide != NULL ||
+        lseek(src_fd, 0, SEEK_CUR) < 0 || fstat(dst_fd, &dst_st) != 0 ||
+        !S_ISREG(dst_st.st_mode)) {
+        return NULL;
+    }
+    *src = map_to_sized_buf(src_fd);
+    if (src->buf == NULL || lseek(src_fd, 0, SEEK_SET) != 0) {
+        if (src->buf != NULL) unmap_sized_buf(src);
+        return NULL;
+    }
+    /* everything other than the source code that affects the output */
+    snprintf(
+        settings,
+        CACHE_SETTINGS_SZ,
+        "eambfc %s (%s) -a %u -t %llu%s%s%s%s%s%s%s",
+        EAMBFC_VERSION,
+        EAMBFC_COMMIT,
+        (uint)rc->inter->ELF_ARCH,
+        (unsigned long long)rc->tape_blocks,
+        rc->optimize ? " -O" : "",
+        rc->buffered ? " -b" : "",
+        rc->align ? " -l" : "",
+        rc->huge_tape ? " -H" : "",
+        rc->eval ? " -E" : "",
+        rc->profile ? " -P" : "",
+        rc->symbols ? " -g" : ""
+    );
+    return cache_path(rc->cache_dir, src, settings);
+}
+
+/* report the stats of the last compilation using ctx, of filename, for the
+ * architecture in rc, or only that it was copied from the cache if cached is
+ * true */
+static void report_stats(
+    const char *filename,
+    const run_cfg *rc,
+    const bf_compile_ctx *ctx,
+    bool cached
+) {
+    const compile_stats *st = &ctx->stats;
+    report_field fields[] = {
+        {"cached", "copied from the cache", cached},
+        {"elfMachine", "ELF machine", rc->inter->ELF_ARCH},
+        {"sourceBytes", "source code bytes", st->src_bytes},
+        {"commentBytes", "comment bytes", st->opt.comment_bytes},
+        {"deadLoops", "dead loops removed", st->opt.dead_loops},
+        {"mergedInstructions", "instructions merged", st->opt.merged},
+        {"zeroLoops", "loops replaced with zeroing", st->opt.zero_loops},
+        {"multiplyLoops", "multiply loops replaced", st->opt.mul_loops},
+        {"scanLoops", "scan loops replaced", st->opt.scan_loops},
+        {"unrolledLoops", "loops unrolled", st->opt.unrolled_loops},
+        {"deadStores", "dead stores removed", st->opt.dead_stores},
+        {"irInstructions", "IR instructions", st->opt.ir_instrs},
+        {"constantBytes", "constant data bytes", st->opt.data_bytes},
+        {"codeBytes", "machine code bytes", st->code_bytes},
+        {"fileBytes", "output file bytes", st->file_bytes},
+        {"readNs", "reading time (ns)", st->read_ns},
+        {"irNs", "IR generation time (ns)", st->ir_ns},
+        {"evalNs", "compile-time evaluation time (ns)", st->eval_ns},
+        {"codegenNs", "code generation time (ns)", st->codegen_ns},
+        {"writeNs", "writing time (ns)", st->write_ns},
+    };
+    /* nothing was measured for a program copied from the cache */
+    size_t ct = cached ? 2 : sizeof(fields) / sizeof(report_field);
+    stats_report(filename, fields, ct);
+}
+
 /* compile a file */
-static bool compile_file(const char *filename, const run_cfg *rc) {
+static bool compile_file(
+    const char *filename, const run_cfg *rc, bf_compile_ctx *ctx
+) {
     char *outname = mgr_malloc(strlen(filename) + 1);
     strcpy(outname, filename);
     if (!rm_ext(outname, rc->ext)) {
@@ -312,8 +528,45 @@ static bool compile_file(const char *filename, const run_cfg *rc) {
         mgr_free(outname);
         return false;
     }
-    bool result =
-        bf_compile(rc->inter, src_fd, dst_fd, rc->optimize, rc->tape_blocks);
+    /* copy the program from the cache if it's there, and if not, compile it
+     * and add it */
+    sized_buf src_code;
+    char settings[CACHE_SETTINGS_SZ];
+    char *entry = cache_entry(src_fd, dst_fd, rc, &src_code, settings);
+    cache_result cached = CACHE_MISS;
+    if (entry != NULL) cached = cache_fetch(entry, &src_code, settings, dst_fd);
+    bool result = cached == CACHE_HIT;
+    if (cached == CACHE_MISS) {
+        const bf_source src = {.fd = src_fd, .buf = NULL, .sz = 0};
+        bf_dest dst = {.fd = dst_fd, .buf = NULL};
+        result = bf_compile(
+            ctx,
+            rc->inter,
+            &src,
+            &dst,
+            rc->optimize,
+            rc->tape_blocks,
+            rc->huge_tape,
+            rc->buffered,
+            rc->align,
+            rc->eval,
+            rc->profile,
+            rc->guide,
+            rc->symbols
+        );
+        /* the program is still usable if it can't be stored in the cache, so
+         * that's only reported, not treated as a failure */
+        if (result && entry != NULL) {
+            cache_store(entry, &src_code, settings, outname);
+        }
+    }
+    if (result && rc->stats) {
+        report_stats(filename, rc, ctx, cached == CACHE_HIT);
+    }
+    if (entry != NULL) {
+        unmap_sized_buf(&src_code);
+        mgr_free(entry);
+    }
     if ((!result) && (!rc->keep)) remove(outname);
     mgr_close(src_fd);
     mgr_close(dst_fd);
@@ -321,6 +574,175 @@ static bool compile_file(const char *filename, const run_cfg *rc) {
     return result;
 }
 
+/* compile a file, then run it within this process */
+static bool run_file(
+    const char *filename, const run_cfg *rc, bf_compile_ctx *ctx
+) {
+    int src_fd = mgr_open(filename, O_RDONLY);
+    if (src_fd < 0) {
+        param_err("OPEN_R_FAILED", "Failed to open {} for reading.", filename);
+        return false;
+    }
+    bool result = bf_jit_run(
+        ctx,
+        src_fd,
+        rc->optimize,
+        rc->tape_blocks,
+        rc->huge_tape,
+        rc->buffered,
+        rc->align,
+        rc->eval,
+        rc->guide,
+        rc->symbols
+    );
+    if (result && rc->stats) report_stats(filename, rc, ctx, false);
+    mgr_close(src_fd);
+    return result;
+}
+
+/* A file being compiled in a child process. Any error messages it prints are
+ * written to temporary files instead, so that they can be printed as a single
+ * uninterrupted block once it's finished. */
+typedef struct {
+    const char *filename;
+    pid_t pid;
+    /* temporary files that replace stdout and stderr in the child process,
+     * or -1 if they aren't open */
+    int out_fd;
+    int err_fd;
+    /* set once the child process has exited */
+    bool done;
+    /* set if it compiled the file successfully */
+    bool ok;
+} job;
+
+/* Return a file descriptor for a new temporary file, which is deleted once
+ * it's closed, or -1 if it could not be created. Only the file descriptor is
+ * kept, so that there's no stream to close along with it. */
+static int tmp_fd(void) {
+    FILE *f = tmpfile();
+    if (f == NULL) return -1;
+    int fd = dup(fileno(f));
+    fclose(f);
+    return fd;
+}
+
+/* start compiling filename in a new child process. If that fails, prints an
+ * error and marks job as done and unsuccessful. */
+static void start_job(job *j, const char *filename, const run_cfg *rc) {
+    j->filename = filename;
+    j->done = false;
+    j->ok = false;
+    j->out_fd = tmp_fd();
+    j->err_fd = tmp_fd();
+    /* make sure nothing already buffered gets printed twice */
+    fflush(stdout);
+    fflush(stderr);
+    if (j->out_fd == -1 || j->err_fd == -1 || (j->pid = fork()) == -1) {
+        param_err("JOB_FAILED", "Failed to start compiling {}.", filename);
+        if (j->out_fd != -1) close(j->out_fd);
+        if (j->err_fd != -1) close(j->err_fd);
+        j->out_fd = -1;
+        j->err_fd = -1;
+        j->done = true;
+        return;
+    }
+    if (j->pid == 0) {
+        if (dup2(j->out_fd, STDOUT_FILENO) == -1 ||
+            dup2(j->err_fd, STDERR_FILENO) == -1) {
+            exit(EXIT_FAILURE);
+        }
+        err_file(filename);
+        bf_compile_ctx ctx;
+        bf_ctx_init(&ctx);
+        bool result = compile_file(filename, rc, &ctx);
+        bf_ctx_cleanup(&ctx);
+        exit(result ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+}
+
+/* copy the contents of the temporary file open as src_fd to the file
+ * descriptor fd, then close src_fd. */
+static void copy_captured(int src_fd, int fd) {
+    if (src_fd == -1) return;
+    if (lseek(src_fd, 0, SEEK_SET) == 0) {
+        sized_buf captured = read_to_sized_buf(src_fd);
+        if (captured.buf != NULL) {
+            write_obj(fd, captured.buf, captured.sz);
+            mgr_free(captured.buf);
+        }
+    }
+    close(src_fd);
+}
+
+/* print everything that the finished job printed, then clean it up. */
+static void finish_job(job *j) {
+    fflush(stdout);
+    fflush(stderr);
+    copy_captured(j->out_fd, STDOUT_FILENO);
+    copy_captured(j->err_fd, STDERR_FILENO);
+}
+
+/* Compile the files in argv from optind onwards, up to rc->jobs at a time,
+ * each in its own child process.
+ *
+ * Each file's error messages are printed all at once, in the same order that
+ * the files were passed, so the output is the same as if they were compiled
+ * one at a time. If a file fails to compile and rc->moveahead is not set, no
+ * more files are started, but any that are already being compiled are allowed
+ * to finish.
+ *
+ * To limit how much output is held back while waiting on a slow file, at most
+ * 2 * rc->jobs files are in progress or waiting to be printed at a time.
+ *
+ * Returns true if every file that was compiled was compiled successfully. */
+static bool compile_parallel(int argc, char *argv[], const run_cfg *rc) {
+    size_t max_pending = (size_t)rc->jobs * 2;
+    job *jobs = mgr_malloc(max_pending * sizeof(job));
+    /* jobs is a ring buffer, and head is the index of the oldest job */
+    size_t head = 0;
+    size_t pending = 0;
+    uint running = 0;
+    int next_file = optind;
+    bool ret = true;
+    bool stop = false;
+
+    while (pending || (!stop && next_file < argc)) {
+        while (!stop && next_file < argc && running < rc->jobs &&
+               pending < max_pending) {
+            job *j = &jobs[(head + pending++) % max_pending];
+            start_job(j, argv[next_file++], rc);
+            if (!j->done) running++;
+        }
+        /* print finished jobs, in the order they were started */
+        while (pending && jobs[head].done) {
+            finish_job(&jobs[head]);
+            if (!jobs[head].ok) {
+                ret = false;
+                if (!rc->moveahead) stop = true;
+            }
+            head = (head + 1) % max_pending;
+            pending--;
+        }
+        if (!running) continue;
+        int status;
+        pid_t pid = wait(&status);
+        if (pid == -1) {
+            internal_err("WAIT_FAILED", "Failed to wait for a job to finish");
+        }
+        for (size_t i = 0; i < pending; i++) {
+            job *j = &jobs[(head + i) % max_pending];
+            if (j->done || j->pid != pid) continue;
+            j->done = true;
+            j->ok = WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+            running--;
+            break;
+        }
+    }
+    mgr_free(jobs);
+    return ret;
+}
+
 int main(int argc, char *argv[]) {
     /* register atexit function to clean up any open files or memory allocations
      * left behind. */
@@ -336,11 +758,33 @@ int main(int argc, char *argv[]) {
 #endif /* SKIP_RESOURCE_MGR */
     int ret = EXIT_SUCCESS;
     run_cfg rc = parse_args(argc, argv);
+    /* read the profile once, to use it for every file */
+    loop_profile guide;
+    if (rc.profile_path != NULL) {
+        if (!load_profile(rc.profile_path, &guide)) return EXIT_FAILURE;
+        rc.guide = &guide;
+    }
+    /* programs run with -x share stdout, so run them one at a time */
+    if (rc.jobs > 1 && !rc.run) {
+        ret = compile_parallel(argc, argv, &rc) ? EXIT_SUCCESS : EXIT_FAILURE;
+        if (rc.guide != NULL) free_profile(&guide);
+        return ret;
+    }
+    /* share one compilation context between the files, so that the space
+     * allocated for one can be reused for the next */
+    bf_compile_ctx ctx;
+    bf_ctx_init(&ctx);
     for (int i = optind; i < argc; i++) {
-        if (compile_file(argv[i], &rc)) continue;
+        err_file(argv[i]);
+        bool ok = rc.run ? run_file(argv[i], &rc, &ctx) :
+                           compile_file(argv[i], &rc, &ctx);
+        err_file(NULL);
+        if (ok) continue;
         ret = EXIT_FAILURE;
         if (!rc.moveahead) break;
     }
+    bf_ctx_cleanup(&ctx);
+    if (rc.guide != NULL) free_profile(&guide);
 
     return ret;
 }
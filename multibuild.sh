@@ -17,6 +17,7 @@ skipped=0
 
 interface_files='backend_arm64.c backend_x86_64.c backend_s390x.c'
 misc_src_files='serialize.c compile.c err.c util.c optimize.c resource_mgr.c'
+misc_src_files="$misc_src_files jit.c cache.c profile.c libeambfc.c"
 src_files="$interface_files $misc_src_files main.c"
 unset interface_files misc_src_files
 
@@ -2,302 +2,1269 @@
  *
  * SPDX-License-Identifier: GPL-3.0-only
  *
- * Either provides a function that returns EAMBFC IR from an FD, or prints out a
- * step-by-step overview of the optimization process, depending on whether the
- * OPTIMIZE_STANDALONE macro is defined at compile time. */
+ * Provides a function that generates EAMBFC IR from brainfuck source code, and
+ * one that runs as much of it as possible ahead of time. */
 
 /* C99 */
-#include <stdio.h> /* sprintf, puts */
-#include <string.h> /* memmove, memset, strchr, strcpy, strlen, strstr */
+#include <stddef.h> /* NULL */
+#include <stdint.h> /* SIZE_MAX */
+#include <string.h> /* memcpy, memmove, memset */
 /* internal */
-#include "err.h" /* basic_err, instr_err */
-#include "resource_mgr.h" /* register_mgr, mgr_malloc */
-#include "types.h" /* bool, uint, {U,}INT64_MAX, [iu]{8,16,32,64}, sized_buf */
-#include "util.h" /* append_obj, read_to_sized_buf */
-
-/* filter out the non-bf characters from code->buf */
-static void filter_non_bf(sized_buf *code) {
-    sized_buf tmp = {.sz = 0, .capacity = 4096, .buf = mgr_malloc(4096)};
-    char instr;
-    for (size_t i = 0; i < code->sz; i++) {
-        switch (instr = ((char *)(code->buf))[i]) {
-        case '[':
-        case '-':
-        case '.':
-        case '<':
-        case '>':
-        case ',':
-        case '+':
-        case ']': append_obj(&tmp, &instr, 1); break;
+#include "err.h" /* position_err, internal_err */
+#include "optimize.h" /* ir_op, ir_instr */
+#include "resource_mgr.h" /* mgr_malloc, mgr_free */
+#include "types.h" /* bool, uint, INT*_MAX, [iu]{8,32,64}, size_t, sized_buf */
+#include "util.h" /* append_obj, reserve_obj, commit_obj */
+
+/* number of instructions stored in ir */
+#define IR_LEN(ir) ((ir)->sz / sizeof(ir_instr))
+
+/* the location of a `[` instruction in the source code, saved for reporting it
+ * if it turns out to be unmatched. */
+typedef struct src_loc {
+    uint line;
+    uint col;
+} src_loc;
+
+/* append an instruction with the given op, arg, and location to ir */
+static bool push_instr(sized_buf *ir, ir_op op, i64 arg, uint line, uint col) {
+    ir_instr instr = {
+        .op = op, .offset = 0, .arg = arg, .len = 0, .line = line, .col = col
+    };
+    return append_obj(ir, &instr, sizeof(ir_instr));
+}
+
+/* append an IR_MOVE or IR_ADD instruction to ir, merging it into the previous
+ * instruction if it has the same op, and dropping the result if they cancel
+ * each other out. */
+static bool push_merged(sized_buf *ir, ir_op op, i64 arg, uint line, uint col) {
+    if (ir->sz == 0) return push_instr(ir, op, arg, line, col);
+    ir_instr *prev = &((ir_instr *)ir->buf)[IR_LEN(ir) - 1];
+    if (prev->op != op) return push_instr(ir, op, arg, line, col);
+    if (op == IR_ADD) {
+        /* 256 `+` instructions in a row wrap back around to the start */
+        prev->arg = (prev->arg + arg) & 0xff;
+    } else if (prev->arg == ((arg > 0) ? INT64_MAX : -INT64_MAX)) {
+        position_err(
+            "TOO_MANY_INSTRUCTIONS",
+            "Over 8192 Pebibytes of net tape movement in a row.",
+            (arg > 0) ? '>' : '<',
+            line,
+            col
+        );
+        return false;
+    } else {
+        prev->arg += arg;
+    }
+    if (prev->arg == 0) ir->sz -= sizeof(ir_instr);
+    return true;
+}
+
+/* pad the constant data to an even size before appending a new entry to it, as
+ * s390x can only load the addresses of even offsets */
+static bool align_data(sized_buf *data) {
+    const u8 pad = 0;
+    return (data->sz % 2 == 0) || append_obj(data, &pad, 1);
+}
+
+/* Convert the src_sz bytes of brainfuck source code at src into unoptimized IR,
+ * merging consecutive `<` and `>` instructions, and consecutive `+` and `-`
+ * instructions, and leaving out loops that can be trivially determined never
+ * to run, because they are at the very beginning of the code, or right after
+ * another loop.
+ *
+ * Because the merging and removal are both done while appending each new
+ * instruction to ir, any sequence that only becomes dead once the code around
+ * it is removed, such as the second loop in `+[-]+-[-]`, is also removed. */
+static bool parse_code(
+    const char *src, size_t src_sz, sized_buf *ir, opt_stats *stats
+) {
+    /* locations of the currently-unmatched `[` instructions */
+    sized_buf opens = {.sz = 0, .capacity = 4096, .buf = mgr_malloc(4096)};
+    /* nesting level of the dead loop being skipped, or 0 if not in one */
+    size_t dead_level = 0;
+    uint line = 1;
+    uint col = 0;
+    bool ret = true;
+    for (size_t i = 0; ret && i < src_sz; i++) {
+        char c = src[i];
+        col++;
+        /* brackets need to be tracked even within dead loops, to make sure
+         * that the whole dead loop is skipped. */
+        if (c == '[') {
+            src_loc loc = {.line = line, .col = col};
+            if (!append_obj(&opens, &loc, sizeof(src_loc))) return false;
+            if (dead_level) continue;
+            if (ir->sz == 0 ||
+                ((ir_instr *)ir->buf)[IR_LEN(ir) - 1].op == IR_LOOP_CLOSE) {
+                dead_level = opens.sz / sizeof(src_loc);
+                stats->dead_loops++;
+                continue;
+            }
+            ret = push_instr(ir, IR_LOOP_OPEN, 0, line, col);
+            continue;
+        }
+        if (c == ']') {
+            if (opens.sz == 0) {
+                position_err(
+                    "UNMATCHED_CLOSE",
+                    "Could not optimize due to unmatched ']'",
+                    ']',
+                    line,
+                    col
+                );
+                ret = false;
+            } else if (dead_level == opens.sz / sizeof(src_loc)) {
+                dead_level = 0;
+            } else if (!dead_level) {
+                ret = push_instr(ir, IR_LOOP_CLOSE, 0, line, col);
+            }
+            opens.sz -= sizeof(src_loc);
+            continue;
+        }
+        if (dead_level) {
+            if (c == '\n') {
+                line++;
+                col = 0;
+            }
+            continue;
+        }
+        size_t prev_len = IR_LEN(ir);
+        switch (c) {
+        case '>': ret = push_merged(ir, IR_MOVE, 1, line, col); break;
+        case '<': ret = push_merged(ir, IR_MOVE, -1, line, col); break;
+        case '+': ret = push_merged(ir, IR_ADD, 1, line, col); break;
+        case '-': ret = push_merged(ir, IR_ADD, 0xff, line, col); break;
+        case '.': ret = push_instr(ir, IR_OUTPUT, 0, line, col); break;
+        case ',': ret = push_instr(ir, IR_INPUT, 0, line, col); break;
+        case '\n':
+            line++;
+            col = 0;
+            stats->comment_bytes++;
+            continue;
+        /* any other characters are comments */
+        default: stats->comment_bytes++; continue;
         }
+        if (c != '.' && c != ',' && IR_LEN(ir) <= prev_len) stats->merged++;
     }
-    instr = '\0';
-    /* null terminate it */
-    append_obj(&tmp, &instr, 1);
-    code->sz = tmp.sz;
-    code->capacity = tmp.capacity;
-    code->buf = tmp.buf;
+    if (ret && opens.sz) {
+        src_loc *loc = &((src_loc *)opens.buf)[opens.sz / sizeof(src_loc) - 1];
+        position_err(
+            "UNMATCHED_OPEN",
+            "Could not optimize due to unmatched '['",
+            '[',
+            loc->line,
+            loc->col
+        );
+        ret = false;
+    }
+    mgr_free(opens.buf);
+    return ret;
 }
 
-/* A function that skips past a matching ].
- * loop_start is a pointer to the [ at the start of the loop */
-static const char *find_loop_end(const char *loop_start) {
-    uint nest_level = 1;
-    const char *p = loop_start;
-    while (*(++p)) {
-        if (*p == '[') {
-            nest_level++;
-        } else if (*p == ']') {
-            if (--nest_level == 0) return p + 1;
+/* maximum number of cells other than the current one that a loop can modify
+ * and still be replaced with IR_MUL_ADD instructions. */
+#define MAX_MUL_TARGETS 16
+
+/* a cell modified by a multiply loop, and how much it's changed by each time */
+typedef struct mul_target {
+    i64 offset;
+    u8 delta;
+} mul_target;
+
+/* Check if the body_len instructions in body are the body of a multiply loop -
+ * that is, a loop consisting only of IR_MOVE and IR_ADD instructions, which
+ * ends on the same cell it started on, and changes the value of that cell by
+ * exactly 1 in either direction.
+ *
+ * If it is, store the changes made to the other cells in targets, store the
+ * number of such cells in *target_ct, and return true. If not, return false.
+ *
+ * Offsets are kept within the range of 32-bit signed integers, so that the
+ * backends don't need to account for larger offsets. */
+static bool parse_mul_loop(
+    const ir_instr *body,
+    size_t body_len,
+    mul_target targets[],
+    size_t *target_ct
+) {
+    i64 offset = 0;
+    u8 step = 0;
+    *target_ct = 0;
+    for (size_t i = 0; i < body_len; i++) {
+        i64 arg = body[i].arg;
+        if (body[i].op == IR_MOVE) {
+            if (arg > INT32_MAX || arg < -INT32_MAX) return false;
+            offset += arg;
+            if (offset > INT32_MAX || offset < INT32_MIN) return false;
+            continue;
+        }
+        /* anything else means it's not a multiply loop */
+        if (body[i].op != IR_ADD) return false;
+        /* at this point, it's known to be modifying a cell by arg */
+        if (offset == 0) {
+            step += arg;
+            continue;
+        }
+        size_t j;
+        for (j = 0; j < *target_ct; j++) {
+            if (targets[j].offset == offset) break;
+        }
+        if (j == *target_ct) {
+            if (*target_ct == MAX_MUL_TARGETS) return false;
+            targets[j].offset = offset;
+            targets[j].delta = 0;
+            (*target_ct)++;
+        }
+        targets[j].delta += arg;
+    }
+    if (offset != 0 || (step != 1 && step != 0xff)) return false;
+    /* if the current cell is incremented, the loop runs (256 - value) times
+     * rather than value times, which works out to negating each change. */
+    if (step == 1) {
+        for (size_t i = 0; i < *target_ct; i++) {
+            targets[i].delta = -targets[i].delta;
         }
     }
-    /* The above loop only terminates if an '[' was unmatched. */
-    instr_err("UNMATCHED_OPEN", "Could not optimize due to unmatched '['", '[');
-    return NULL;
+    return true;
 }
 
-/* return true if the loops are balanced, false otherwise */
-static bool loops_match(const char *code) {
-    const char *open_p = strchr(code, '[');
-    const char *close_p = strchr(code, ']');
-    /* if none are found, it's fine. */
-    if ((open_p == NULL) && (close_p == NULL)) return true;
-    /* if only one is found, that's a mismatch */
-    if ((open_p == NULL) && !(close_p == NULL)) {
-        instr_err(
-            "UNMATCHED_CLOSE", "Could not optimize due to unmatched ']'", ']'
-        );
-        return false;
+/* Replace scan loops, which consist of a single IR_MOVE within the range of
+ * 32-bit signed integers, with an IR_SCAN, and multiply loops (as described by
+ * parse_mul_loop) with an IR_MUL_ADD for each cell they modify, followed by
+ * IR_ZERO.
+ *
+ * As the replacements are never longer than the loops they replace, this is
+ * done in place, and as each loop is checked when its end is reached, any
+ * loop containing another loop has already had the inner loop replaced. */
+static bool replace_loops(sized_buf *ir, opt_stats *stats) {
+    ir_instr *instrs = ir->buf;
+    size_t len = IR_LEN(ir);
+    size_t out_i = 0;
+    /* indexes of the currently-open loops within the output */
+    sized_buf opens = {.sz = 0, .capacity = 4096, .buf = mgr_malloc(4096)};
+    mul_target targets[MAX_MUL_TARGETS];
+    size_t target_ct;
+    for (size_t i = 0; i < len; i++) {
+        ir_instr instr = instrs[i];
+        if (instr.op == IR_LOOP_OPEN) {
+            if (!append_obj(&opens, &out_i, sizeof(size_t))) return false;
+        } else if (instr.op == IR_LOOP_CLOSE) {
+            opens.sz -= sizeof(size_t);
+            size_t open_i = ((size_t *)opens.buf)[opens.sz / sizeof(size_t)];
+            ir_instr *body = &instrs[open_i + 1];
+            size_t body_len = out_i - (open_i + 1);
+            ir_instr loop_start = instrs[open_i];
+            if (body_len == 1 && body->op == IR_MOVE &&
+                body->arg <= INT32_MAX && body->arg >= -INT32_MAX) {
+                instrs[open_i].op = IR_SCAN;
+                instrs[open_i].arg = body->arg;
+                out_i = open_i + 1;
+                stats->scan_loops++;
+                continue;
+            }
+            if (parse_mul_loop(body, body_len, targets, &target_ct)) {
+                out_i = open_i;
+                for (size_t j = 0; j < target_ct; j++) {
+                    /* a cell that ends up unchanged doesn't need anything */
+                    if (targets[j].delta == 0) continue;
+                    loop_start.op = IR_MUL_ADD;
+                    loop_start.offset = targets[j].offset;
+                    loop_start.arg = targets[j].delta;
+                    instrs[out_i++] = loop_start;
+                }
+                if (out_i == open_i) {
+                    stats->zero_loops++;
+                } else {
+                    stats->mul_loops++;
+                }
+                loop_start.op = IR_ZERO;
+                loop_start.offset = 0;
+                loop_start.arg = 0;
+                instrs[out_i++] = loop_start;
+                continue;
+            }
+        }
+        instrs[out_i++] = instr;
     }
-    if ((close_p == NULL) && !(open_p == NULL)) {
-        instr_err(
-            "UNMATCHED_OPEN", "Could not optimize due to unmatched '['", '['
-        );
-        return false;
+    ir->sz = out_i * sizeof(ir_instr);
+    mgr_free(opens.buf);
+    return true;
+}
+
+/* Within each stretch of code without loops or I/O, keep track of how far the
+ * tape pointer has moved instead of moving it, and adjust the offsets of
+ * IR_ADD, IR_ZERO, and IR_SET instructions to make up for it. The tape pointer
+ * is only actually moved right before the next instruction that needs it to be
+ * in place, and not at all at the end of the program, as its final position is
+ * irrelevant. IR_OUTPUT_CONST instructions don't use the tape, so they don't
+ * need it to be in place either.
+ *
+ * Offsets are kept within the range of 32-bit signed integers. If that would
+ * not be possible, the pending movement is performed first, and the IR_MOVE
+ * that would have exceeded the range, or the instruction whose offset would
+ * have, is left as is.
+ *
+ * An IR_MOVE is only added when at least one other IR_MOVE was removed, so
+ * this is also done in place. */
+static void defer_moves(sized_buf *ir) {
+    ir_instr *instrs = ir->buf;
+    size_t len = IR_LEN(ir);
+    size_t out_i = 0;
+    i64 offset = 0;
+    for (size_t i = 0; i < len; i++) {
+        ir_instr instr = instrs[i];
+        switch (instr.op) {
+        case IR_MOVE:
+            if (instr.arg <= INT32_MAX && instr.arg >= -INT32_MAX &&
+                offset + instr.arg <= INT32_MAX &&
+                offset + instr.arg >= INT32_MIN) {
+                offset += instr.arg;
+                continue;
+            }
+            break;
+        case IR_ADD:
+        case IR_ZERO:
+        case IR_SET:
+            if (offset + instr.offset <= INT32_MAX &&
+                offset + instr.offset >= INT32_MIN) {
+                instr.offset += offset;
+                instrs[out_i++] = instr;
+                continue;
+            }
+            break;
+        case IR_OUTPUT_CONST: instrs[out_i++] = instr; continue;
+        default: break;
+        }
+        if (offset != 0) {
+            ir_instr move = instr;
+            move.op = IR_MOVE;
+            move.offset = 0;
+            move.arg = offset;
+            instrs[out_i++] = move;
+            offset = 0;
+        }
+        instrs[out_i++] = instr;
     }
+    ir->sz = out_i * sizeof(ir_instr);
+}
+
+/* number of cells that fold_known keeps track of, centered on where the tape
+ * pointer was when it last started over. Cells outside of that range are
+ * treated as unknown. */
+#define KNOWN_WINDOW 0x1000
+
+/* What fold_known knows about a cell. If gen is not the current generation,
+ * nothing's been recorded about the cell since the last time fold_known started
+ * over, and the rest is outdated. Otherwise, val is the cell's value, or -1 if
+ * that's unknown, and store is the index in the output of the instruction that
+ * stored that value, or SIZE_MAX if there isn't one. */
+typedef struct known_cell {
+    u32 gen;
+    i16 val;
+    size_t store;
+} known_cell;
 
-    /* ensure that it opens before it closes */
-    if (open_p > close_p) return false;
-    /* if this point is reached, both are found. Ensure they are balanced. */
-    return (find_loop_end(open_p) != NULL);
+/* What fold_known knows about the tape as a whole. */
+typedef struct known_tape {
+    known_cell *cells;
+    /* the current generation, which is increased to forget everything */
+    u32 gen;
+    /* whether cells with nothing recorded this generation are known to be 0 */
+    bool zeroed;
+    /* the index in cells of the cell the tape pointer is on */
+    i64 pos;
+} known_tape;
+
+/* Forget everything known about the tape, and start over from the current
+ * position of the tape pointer. */
+static void forget_all(known_tape *kt) {
+    if (++kt->gen == 0) {
+        /* it wrapped around, so old generations could be mistaken for it */
+        for (size_t i = 0; i < KNOWN_WINDOW; i++) kt->cells[i].gen = 0;
+        kt->gen = 1;
+    }
+    kt->zeroed = false;
+    kt->pos = KNOWN_WINDOW / 2;
 }
 
-#define REPSTR16(s) s s s s s s s s s s s s s s s s
-#define REPSTR64(s) REPSTR16(s) REPSTR16(s) REPSTR16(s) REPSTR16(s)
-#define REPSTR256(s) REPSTR64(s) REPSTR64(s) REPSTR64(s) REPSTR64(s)
-
-/* remove redundant instruction sequences like `<>` */
-static void strip_dead(sized_buf *ir) {
-    /* code constructs that do nothing - either 2 adjacent instructions that
-     * cancel each other out, or 256 consecutive `+` or `-` instructions that
-     * loop the current cell back to its current value */
-    char *str = ir->buf;
-    const char *simple_patterns[] = {
-        "<>",
-        "><",
-        "-+",
-        "+-",
-        REPSTR256("+"),
-        REPSTR256("-"),
-    };
-    /* don't want to compute these every loop, or even every run, so hard-code
-     * the known sizes of the simple patterns here. */
-    size_t simple_pattern_sizes[] = {2, 2, 2, 2, 256, 256};
-    bool matched = false;
-    char *match_start;
-    const char *loop_end;
+/* Return what's known about the cell offset cells away from the tape pointer,
+ * or NULL if it's outside of the range being tracked. */
+static known_cell *cell_at(known_tape *kt, i64 offset) {
+    i64 i = kt->pos + offset;
+    if (i < 0 || i >= KNOWN_WINDOW) return NULL;
+    known_cell *cell = &kt->cells[i];
+    if (cell->gen != kt->gen) {
+        cell->gen = kt->gen;
+        cell->val = kt->zeroed ? 0 : -1;
+        cell->store = SIZE_MAX;
+    }
+    return cell;
+}
+
+/* Return the index of the IR_LOOP_CLOSE that matches the IR_LOOP_OPEN at index
+ * open_i of instrs. */
+static size_t loop_end(const ir_instr *instrs, size_t open_i) {
+    size_t depth = 0;
+    size_t i = open_i;
     do {
-        matched = false;
-        /* if str opens with a loop, that loop won't run, so remove it */
-        if (*str == '[') {
-            matched = true;
-            loop_end = find_loop_end(str);
-            if (loop_end == NULL) {
-                mgr_free(ir->buf);
-                ir->buf = NULL;
-                return;
+        if (instrs[i].op == IR_LOOP_OPEN) depth++;
+        if (instrs[i].op == IR_LOOP_CLOSE) depth--;
+        i++;
+    } while (depth);
+    return i - 1;
+}
+
+/* Track the values of cells through the code, starting from the zeroed tape
+ * at the start of the program, and starting over at each loop or IR_SCAN.
+ * Within each stretch of code in between, cells set by IR_ZERO, IR_SET, or
+ * IR_INPUT, or modified by IR_ADD or IR_MUL_ADD are tracked, as is movement of
+ * the tape pointer. Using that:
+ *
+ * - loops and IR_SCAN instructions that start on a cell known to be zero are
+ *   removed, as they never do anything
+ * - IR_ADD and IR_MUL_ADD instructions that modify cells with known values
+ *   become IR_SET or IR_ZERO instructions, and IR_MUL_ADD instructions that
+ *   add a known value to an unknown one become IR_ADD instructions
+ * - IR_SET and IR_ZERO instructions that don't change a cell are removed, and
+ *   if nothing could have read the value stored by an earlier IR_SET or
+ *   IR_ZERO for the same cell, that one is changed to store the new value
+ *   instead, so that `[-]+++` becomes a single IR_SET
+ * - IR_OUTPUT instructions that write known values become IR_OUTPUT_CONST
+ *   instructions, with the bytes they write appended to data, and if nothing
+ *   that could read the tape or do any other I/O came since the last one, the
+ *   new byte is added onto it instead.
+ *
+ * Nothing is ever replaced with more than one instruction, so this is done in
+ * place. */
+static bool fold_known(sized_buf *ir, sized_buf *data) {
+    ir_instr *instrs = ir->buf;
+    size_t len = IR_LEN(ir);
+    size_t out_i = 0;
+    known_tape kt = {
+        .cells = mgr_malloc(KNOWN_WINDOW * sizeof(known_cell)),
+        .gen = 1,
+        .zeroed = true,
+        .pos = KNOWN_WINDOW / 2,
+    };
+    for (size_t i = 0; i < KNOWN_WINDOW; i++) kt.cells[i].gen = 0;
+    /* index in the output of the first instruction since the last one that
+     * could read the tape or do any I/O other than IR_OUTPUT_CONST */
+    size_t barrier = 0;
+    /* index in the output of the last IR_OUTPUT_CONST, or SIZE_MAX if there
+     * hasn't been one */
+    size_t last_out = SIZE_MAX;
+    for (size_t i = 0; i < len; i++) {
+        ir_instr instr = instrs[i];
+        known_cell *cell = cell_at(&kt, instr.offset);
+        known_cell *src;
+        switch (instr.op) {
+        case IR_MOVE:
+            if (instr.arg > INT32_MAX || instr.arg < -INT32_MAX ||
+                kt.pos + instr.arg > INT32_MAX ||
+                kt.pos + instr.arg < -INT32_MAX) {
+                forget_all(&kt);
+            } else {
+                kt.pos += instr.arg;
             }
-            memmove(str, loop_end, strlen(loop_end) + 1);
-        }
-        /* next, remove any matches for simple_patterns[*] */
-        for (u8 i = 0; i < 6 /* there are 6 patterns */; i++) {
-            while (((match_start = strstr(str, simple_patterns[i])) != NULL)) {
-                matched = true;
-                memmove(
-                    match_start,
-                    match_start + simple_pattern_sizes[i],
-                    strlen(match_start) - simple_pattern_sizes[i] + 1
-                );
+            break;
+        case IR_MUL_ADD:
+            src = cell_at(&kt, 0);
+            if (src == NULL || src->val < 0) {
+                /* the target cell's new value depends on an unknown one */
+                if (cell != NULL) {
+                    cell->val = -1;
+                    cell->store = SIZE_MAX;
+                }
+                instrs[out_i++] = instr;
+                barrier = out_i;
+                continue;
             }
-        }
-        /* finally, remove any loops that begin right after other loops end */
-        while (((match_start = strstr(str, "][")) != NULL)) {
-            matched = true;
-            /* skip past the closing `]` */
-            loop_end = find_loop_end(++match_start);
-            if (loop_end == NULL) {
-                mgr_free(ir->buf);
-                ir->buf = NULL;
-                return;
+            instr.op = IR_ADD;
+            instr.arg = (src->val * instr.arg) & 0xff;
+            if (instr.arg == 0) continue;
+            /* now it's an ordinary IR_ADD */
+            /* fall through */
+        case IR_ADD:
+            if (cell == NULL || cell->val < 0) break;
+            instr.arg = (cell->val + instr.arg) & 0xff;
+            instr.op = instr.arg ? IR_SET : IR_ZERO;
+            /* now it's an IR_SET or IR_ZERO */
+            /* fall through */
+        case IR_ZERO:
+        case IR_SET:
+            if (cell == NULL) break;
+            if (cell->val == instr.arg) continue;
+            cell->val = instr.arg;
+            if (cell->store != SIZE_MAX && cell->store >= barrier) {
+                instrs[cell->store].op = instr.op;
+                instrs[cell->store].arg = instr.arg;
+                continue;
+            }
+            cell->store = out_i;
+            break;
+        case IR_SCAN:
+        case IR_LOOP_OPEN:
+            if (cell != NULL && cell->val == 0) {
+                if (instr.op == IR_LOOP_OPEN) i = loop_end(instrs, i);
+                continue;
+            }
+            instrs[out_i++] = instr;
+            barrier = out_i;
+            forget_all(&kt);
+            /* a scan always ends on a zero cell */
+            if (instr.op == IR_SCAN) cell_at(&kt, 0)->val = 0;
+            continue;
+        case IR_LOOP_CLOSE:
+            instrs[out_i++] = instr;
+            barrier = out_i;
+            forget_all(&kt);
+            /* loops only end once the current cell is zero */
+            cell_at(&kt, 0)->val = 0;
+            continue;
+        case IR_OUTPUT:
+            if (cell == NULL || cell->val < 0) {
+                instrs[out_i++] = instr;
+                barrier = out_i;
+                continue;
+            }
+            u8 byte = cell->val;
+            bool extend = last_out != SIZE_MAX && last_out >= barrier &&
+                          instrs[last_out].len < UINT32_MAX;
+            if (!(extend || align_data(data)) || !append_obj(data, &byte, 1)) {
+                mgr_free(kt.cells);
+                return false;
+            }
+            if (extend) {
+                instrs[last_out].len++;
+                continue;
             }
-            memmove(match_start, loop_end, strlen(loop_end) + 1);
+            instr.op = IR_OUTPUT_CONST;
+            instr.arg = data->sz - 1;
+            instr.offset = 0;
+            instr.len = 1;
+            last_out = out_i;
+            break;
+        case IR_OUTPUT_CONST:
+            /* this is from an earlier run, so its bytes aren't at the end of
+             * data, and can't be added onto */
+            last_out = SIZE_MAX;
+            break;
+        case IR_INPUT:
+            /* at the end of input, the cell is left as is, so it's read too */
+            if (cell != NULL) {
+                cell->val = -1;
+                cell->store = SIZE_MAX;
+            }
+            instrs[out_i++] = instr;
+            barrier = out_i;
+            continue;
+        default: break;
         }
-    } while (matched);
-    ir->sz = strlen(str) + 1;
+        instrs[out_i++] = instr;
+    }
+    ir->sz = out_i * sizeof(ir_instr);
+    mgr_free(kt.cells);
+    return true;
 }
 
-/* condense a sequence of identical instructions into an IR operation. */
-static size_t condense(char instr, u64 consec_ct, char *dest) {
-    char opcode;
-#if SIZE_MAX < UINT64_MAX
-    if (consec_ct > SIZE_MAX) {
-        instr_err(
-            "TOO_MANY_INSTRUCTIONS",
-            "More than SIZE_MAX consecutive identical instructions. Somehow.",
-            instr
-        );
-        return 0;
+/* the most instructions that unroll_loops replaces a single loop with */
+#define UNROLL_MAX 256
+/* the most times that to_ir runs unroll_loops */
+#define UNROLL_ROUNDS 4
+
+/* Check if the body_len instructions in body, which contain no loops or IR_SCAN
+ * instructions, are the body of a loop that runs a fixed number of times once
+ * the value of the cell it starts on is known - that is, one which ends on the
+ * same cell it started on, and only changes that cell with IR_ADD instructions,
+ * though it can read it. If it is, return the total that it adds to that cell
+ * each time through, which is 0 if it never stops. If not, return 0. */
+static u8 counter_step(const ir_instr *body, size_t body_len) {
+    i64 pos = 0;
+    u8 step = 0;
+    for (size_t i = 0; i < body_len; i++) {
+        if (body[i].op == IR_MOVE) {
+            if (body[i].arg > INT32_MAX || body[i].arg < -INT32_MAX) return 0;
+            pos += body[i].arg;
+            if (pos > INT32_MAX || pos < INT32_MIN) return 0;
+            continue;
+        }
+        /* only instructions that change the loop's counter matter */
+        if (pos + body[i].offset != 0) continue;
+        switch (body[i].op) {
+        case IR_ADD: step += body[i].arg; break;
+        case IR_ZERO:
+        case IR_SET:
+        case IR_MUL_ADD:
+        case IR_INPUT: return 0;
+        default: break;
+        }
     }
-#endif /* SIZE_MAX < UINT64_MAX */
-    if (consec_ct == 1) {
-        *dest = instr;
-        return 1;
-    } else {
-        switch (instr) {
-        case '.':
-        case ',':
-        case ']':
-        case '[': memset(dest, instr, consec_ct); return (size_t)consec_ct;
-        case '>':
-            if (consec_ct <= INT64_MAX) {
-                opcode = '}';
+    return pos == 0 ? step : 0;
+}
+
+/* Return the number of times a loop runs if it starts on a cell with the value
+ * val, and adds step to it each time through, or 0 if it never stops. */
+static size_t trip_count(u8 val, u8 step) {
+    for (size_t n = 1; n <= 256; n++) {
+        val += step;
+        if (val == 0) return n;
+    }
+    return 0;
+}
+
+/* an IR_LOOP_OPEN in the output of unroll_loops, and what's known about it */
+typedef struct open_loop {
+    size_t index;
+    /* the value of the cell it starts on, or -1 if that's unknown */
+    i16 val;
+    /* whether it contains any other loops or IR_SCAN instructions */
+    bool inner;
+} open_loop;
+
+/* Replace loops that contain no other loops or IR_SCAN instructions, and start
+ * on a cell with a value known ahead of time, which they change by the same
+ * amount each time through, as described by counter_step, with a copy of their
+ * body for each time they'd run, if that's no more than UNROLL_MAX
+ * instructions in total. That way, the body can be folded into constants by
+ * running fold_known again, and either way, there are no jumps left.
+ *
+ * The values of cells are tracked the same way that fold_known tracks them.
+ *
+ * On failure, frees ir->buf and returns false. */
+static bool unroll_loops(sized_buf *ir, opt_stats *stats) {
+    const ir_instr *instrs = ir->buf;
+    size_t len = IR_LEN(ir);
+    sized_buf out = {.sz = 0, .capacity = 4096, .buf = mgr_malloc(4096)};
+    sized_buf opens = {.sz = 0, .capacity = 4096, .buf = mgr_malloc(4096)};
+    known_tape kt = {
+        .cells = mgr_malloc(KNOWN_WINDOW * sizeof(known_cell)),
+        .gen = 1,
+        .zeroed = true,
+        .pos = KNOWN_WINDOW / 2,
+    };
+    for (size_t i = 0; i < KNOWN_WINDOW; i++) kt.cells[i].gen = 0;
+    bool ret = true;
+    for (size_t i = 0; ret && i < len; i++) {
+        ir_instr instr = instrs[i];
+        known_cell *cell = cell_at(&kt, instr.offset);
+        /* the innermost loop that this instruction is in, if any */
+        open_loop *loops = opens.buf;
+        size_t depth = opens.sz / sizeof(open_loop);
+        open_loop *parent = depth ? &loops[depth - 1] : NULL;
+        switch (instr.op) {
+        case IR_MOVE:
+            if (instr.arg > INT32_MAX || instr.arg < -INT32_MAX ||
+                kt.pos + instr.arg > INT32_MAX ||
+                kt.pos + instr.arg < -INT32_MAX) {
+                forget_all(&kt);
             } else {
-                instr_err(
-                    "TOO_MANY_INSTRUCTIONS",
-                    "Over 8192 Pebibytes of '>' in a row.",
-                    '>'
-                );
-                return 0;
+                kt.pos += instr.arg;
             }
             break;
-        case '<':
-            if (consec_ct <= INT64_MAX) {
-                opcode = '{';
-            } else {
-                instr_err(
-                    "TOO_MANY_INSTRUCTIONS",
-                    "Over 8192 Pebibytes of '<' in a row.",
-                    '<'
-                );
-                return 0;
+        case IR_ADD:
+            if (cell != NULL && cell->val >= 0) {
+                cell->val = (cell->val + instr.arg) & 0xff;
             }
             break;
-        /* for + and -, assume that consec_ct is less than 256, as a larger
-         * value would have been optimized down. */
-        case '+': opcode = '#'; break;
-        case '-': opcode = '='; break;
-        default: return 0; break;
+        case IR_ZERO:
+        case IR_SET:
+            if (cell != NULL) cell->val = instr.arg;
+            break;
+        case IR_MUL_ADD:
+        case IR_INPUT:
+            if (cell != NULL) cell->val = -1;
+            break;
+        case IR_SCAN:
+            if (parent != NULL) parent->inner = true;
+            forget_all(&kt);
+            cell_at(&kt, 0)->val = 0;
+            break;
+        case IR_LOOP_OPEN: {
+            if (parent != NULL) parent->inner = true;
+            open_loop loop = {
+                .index = IR_LEN(&out),
+                .val = (cell != NULL) ? cell->val : -1,
+                .inner = false,
+            };
+            ret = append_obj(&opens, &loop, sizeof(open_loop));
+            forget_all(&kt);
+            break;
+        }
+        case IR_LOOP_CLOSE: {
+            if (parent == NULL) {
+                internal_err(
+                    "UNBALANCED_IR", "IR_LOOP_CLOSE without a matching open"
+                );
+                /* internal_err never returns, as it calls exit(EXIT_FAILURE) */
+                ret = false;
+                break;
+            }
+            open_loop loop = *parent;
+            opens.sz -= sizeof(open_loop);
+            forget_all(&kt);
+            cell_at(&kt, 0)->val = 0;
+            size_t body_len = IR_LEN(&out) - (loop.index + 1);
+            if (loop.inner || loop.val <= 0) break;
+            ir_instr *body = &((ir_instr *)out.buf)[loop.index + 1];
+            size_t trips = trip_count(loop.val, counter_step(body, body_len));
+            if (trips == 0 || body_len * trips > UNROLL_MAX) break;
+            /* remove the IR_LOOP_OPEN, then add the other copies of the body */
+            memmove(body - 1, body, body_len * sizeof(ir_instr));
+            out.sz -= sizeof(ir_instr);
+            size_t copies_sz = body_len * (trips - 1) * sizeof(ir_instr);
+            ir_instr *copies = reserve_obj(&out, copies_sz);
+            if (copies == NULL) {
+                ret = false;
+                break;
+            }
+            body = &((ir_instr *)out.buf)[loop.index];
+            for (size_t j = 0; j < trips - 1; j++) {
+                memcpy(
+                    &copies[j * body_len], body, body_len * sizeof(ir_instr)
+                );
+            }
+            commit_obj(&out, copies_sz);
+            stats->unrolled_loops++;
+            continue;
         }
+        default: break;
+        }
+        if (ret) ret = append_obj(&out, &instr, sizeof(ir_instr));
+    }
+    mgr_free(kt.cells);
+    if (opens.buf != NULL) mgr_free(opens.buf);
+    mgr_free(ir->buf);
+    if (!ret) {
+        if (out.buf != NULL) mgr_free(out.buf);
+        ir->buf = NULL;
+        return false;
     }
-    return (size_t)sprintf(dest, "%c%" PRIx64, opcode, consec_ct);
+    *ir = out;
+    return true;
 }
 
-/* Substitute instructions
- *
- * SUBSTITUTIONS:
+/* What drop_dead_stores knows about a cell. If gen is not the current
+ * generation, nothing's been recorded about the cell since the last time
+ * drop_dead_stores started over, and the rest is outdated. Otherwise, dead is
+ * whether the cell is overwritten before anything could read it. */
+typedef struct live_cell {
+    u32 gen;
+    bool dead;
+} live_cell;
+
+/* What drop_dead_stores knows about the tape as a whole. */
+typedef struct live_tape {
+    live_cell *cells;
+    /* the current generation, which is increased to forget everything */
+    u32 gen;
+    /* whether cells with nothing recorded this generation are dead */
+    bool all_dead;
+    /* the index in cells of the cell the tape pointer is on */
+    i64 pos;
+} live_tape;
+
+/* Forget everything known about which cells are dead, and start over from the
+ * current position of the tape pointer. */
+static void forget_live(live_tape *lt) {
+    if (++lt->gen == 0) {
+        /* it wrapped around, so old generations could be mistaken for it */
+        for (size_t i = 0; i < KNOWN_WINDOW; i++) lt->cells[i].gen = 0;
+        lt->gen = 1;
+    }
+    lt->all_dead = false;
+    lt->pos = KNOWN_WINDOW / 2;
+}
+
+/* Return what's known about the cell offset cells away from the tape pointer,
+ * or NULL if it's outside of the range being tracked. */
+static live_cell *live_at(live_tape *lt, i64 offset) {
+    i64 i = lt->pos + offset;
+    if (i < 0 || i >= KNOWN_WINDOW) return NULL;
+    live_cell *cell = &lt->cells[i];
+    if (cell->gen != lt->gen) {
+        cell->gen = lt->gen;
+        cell->dead = lt->all_dead;
+    }
+    return cell;
+}
+
+/* Remove IR_ZERO, IR_SET, IR_ADD, and IR_MUL_ADD instructions that change
+ * cells which are overwritten before anything could read them. This works
+ * backwards through each stretch of code without loops or IR_SCAN instructions,
+ * including the bodies of innermost loops, tracking the movement of the tape
+ * pointer so that the same cell is recognized at different offsets. Nothing
+ * reads the tape once the program ends, so every cell is treated as overwritten
+ * at the end of the program, and IR_MOVE instructions after the last
+ * instruction that uses the tape pointer are removed too.
  *
- * N consecutive `>` instructions are replaced with `}N`.
- * N consecutive `<` instructions are replaced with `{N`.
- * N consecutive `+` instructions are replaced with `#N`.
- * N consecutive `-` instructions are replaced with `=N`.
+ * fold_known already merged stores for the same cell that nothing read in
+ * between, but only within the stretch since the last instruction that could
+ * read any cell, and it leaves IR_ADD and IR_MUL_ADD instructions that modify
+ * cells with unknown values alone.
  *
- * single `+`, `-`, `<`, and `>` instructions are left as is.
+ * Returns the number of instructions removed, other than IR_MOVE instructions.
+ * Instructions are only ever removed, so this is done in place. */
+static size_t drop_dead_stores(sized_buf *ir) {
+    ir_instr *instrs = ir->buf;
+    size_t len = IR_LEN(ir);
+    size_t out_i = len;
+    live_tape lt = {
+        .cells = mgr_malloc(KNOWN_WINDOW * sizeof(live_cell)),
+        .gen = 1,
+        .all_dead = true,
+        .pos = KNOWN_WINDOW / 2,
+    };
+    for (size_t i = 0; i < KNOWN_WINDOW; i++) lt.cells[i].gen = 0;
+    /* set until an instruction that uses the tape pointer is found */
+    bool at_end = true;
+    size_t dead_moves = 0;
+    for (size_t i = len; i-- > 0;) {
+        ir_instr instr = instrs[i];
+        live_cell *cell = live_at(&lt, instr.offset);
+        live_cell *src;
+        if (instr.op != IR_MOVE && instr.op != IR_OUTPUT_CONST) at_end = false;
+        switch (instr.op) {
+        case IR_MOVE:
+            /* where the tape pointer ends up doesn't matter */
+            if (at_end) {
+                dead_moves++;
+                continue;
+            }
+            if (instr.arg > INT32_MAX || instr.arg < -INT32_MAX ||
+                lt.pos - instr.arg > INT32_MAX ||
+                lt.pos - instr.arg < -INT32_MAX) {
+                forget_live(&lt);
+            } else {
+                lt.pos -= instr.arg;
+            }
+            break;
+        case IR_ZERO:
+        case IR_SET:
+            if (cell == NULL) break;
+            if (cell->dead) continue;
+            cell->dead = true;
+            break;
+        case IR_ADD:
+        case IR_MUL_ADD:
+            /* they only read the cell they change in order to change it */
+            if (cell != NULL && cell->dead) continue;
+            src = live_at(&lt, 0);
+            if (instr.op == IR_MUL_ADD && src != NULL) src->dead = false;
+            break;
+        case IR_OUTPUT:
+        case IR_INPUT:
+            /* at the end of input, the cell is left as is, so it's read too */
+            if (cell != NULL) cell->dead = false;
+            break;
+        case IR_OUTPUT_CONST: break;
+        default:
+            /* loops and scans can read any cell */
+            forget_live(&lt);
+            break;
+        }
+        instrs[--out_i] = instr;
+    }
+    memmove(instrs, &instrs[out_i], (len - out_i) * sizeof(ir_instr));
+    ir->sz = (len - out_i) * sizeof(ir_instr);
+    mgr_free(lt.cells);
+    return out_i - dead_moves;
+}
+
+/* the fewest cells in a row that are worth setting with an IR_ZERO_RANGE or
+ * IR_SET_RANGE instead of separate IR_ZERO and IR_SET instructions. Setting
+ * cells to constant data has to find the data first, so it takes more. */
+#define ZERO_RANGE_MIN 2
+#define SET_RANGE_MIN 4
+
+/* return whether instr stores a constant value in a cell */
+static bool is_store(const ir_instr *instr) {
+    return instr->op == IR_ZERO || instr->op == IR_SET;
+}
+
+/* Merge runs of IR_ZERO and IR_SET instructions for cells next to each other,
+ * one after another in the same direction, into an IR_ZERO_RANGE if they're
+ * all IR_ZERO, or an IR_SET_RANGE, with the values to set them to appended to
+ * data, if not. Runs are split up into ranges of at most IR_RANGE_MAX cells,
+ * and ranges shorter than SET_RANGE_MIN are left alone, other than any run of
+ * at least ZERO_RANGE_MIN IR_ZERO instructions they start with.
  *
- * `[+]` and `[-]` both get replaced with `@`.
+ * fold_known already merged any stores to the same cell that nothing read in
+ * between, and the instructions in a run are next to each other, so nothing
+ * can read any of the cells in between them.
  *
- * all `,` and `.` instructions are left unchanged, as are any `[` or `]`
- * instructions not part of the two sequences that are replaced with `@`. */
-static void instr_merge(sized_buf *ir) {
-    char *str = ir->buf;
-    char prev_mode = *str;
-    char *new_str = mgr_malloc(ir->sz);
-    if (new_str == NULL) {
-        alloc_err();
-        return;
-    }
-    char *p = new_str;
-    u64 consec_ct = 1;
-    size_t i;
-    size_t skip;
-    /* condese consecutive identical instructions */
-    for (i = 1; i < ir->sz; i++) {
-        char current_mode = *(str + i);
-        if (current_mode != prev_mode) {
-            if (!((skip = condense(prev_mode, consec_ct, p)))) {
-                mgr_free(new_str);
-                instr_err(
-                    "INTERNAL_ERROR",
-                    "Failed to condense consecutive instructions",
-                    prev_mode
-                );
-                return;
+ * Instructions are only ever merged together, so this is done in place. */
+static bool merge_ranges(sized_buf *ir, sized_buf *data) {
+    ir_instr *instrs = ir->buf;
+    size_t len = IR_LEN(ir);
+    size_t out_i = 0;
+    size_t i = 0;
+    while (i < len) {
+        /* find the end of the run starting at i, and how many IR_ZERO
+         * instructions it starts with */
+        size_t end = i + 1;
+        size_t zeros = (instrs[i].op == IR_ZERO) ? 1 : 0;
+        i64 step = 0;
+        while (is_store(&instrs[i]) && end < len && is_store(&instrs[end]) &&
+               end - i < IR_RANGE_MAX) {
+            i64 diff = (i64)instrs[end].offset - instrs[end - 1].offset;
+            if ((diff != 1 && diff != -1) || (step != 0 && diff != step)) {
+                break;
             }
-            p += skip;
-            consec_ct = 1;
-            prev_mode = current_mode;
+            step = diff;
+            if (zeros == end - i && instrs[end].op == IR_ZERO) zeros++;
+            end++;
+        }
+        /* if it's too short to set to constant data, the zeros at the start
+         * could still be worth merging */
+        bool zero = zeros == end - i || end - i < SET_RANGE_MIN;
+        if (zero) end = i + zeros;
+        if (zero && zeros < ZERO_RANGE_MIN) {
+            instrs[out_i++] = instrs[i++];
+            continue;
+        }
+        size_t run = end - i;
+        ir_instr range = instrs[i];
+        range.offset = (step < 0) ? instrs[end - 1].offset : instrs[i].offset;
+        range.len = run;
+        if (zero) {
+            range.op = IR_ZERO_RANGE;
+            range.arg = 0;
         } else {
-            if (consec_ct == UINT64_MAX) {
-                instr_err(
-                    "TOO_MANY_INSTRUCTIONS",
-                    "More than 16384 PiB of identical instructions in a row.",
-                    prev_mode
-                );
-                return;
-            } else {
-                consec_ct++;
+            range.op = IR_SET_RANGE;
+            if (!align_data(data)) return false;
+            range.arg = data->sz;
+            u8 *bytes = reserve_obj(data, run);
+            if (bytes == NULL) return false;
+            for (size_t j = i; j < end; j++) {
+                bytes[instrs[j].offset - range.offset] = instrs[j].arg;
             }
+            commit_obj(data, run);
         }
+        instrs[out_i++] = range;
+        i = end;
     }
-    *p = '\0'; /* NULL terminate the new string */
+    ir->sz = out_i * sizeof(ir_instr);
+    return true;
+}
 
-    /* handle [-] */
-    while ((p = strstr(new_str, "[-]"))) {
-        *p = '@';
-        memmove(p + 1, p + 3, strlen(p + 3) + 1);
+bool to_ir(
+    const char *src,
+    size_t src_sz,
+    sized_buf *ir,
+    sized_buf *data,
+    opt_stats *stats
+) {
+    /* the passes always count what they do, even if it's not needed */
+    opt_stats unused;
+    if (stats == NULL) stats = &unused;
+    *stats = (opt_stats){0};
+    ir->sz = 0;
+    ir->capacity = 4096;
+    ir->buf = mgr_malloc(4096);
+    data->sz = 0;
+    data->capacity = 4096;
+    data->buf = mgr_malloc(4096);
+    if (!parse_code(src, src_sz, ir, stats) || !replace_loops(ir, stats)) {
+        /* if append_obj failed, it already freed the buffer */
+        if (ir->buf != NULL) mgr_free(ir->buf);
+        ir->buf = NULL;
+        mgr_free(data->buf);
+        data->buf = NULL;
+        return false;
+    }
+    defer_moves(ir);
+    bool ret = fold_known(ir, data);
+    /* fold the bodies of unrolled loops, which can make the values of cells
+     * that later loops start on known, so that they can be unrolled too */
+    for (int round = 0; ret && round < UNROLL_ROUNDS; round++) {
+        size_t unrolled = stats->unrolled_loops;
+        if (!unroll_loops(ir, stats)) {
+            ret = false;
+        } else if (stats->unrolled_loops != unrolled) {
+            defer_moves(ir);
+            ret = fold_known(ir, data);
+        } else {
+            break;
+        }
+    }
+    if (ret) {
+        stats->dead_stores = drop_dead_stores(ir);
+        /* folding and dropping instructions can leave IR_MOVE instructions
+         * next to each other, so merge them again */
+        defer_moves(ir);
+        ret = merge_ranges(ir, data);
     }
-    /* handle [+] */
-    while ((p = strstr(new_str, "[+]"))) {
-        *p = '@';
-        memmove(p + 1, p + 3, strlen(p + 3) + 1);
+    if (ret) {
+        stats->ir_instrs = IR_LEN(ir);
+        stats->data_bytes = data->sz;
+        return true;
     }
-    strcpy(str, new_str);
-    ir->sz = strlen(str);
-    mgr_free(new_str);
+    if (ir->buf != NULL) mgr_free(ir->buf);
+    ir->buf = NULL;
+    if (data->buf != NULL) mgr_free(data->buf);
+    data->buf = NULL;
+    return false;
 }
 
-/* Reads the content of the file fd, and returns a string containing optimized
- * internal intermediate representation of that file's code.
- * fd must be open for reading already, no check is performed.
- * Calling function is responsible for `mgr_free`ing the returned string. */
-bool to_ir(sized_buf *src) {
-    filter_non_bf(src);
-    if (src->buf == NULL) {
-        mgr_free(src->buf);
-        src->buf = NULL;
-        return false;
+/* the most IR instructions (counting each step of an IR_SCAN) that partial_eval
+ * runs before giving up on running the rest of the program ahead of time */
+#define EVAL_STEPS 0x1000000
+
+/* the most output that partial_eval collects before giving up */
+#define EVAL_MAX_OUTPUT 0x1000000
+
+/* The state of a program being run by partial_eval. */
+typedef struct eval_state {
+    /* the cells that have been used so far, all others are still zero */
+    sized_buf *tape;
+    /* the size of the tape that the program will run with */
+    size_t tape_sz;
+    /* the index of the cell the tape pointer is on */
+    size_t pos;
+    /* the output written so far */
+    sized_buf out;
+    /* the constant data used by IR_OUTPUT_CONST */
+    const sized_buf *data;
+    /* the number of steps run so far */
+    u32 steps;
+} eval_state;
+
+/* Return the cell offset cells away from the tape pointer, extending the part
+ * of the tape in use to include it if needed, or NULL if it's outside of the
+ * tape, or the tape could not be extended. */
+static u8 *eval_cell(eval_state *st, i64 offset) {
+    if ((offset < 0 && (size_t)-offset > st->pos) ||
+        (offset > 0 && (size_t)offset >= st->tape_sz - st->pos)) {
+        return NULL;
     }
-    if (!loops_match(src->buf)) {
-        mgr_free(src->buf);
-        src->buf = NULL;
-        return false;
+    size_t i = st->pos + offset;
+    sized_buf *tape = st->tape;
+    if (i >= tape->sz) {
+        u8 *ext = reserve_obj(tape, i + 1 - tape->sz);
+        if (ext == NULL) return NULL;
+        memset(ext, 0, i + 1 - tape->sz);
+        commit_obj(tape, i + 1 - tape->sz);
     }
-    strip_dead(src);
-    if (src->buf == NULL) {
-        mgr_free(src->buf);
-        src->buf = NULL;
-        return false;
+    return &((u8 *)tape->buf)[i];
+}
+
+/* Run the instruction at index *pc of instrs, updating *pc to point to the
+ * next one to run, where loop_match maps each IR_LOOP_OPEN to its
+ * IR_LOOP_CLOSE, and vice versa. Returns false without changing anything if it
+ * can't be run ahead of time - because it reads input, goes outside of the
+ * tape, or writes too much output - or if st->tape or st->out could not be
+ * extended. */
+static bool eval_instr(
+    eval_state *st, const ir_instr *instrs, const size_t *loop_match, size_t *pc
+) {
+    const ir_instr *instr = &instrs[*pc];
+    u8 *cell = eval_cell(st, instr->offset);
+    if (cell == NULL) return false;
+    switch (instr->op) {
+    case IR_MOVE:
+        if (eval_cell(st, instr->arg) == NULL) return false;
+        st->pos += instr->arg;
+        break;
+    case IR_ADD: *cell += instr->arg; break;
+    case IR_ZERO:
+    case IR_SET: *cell = instr->arg; break;
+    case IR_ZERO_RANGE:
+    case IR_SET_RANGE:
+        /* extending the tape to the end of the range can move the start */
+        if (eval_cell(st, (i64)instr->offset + instr->len - 1) == NULL) {
+            return false;
+        }
+        cell = eval_cell(st, instr->offset);
+        if (cell == NULL) return false;
+        if (instr->op == IR_ZERO_RANGE) {
+            memset(cell, 0, instr->len);
+        } else {
+            memcpy(cell, (const u8 *)st->data->buf + instr->arg, instr->len);
+        }
+        break;
+    case IR_MUL_ADD: {
+        /* cell is the target, and the current cell is the source */
+        const u8 *src = eval_cell(st, 0);
+        if (src == NULL) return false;
+        *cell += *src * instr->arg;
+        break;
+    }
+    case IR_SCAN: {
+        size_t start = st->pos;
+        const u8 *cur;
+        while ((cur = eval_cell(st, 0)) == NULL || *cur != 0) {
+            if (cur == NULL || eval_cell(st, instr->arg) == NULL ||
+                ++st->steps > EVAL_STEPS) {
+                st->pos = start;
+                return false;
+            }
+            st->pos += instr->arg;
+        }
+        break;
+    }
+    case IR_LOOP_OPEN:
+        if (*cell == 0) *pc = loop_match[*pc];
+        break;
+    case IR_LOOP_CLOSE:
+        if (*cell != 0) *pc = loop_match[*pc];
+        break;
+    case IR_OUTPUT:
+        if (st->out.sz >= EVAL_MAX_OUTPUT) return false;
+        if (!append_obj(&st->out, cell, 1)) return false;
+        break;
+    case IR_OUTPUT_CONST:
+        if (st->out.sz + instr->len > EVAL_MAX_OUTPUT) return false;
+        if (!append_obj(
+                &st->out, (const u8 *)st->data->buf + instr->arg, instr->len
+            )) {
+            return false;
+        }
+        break;
+    /* the input isn't available until the program runs */
+    case IR_INPUT:
+    default: return false;
     }
-    instr_merge(src);
-    src->sz = strlen(src->buf) + 1;
+    (*pc)++;
     return true;
 }
+
+/* Build the IR for the rest of the program after partial_eval stopped at index
+ * pc of the len instructions in instrs, inside of the loops starting at the
+ * depth indexes in open_stack, outermost first. Running the rest of the
+ * innermost loop's body then hitting its IR_LOOP_CLOSE does the same thing as
+ * running the rest of the body then the whole loop again from its start, and
+ * the same goes for each loop around it after that, so that's what's appended
+ * to res. */
+static bool eval_residue(
+    sized_buf *res,
+    const ir_instr *instrs,
+    size_t len,
+    size_t pc,
+    const size_t *loop_match,
+    const size_t *open_stack,
+    size_t depth
+) {
+    size_t from = pc;
+    while (depth--) {
+        size_t open_i = open_stack[depth];
+        size_t close_i = loop_match[open_i];
+        if (!append_obj(
+                res, &instrs[from], (close_i - from) * sizeof(ir_instr)
+            ) ||
+            !append_obj(
+                res,
+                &instrs[open_i],
+                (close_i + 1 - open_i) * sizeof(ir_instr)
+            )) {
+            return false;
+        }
+        from = close_i + 1;
+    }
+    return append_obj(res, &instrs[from], (len - from) * sizeof(ir_instr));
+}
+
+bool partial_eval(
+    sized_buf *ir, sized_buf *data, sized_buf *tape, size_t tape_sz
+) {
+    const ir_instr *instrs = ir->buf;
+    size_t len = IR_LEN(ir);
+    tape->sz = 0;
+    if (len == 0) return true;
+    /* match up each loop's start and end, using loop_match for both */
+    size_t *loop_match = mgr_malloc(len * sizeof(size_t));
+    size_t *open_stack = mgr_malloc(len * sizeof(size_t));
+    size_t depth = 0;
+    bool matched = true;
+    for (size_t i = 0; matched && i < len; i++) {
+        if (instrs[i].op == IR_LOOP_OPEN) {
+            open_stack[depth++] = i;
+        } else if (instrs[i].op == IR_LOOP_CLOSE && depth == 0) {
+            matched = false;
+        } else if (instrs[i].op == IR_LOOP_CLOSE) {
+            loop_match[i] = open_stack[--depth];
+            loop_match[open_stack[depth]] = i;
+        }
+    }
+    /* unmatched loops are reported once the code is compiled, so leave it be */
+    if (!matched || depth != 0) {
+        mgr_free(loop_match);
+        mgr_free(open_stack);
+        return true;
+    }
+
+    eval_state st = {
+        .tape = tape,
+        .tape_sz = tape_sz,
+        .pos = 0,
+        .out = {.sz = 0, .capacity = 4096, .buf = mgr_malloc(4096)},
+        .data = data,
+        .steps = 0,
+    };
+    size_t pc = 0;
+    while (pc < len && ++st.steps <= EVAL_STEPS &&
+           eval_instr(&st, instrs, loop_match, &pc)) {}
+
+    bool ret = (tape->buf != NULL && st.out.buf != NULL);
+    if (pc == len) {
+        /* it ran to completion, so the tape doesn't matter anymore */
+        tape->sz = 0;
+    } else if (ret) {
+        /* the cells past the last nonzero one don't need to be stored */
+        while (tape->sz && ((u8 *)tape->buf)[tape->sz - 1] == 0) tape->sz--;
+    }
+    /* find the loops that it stopped inside of */
+    depth = 0;
+    for (size_t i = 0; i < pc; i++) {
+        if (instrs[i].op == IR_LOOP_OPEN) open_stack[depth++] = i;
+        if (instrs[i].op == IR_LOOP_CLOSE) depth--;
+    }
+    /* nothing to do if it stopped before changing anything */
+    if (ret && (pc != 0 || st.out.sz != 0)) {
+        sized_buf res = {.sz = 0, .capacity = 4096, .buf = mgr_malloc(4096)};
+        /* if it ran to completion, nothing uses the old constant data */
+        if (pc == len) data->sz = 0;
+        /* start by writing everything it output so far all at once */
+        if (st.out.sz && !align_data(data)) ret = false;
+        if (ret && st.out.sz) {
+            ir_instr out = {
+                .op = IR_OUTPUT_CONST,
+                .offset = 0,
+                .arg = data->sz,
+                .len = st.out.sz,
+                .line = instrs[0].line,
+                .col = instrs[0].col,
+            };
+            ret = append_obj(data, st.out.buf, st.out.sz) &&
+                  append_obj(&res, &out, sizeof(ir_instr));
+        }
+        if (pc < len) {
+            /* continue from the same cell and instruction */
+            if (ret && st.pos != 0) {
+                ret = push_instr(
+                    &res, IR_MOVE, st.pos, instrs[pc].line, instrs[pc].col
+                );
+            }
+            if (ret) {
+                ret = eval_residue(
+                    &res, instrs, len, pc, loop_match, open_stack, depth
+                );
+            }
+        }
+        mgr_free(ir->buf);
+        *ir = res;
+        /* if res was freed after an error, leave ir in the same state */
+        if (res.buf == NULL) ret = false;
+    }
+
+    if (st.out.buf != NULL) mgr_free(st.out.buf);
+    mgr_free(loop_match);
+    mgr_free(open_stack);
+    if (!ret) {
+        if (ir->buf != NULL) mgr_free(ir->buf);
+        ir->buf = NULL;
+        if (data->buf != NULL) mgr_free(data->buf);
+        data->buf = NULL;
+    }
+    return ret;
+}
@@ -2,29 +2,167 @@
  *
  * SPDX-License-Identifier: GPL-3.0-only
  *
- * Provides a function that returns EAMBFC IR from an open FD */
+ * Provides the EAMBFC IR types, a function that generates EAMBFC IR from
+ * brainfuck source code, and one that runs EAMBFC IR ahead of time. */
 
 #ifndef EAMBFC_OPTIMIZE_H
 #define EAMBFC_OPTIMIZE_H 1
 /* internal */
-#include "types.h" /* sized_buf */
+#include "types.h" /* i32, i64, u32, uint, size_t, sized_buf */
 
-/* Replaces the content of the buffer with a null-terminated string containing
- * an internal intermediate representation of the code, and dead loops are
- * removed, as are sequences of instructions that cancel out, such as `<>`.
+/* The operations that EAMBFC IR instructions can perform.
  *
- * SUBSTITUTIONS:
+ * Every cell-modifying operation acts on the cell that's offset cells away from
+ * the tape pointer, and the meaning of arg depends on the operation. */
+typedef enum {
+    /* move the tape pointer arg cells to the right (or left, if negative) */
+    IR_MOVE,
+    /* add arg (which is from 1 to 255) to the cell */
+    IR_ADD,
+    /* set the cell to zero */
+    IR_ZERO,
+    /* set the cell to arg (which is from 1 to 255) */
+    IR_SET,
+    /* set len cells (from 2 to IR_RANGE_MAX), starting with the cell, to 0 */
+    IR_ZERO_RANGE,
+    /* set len cells (from 2 to IR_RANGE_MAX), starting with the cell, to the
+     * len bytes of constant data starting arg bytes into the data that to_ir
+     * stores alongside the IR */
+    IR_SET_RANGE,
+    /* add the current cell multiplied by arg (from 1 to 255) to the cell */
+    IR_MUL_ADD,
+    /* move the tape pointer arg cells at a time until it reaches a zero cell */
+    IR_SCAN,
+    /* the `[` and `]` brainfuck instructions */
+    IR_LOOP_OPEN,
+    IR_LOOP_CLOSE,
+    /* the `.` and `,` brainfuck instructions */
+    IR_OUTPUT,
+    IR_INPUT,
+    /* write len bytes of constant data, starting arg bytes into the data that
+     * to_ir stores alongside the IR, without reading the tape at all */
+    IR_OUTPUT_CONST
+} ir_op;
+
+/* the most cells that a single IR_ZERO_RANGE or IR_SET_RANGE can set */
+#define IR_RANGE_MAX 32
+
+/* A single EAMBFC IR instruction. line and col are the location in the source
+ * file of the first brainfuck instruction it was generated from. */
+typedef struct ir_instr {
+    ir_op op;
+    i32 offset;
+    i64 arg;
+    /* the number of cells or bytes acted on, for the ops that mention it */
+    u32 len;
+    uint line;
+    uint col;
+} ir_instr;
+
+/* Counts of what to_ir did to a program, for reporting. */
+typedef struct opt_stats {
+    /* bytes of the source code outside of dead loops that are comments */
+    size_t comment_bytes;
+    /* loops removed because they could never run */
+    size_t dead_loops;
+    /* `+`, `-`, `<`, and `>` instructions merged into or cancelled out by the
+     * instruction before them */
+    size_t merged;
+    /* loops replaced with just an IR_ZERO, with IR_MUL_ADD instructions, and
+     * with an IR_SCAN */
+    size_t zero_loops;
+    size_t mul_loops;
+    size_t scan_loops;
+    /* loops replaced with a copy of their body for each time they'd run */
+    size_t unrolled_loops;
+    /* instructions removed because the cells they change are overwritten
+     * before anything could read them */
+    size_t dead_stores;
+    /* the number of IR instructions and bytes of constant data at the end */
+    size_t ir_instrs;
+    size_t data_bytes;
+} opt_stats;
+
+/* Generate EAMBFC IR from the src_sz bytes of brainfuck source code at src,
+ * and store it in *ir as a contiguous array of ir_instr structs, with ir->sz
+ * set to the number of bytes used. Dead loops are removed, as are sequences of
+ * instructions that cancel out, such as `<>`.
+ *
+ * Consecutive `<` and `>` instructions are merged into a single IR_MOVE, and
+ * consecutive `+` and `-` instructions are merged into a single IR_ADD.
+ *
+ * `[+]` and `[-]` both become IR_ZERO.
+ *
+ * Loops made up only of `+`, `-`, `<`, and `>` instructions, which end on the
+ * same cell they started on and change that cell by exactly 1 each time
+ * through, such as `[->+++<]`, become an IR_MUL_ADD for each other cell they
+ * change, followed by IR_ZERO.
+ *
+ * Loops made up of only `<` or only `>` instructions, such as `[>]`, become an
+ * IR_SCAN.
  *
- * N consecutive `>` instructions are replaced with `}N`.
- * N consecutive `<` instructions are replaced with `{N`.
- * N consecutive `+` instructions are replaced with `#N`.
- * N consecutive `-` instructions are replaced with `=N`.
+ * Pointer movement is deferred until the next IR_LOOP_OPEN, IR_LOOP_CLOSE,
+ * IR_OUTPUT, IR_INPUT, IR_MUL_ADD, or IR_SCAN, and the offset of IR_ADD and
+ * IR_ZERO instructions in between is set to make up for it.
  *
- * single `+`, `-`, `<`, and `>` instructions are left as is.
+ * Finally, the values of cells are tracked wherever they can be known ahead of
+ * time - from the start of the program, where every cell is zero, and from the
+ * point where they're set within each stretch of code without loops. Loops and
+ * IR_SCAN instructions that start on a cell known to be zero are removed, and
+ * modifying a cell with a known value becomes an IR_SET or IR_ZERO, merged into
+ * any earlier store to that cell that nothing could have read in between.
+ * IR_OUTPUT instructions that write cells with known values become
+ * IR_OUTPUT_CONST instructions, and consecutive ones are merged into one, with
+ * the bytes they write stored in *data.
+ *
+ * Loops without any loops or IR_SCAN instructions inside of them which start
+ * on a cell with a known value, and only change it by adding the same amount
+ * each time through, such as `+++[>.-<-]`, run a number of times that's known
+ * ahead of time. If their body isn't too long, they're replaced with a copy of
+ * it for each time they'd run, and then cell values are tracked again, so
+ * that the copies can also be folded into constants.
+ *
+ * Then, instructions that only change cells which are overwritten before
+ * anything could read them are removed, working backwards through each stretch
+ * of code without loops, such as the `+++` in `+++>+<[-]` or anything that
+ * changes the tape at the very end of the program.
+ *
+ * After that, runs of IR_ZERO and IR_SET instructions for cells next to each
+ * other, such as those from `[-]>[-]>[-]` or `>[-]++>[-]+++`, are merged into
+ * IR_ZERO_RANGE or IR_SET_RANGE instructions, with the bytes to set the cells
+ * to also stored in *data.
+ *
+ * Offsets and IR_SCAN strides are always within the range of 32-bit signed
+ * integers.
+ *
+ * If stats is not NULL, counts of what was done along the way are stored in it.
+ *
+ * On success, returns true, and the caller is responsible for calling
+ * `mgr_free` on ir->buf and data->buf. On failure, prints an error and returns
+ * false. */
+bool to_ir(
+    const char *src,
+    size_t src_sz,
+    sized_buf *ir,
+    sized_buf *data,
+    opt_stats *stats
+);
+
+/* Run as much of the program in *ir (with its constant data in *data) as
+ * possible at compile time, on a tape of tape_sz cells, then replace it with
+ * the part that's left to run at runtime, which starts by writing the output
+ * produced so far with an IR_OUTPUT_CONST, and moving the tape pointer to the
+ * cell it was on when it stopped. The program stops if it reaches an IR_INPUT,
+ * would move outside of the tape, produces too much output, or runs for too
+ * long, so programs which don't read input can often be run in full.
  *
- * `[+]` and `[-]` both get replaced with `@`.
+ * tape is set to the initial contents of the tape for the rest of the program,
+ * leaving out any zero cells at the end, so that tape->sz is 0 if the tape
+ * starts out zeroed, as it does if the whole program was run.
  *
- * all `,` and `.` instructions are left unchanged, as are any `[` or `]`
- * instructions not part of the two sequences that are replaced with `@`. */
-bool to_ir(sized_buf *src);
+ * On success, returns true. On failure, prints an error, frees ir->buf and
+ * data->buf, and returns false. */
+bool partial_eval(
+    sized_buf *ir, sized_buf *data, sized_buf *tape, size_t tape_sz
+);
 #endif /* EAMBFC_OPTIMIZE_H */
@@ -0,0 +1,104 @@
+/* SPDX-FileCopyrightText: 2025 Eli Array Minkoff
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * Reads the profiles written by programs compiled with profiling enabled, and
+ * looks up how hot the loops in them are. */
+
+/* C99 */
+#include <stdlib.h> /* qsort, bsearch */
+#include <string.h> /* memcmp */
+/* POSIX */
+#include <fcntl.h> /* O_RDONLY */
+/* internal */
+#include "compat/elf.h" /* ELFDATA2[LM]SB */
+#include "compile.h" /* PROFILE_MAGIC */
+#include "err.h" /* param_err */
+#include "profile.h" /* loop_count, loop_profile */
+#include "resource_mgr.h" /* mgr_malloc, mgr_free, mgr_open, mgr_close */
+#include "types.h" /* bool, uint, u8, u32, u64, UINT64_MAX, size_t, sized_buf */
+#include "util.h" /* read_to_sized_buf */
+
+/* the size of the magic bytes, byte order, and loop count at the start */
+#define PROFILE_HEADER_SZ 16
+
+/* read the sz-byte unsigned integer at p, which is little-endian if le is true,
+ * and big-endian otherwise */
+static u64 read_uint(const u8 *p, int sz, bool le) {
+    u64 val = 0;
+    for (int i = 0; i < sz; i++) val = (val << 8) | p[le ? sz - 1 - i : i];
+    return val;
+}
+
+/* order loop_count entries by source location, for qsort and bsearch */
+static int cmp_loops(const void *a, const void *b) {
+    const loop_count *l = a, *r = b;
+    if (l->line != r->line) return (l->line > r->line) - (l->line < r->line);
+    return (l->col > r->col) - (l->col < r->col);
+}
+
+/* read the header and loops of the profile in buf into dst, returning false if
+ * it's not a valid profile */
+static bool parse_profile(const sized_buf *buf, loop_profile *dst) {
+    const u8 *bytes = buf->buf;
+    if (buf->sz < PROFILE_HEADER_SZ || memcmp(bytes, PROFILE_MAGIC, 7) != 0 ||
+        (bytes[7] != ELFDATA2LSB && bytes[7] != ELFDATA2MSB)) {
+        return false;
+    }
+    bool le = bytes[7] == ELFDATA2LSB;
+    u64 ct = read_uint(&bytes[8], 8, le);
+    /* each loop has an 8-byte location and an 8-byte count */
+    if (ct > (buf->sz - PROFILE_HEADER_SZ) / 16 ||
+        buf->sz != PROFILE_HEADER_SZ + ct * 16) {
+        return false;
+    }
+    dst->ct = ct;
+    dst->loops = mgr_malloc((ct ? ct : 1) * sizeof(loop_count));
+    const u8 *locs = &bytes[PROFILE_HEADER_SZ];
+    const u8 *counts = &locs[ct * 8];
+    u64 total = 0;
+    for (size_t i = 0; i < ct; i++) {
+        dst->loops[i].line = (u32)read_uint(&locs[i * 8], 4, le);
+        dst->loops[i].col = (u32)read_uint(&locs[i * 8 + 4], 4, le);
+        dst->loops[i].count = read_uint(&counts[i * 8], 8, le);
+        /* saturate rather than wrap, as it's only used for a rough share */
+        u64 count = dst->loops[i].count;
+        total = (total > UINT64_MAX - count) ? UINT64_MAX : total + count;
+    }
+    dst->hot_min = total / 64 ? total / 64 : 1;
+    qsort(dst->loops, ct, sizeof(loop_count), cmp_loops);
+    return true;
+}
+
+bool load_profile(const char *path, loop_profile *dst) {
+    dst->ct = 0;
+    dst->loops = NULL;
+    dst->hot_min = 1;
+    int fd = mgr_open(path, O_RDONLY);
+    if (fd < 0) {
+        param_err("OPEN_R_FAILED", "Failed to open {} for reading.", path);
+        return false;
+    }
+    sized_buf buf = read_to_sized_buf(fd);
+    mgr_close(fd);
+    if (buf.buf == NULL) return false;
+    bool ret = parse_profile(&buf, dst);
+    mgr_free(buf.buf);
+    if (!ret) param_err("BAD_PROFILE", "{} is not a valid profile.", path);
+    return ret;
+}
+
+bool loop_is_hot(const loop_profile *profile, uint line, uint col) {
+    if (profile->ct == 0) return false;
+    loop_count key = {.line = line, .col = col, .count = 0};
+    const loop_count *found = bsearch(
+        &key, profile->loops, profile->ct, sizeof(loop_count), cmp_loops
+    );
+    return found != NULL && found->count >= profile->hot_min;
+}
+
+void free_profile(loop_profile *profile) {
+    if (profile->loops != NULL) mgr_free(profile->loops);
+    profile->loops = NULL;
+    profile->ct = 0;
+}
@@ -0,0 +1,46 @@
+/* SPDX-FileCopyrightText: 2025 Eli Array Minkoff
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * Provides an interface to profile.c, which reads the profiles written by
+ * programs compiled with profiling enabled, so that they can guide how the
+ * programs are compiled afterwards. */
+
+#ifndef EAMBFC_PROFILE_H
+#define EAMBFC_PROFILE_H 1
+/* internal */
+#include "types.h" /* bool, uint, u32, u64, size_t */
+
+/* how many times the body of the loop opened at a source location ran */
+typedef struct loop_count {
+    u32 line;
+    u32 col;
+    u64 count;
+} loop_count;
+
+/* the loops in a profile, sorted by source location */
+typedef struct loop_profile {
+    size_t ct;
+    loop_count *loops;
+    /* the smallest count of a loop that counts as hot */
+    u64 hot_min;
+} loop_profile;
+
+/* Read the profile in the file at path (see PROFILE_FD in compile.h for the
+ * format) into dst, allocating its loops with mgr_malloc.
+ *
+ * A loop is hot if it ran at least once, and its body ran at least 1/64 as many
+ * times as those of all of the loops in the profile combined.
+ *
+ * Returns true if it was read, and prints an error and returns false if not. */
+bool load_profile(const char *path, loop_profile *dst);
+
+/* Returns true if the loop opened at line and col in the source code is hot in
+ * profile. Loops that aren't in it at all, such as ones added since it was
+ * written, aren't hot. */
+bool loop_is_hot(const loop_profile *profile, uint line, uint col);
+
+/* Free the loops in profile. */
+void free_profile(loop_profile *profile);
+
+#endif /* EAMBFC_PROFILE_H */
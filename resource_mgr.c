@@ -5,6 +5,7 @@
  * the process, and calls the cleanup functions as needed if the end was reached
  * improperly */
 /* C99 */
+#include <stdint.h> /* SIZE_MAX */
 #include <stdlib.h> /* {m,re}alloc, free, atexit */
 #include <string.h> /* memmove */
 /* POSIX */
@@ -12,54 +13,65 @@
 #include <unistd.h> /* close */
 /* internal */
 #include "err.h" /* internal_err, alloc_err */
-#include "types.h" /* ifast_8, bool, mode_t, size_t */
+#include "types.h" /* bool, mode_t, size_t */
 
-#define MAX_ALLOCS 64
-#define MAX_FDS 16
+/* number of entries to add to a table at a time when it fills up */
+#define TABLE_CHUNK_SZ 64
 
-/* with the maximum numbers of entries as low as they are, no fancy data
- * structure needed. A struct is used just to keep all of the Resource Manager's
- * internal state in one place. */
+/* The tables grow as needed, so there's no fixed limit on the number of
+ * allocations and file descriptors that can be tracked at once. Lookups are a
+ * linear search from the most recent entry, as entries tend to be short-lived.
+ * A struct is used just to keep all of the Resource Manager's internal state
+ * in one place. */
 static struct resource_tracker {
-    void *allocs[MAX_ALLOCS];
-    int fds[MAX_FDS];
+    void **allocs;
+    int *fds;
     /* index variables are for the NEXT entry in the array. */
-    ifast_8 alloc_i;
-    ifast_8 fd_i;
+    size_t alloc_i;
+    size_t fd_i;
+    /* number of entries the tables have room for */
+    size_t alloc_cap;
+    size_t fd_cap;
 } resources;
 
-static ifast_8 alloc_index(const void *ptr) {
+/* return table, reallocated to fit another TABLE_CHUNK_SZ entries of sz bytes
+ * each, and add TABLE_CHUNK_SZ to *cap, which is the number it had room for.
+ *
+ * The tables themselves are allocated with the plain realloc, as the Resource
+ * Manager can't track its own storage. */
+static void *grow_table(void *table, size_t *cap, size_t sz) {
+    if (*cap > SIZE_MAX / sz - TABLE_CHUNK_SZ) alloc_err();
+    void *new_table = realloc(table, (*cap + TABLE_CHUNK_SZ) * sz);
+    if (new_table == NULL) alloc_err();
+    *cap += TABLE_CHUNK_SZ;
+    return new_table;
+}
+
+/* return the index of ptr within resources.allocs, or resources.alloc_i if it
+ * isn't registered. */
+static size_t alloc_index(const void *ptr) {
     /* work backwards, as more recent allocs are more likely to be used */
-    for (ifast_8 i = resources.alloc_i - 1; i >= 0; --i) {
-        if (resources.allocs[i] == ptr) return i;
+    for (size_t i = resources.alloc_i; i > 0; --i) {
+        if (resources.allocs[i - 1] == ptr) return i - 1;
     }
-    return -1;
+    return resources.alloc_i;
 }
 
 void *mgr_malloc(size_t size) {
-    if (resources.alloc_i > MAX_ALLOCS - 1) {
-        internal_err(
-            "TOO_MANY_ALLOCS",
-            "Allocated too many times for resource_mgr to track."
+    if (resources.alloc_i == resources.alloc_cap) {
+        resources.allocs = grow_table(
+            resources.allocs, &resources.alloc_cap, sizeof(void *)
         );
-        /* will never return, as internal_err calls exit(EXIT_FAILURE) */
-        return NULL;
     }
-
     void *result = malloc(size);
-    if (result == NULL) {
-        /* don't skip over this array index */
-        resources.alloc_i--;
-        alloc_err();
-    } else {
-        resources.allocs[resources.alloc_i++] = result;
-    }
+    if (result == NULL) alloc_err();
+    resources.allocs[resources.alloc_i++] = result;
     return result;
 }
 
 void mgr_free(void *ptr) {
-    ifast_8 index = alloc_index(ptr);
-    if (index == -1) {
+    size_t index = alloc_index(ptr);
+    if (index == resources.alloc_i) {
         internal_err(
             "MGR_FREE_UNKNOWN",
             "mgr_free called with an unregistered *ptr value"
@@ -68,15 +80,15 @@ void mgr_free(void *ptr) {
         return;
     }
     free(ptr);
-    size_t to_move = (resources.alloc_i - index) * sizeof(void *);
+    size_t to_move = ((--resources.alloc_i) - index) * sizeof(void *);
     memmove(
         &(resources.allocs[index]), &(resources.allocs[index + 1]), to_move
     );
 }
 
 void *mgr_realloc(void *ptr, size_t size) {
-    ifast_8 index = alloc_index(ptr);
-    if (index == -1) {
+    size_t index = alloc_index(ptr);
+    if (index == resources.alloc_i) {
         /* will never return, as internal_err calls exit(EXIT_FAILURE) */
         internal_err(
             "MGR_REALLOC_UNKNOWN",
@@ -87,6 +99,8 @@ void *mgr_realloc(void *ptr, size_t size) {
     void *new_ptr = realloc(ptr, size);
     if (new_ptr == NULL) {
         free(resources.allocs[index]);
+        /* don't try to free it again at exit */
+        resources.allocs[index] = NULL;
         alloc_err();
         return NULL;
     }
@@ -97,12 +111,10 @@ void *mgr_realloc(void *ptr, size_t size) {
 static int mgr_open_handler(
     const char *pathname, int flags, mode_t mode, bool with_mode
 ) {
-    if (resources.fd_i > MAX_FDS - 1) {
-        internal_err(
-            "TOO_MANY_OPENS", "Opened too many files for resource_mgr to track."
+    if (resources.fd_i == resources.fd_cap) {
+        resources.fds = grow_table(
+            resources.fds, &resources.fd_cap, sizeof(int)
         );
-        /* will never return, as internal_err calls exit(EXIT_FAILURE) */
-        return -1;
     }
     int result;
     if (with_mode) {
@@ -126,15 +138,15 @@ int mgr_open(const char *pathname, int flags) {
 }
 
 int mgr_close(int fd) {
-    ifast_8 index = -1;
+    size_t index = resources.fd_i;
     /* work backwards - more likely to close more recently-opened files */
-    for (ifast_8 i = resources.fd_i - 1; i >= 0; i--) {
-        if (resources.fds[i] == fd) {
-            index = i;
+    for (size_t i = resources.fd_i; i > 0; i--) {
+        if (resources.fds[i - 1] == fd) {
+            index = i - 1;
             break;
         }
     }
-    if (index == -1) {
+    if (index == resources.fd_i) {
         internal_err(
             "MGR_CLOSE_UNKNOWN",
             "mgr_close called with an unregistered fd value"
@@ -143,14 +155,20 @@ int mgr_close(int fd) {
         return -1;
     }
     /* remove fd from resources */
-    size_t to_move = ((resources.fd_i--) - index) * sizeof(int);
+    size_t to_move = ((--resources.fd_i) - index) * sizeof(int);
     memmove(&(resources.fds[index]), &(resources.fds[index + 1]), to_move);
     return close(fd);
 }
 
 void cleanup(void) {
-    while (--resources.alloc_i > -1) free(resources.allocs[resources.alloc_i]);
-    while (--resources.fd_i > -1) close(resources.fds[resources.fd_i]);
+    while (resources.alloc_i > 0) free(resources.allocs[--resources.alloc_i]);
+    while (resources.fd_i > 0) close(resources.fds[--resources.fd_i]);
+    free(resources.allocs);
+    free(resources.fds);
+    resources.allocs = NULL;
+    resources.fds = NULL;
+    resources.alloc_cap = 0;
+    resources.fd_cap = 0;
 }
 
 void register_mgr(void) {
@@ -37,13 +37,11 @@ void register_mgr(void);
  * Any allocation done with mgr_malloc must be 'realloc'ed and 'free'd with the
  * mgr_realloc and mgr_free functions, to ensure that they are properly tracked
  * and unregistered by the Resource Manager, otherwise it may try to free them
- * again, resulting in Double Frees or other Undefined Behavior, or run out of
- * space to register new allocations.
+ * again, resulting in Double Frees or other Undefined Behavior.
  *
  * Fatal Error Calls:
- *  - if called with 64 allocations already registered, calls internal_err with
- *    error code `TOO_MANY_ALLOCS`
- *  - if internal call to malloc fails, calls alloc_err
+ *  - if internal call to malloc fails, or if there's no memory left to register
+ *    the allocation, calls alloc_err
  *
  * Because it calls alloc_err on failure, it never returns NULL. */
 void *mgr_malloc(size_t size);
@@ -73,14 +71,13 @@ void mgr_free(void *ptr);
  *
  * Any file descriptors opened with mgr_open or mgr_open_m must be closed with
  * mgr_close, to ensure that they are properly unregistered by the Resource
- * Manager, otherwise it may try to close them again, or run out of space to
- * register new file descriptors.
+ * Manager, otherwise it may try to close them again.
  *
  * If internal call to open returns -1, they don't register the file descriptor.
  *
  * Fatal Error Calls:
- *  - if called with 16 file descriptors already registered, call internal_err
- *    with error code `TOO_MANY_OPENS`. */
+ *  - if there's no memory left to register the file descriptor, call
+ *    alloc_err. */
 int mgr_open_m(const char *pathname, int flags, mode_t mode);
 int mgr_open(const char *pathname, int flags);
 
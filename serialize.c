@@ -7,7 +7,7 @@
 /* C99 */
 #include <stddef.h> /* size_t */
 /* internal */
-#include "compat/elf.h" /* Elf64_Ehdr, Elf64_Phdr */
+#include "compat/elf.h" /* Elf64_Ehdr, Elf64_Phdr, Elf64_Shdr, Elf64_Sym */
 #include "types.h" /* [iu]{8,16,32,64} */
 
 /* serialize a 16-bit value in v16 into 2 bytes in dest, in LSB order
@@ -135,3 +135,63 @@ size_t serialize_phdr64_be(const Elf64_Phdr *phdr, void *dest) {
     i += serialize64be(phdr->p_align, p + i);
     return i;
 }
+
+/* serialize a 64-bit Shdr into a byte sequence, in LSB order */
+size_t serialize_shdr64_le(const Elf64_Shdr *shdr, void *dest) {
+    size_t i = 0;
+    char *p = dest;
+    i += serialize32le(shdr->sh_name, p + i);
+    i += serialize32le(shdr->sh_type, p + i);
+    i += serialize64le(shdr->sh_flags, p + i);
+    i += serialize64le(shdr->sh_addr, p + i);
+    i += serialize64le(shdr->sh_offset, p + i);
+    i += serialize64le(shdr->sh_size, p + i);
+    i += serialize32le(shdr->sh_link, p + i);
+    i += serialize32le(shdr->sh_info, p + i);
+    i += serialize64le(shdr->sh_addralign, p + i);
+    i += serialize64le(shdr->sh_entsize, p + i);
+    return i;
+}
+
+/* serialize a 64-bit Shdr into a byte sequence, in MSB order */
+size_t serialize_shdr64_be(const Elf64_Shdr *shdr, void *dest) {
+    size_t i = 0;
+    char *p = dest;
+    i += serialize32be(shdr->sh_name, p + i);
+    i += serialize32be(shdr->sh_type, p + i);
+    i += serialize64be(shdr->sh_flags, p + i);
+    i += serialize64be(shdr->sh_addr, p + i);
+    i += serialize64be(shdr->sh_offset, p + i);
+    i += serialize64be(shdr->sh_size, p + i);
+    i += serialize32be(shdr->sh_link, p + i);
+    i += serialize32be(shdr->sh_info, p + i);
+    i += serialize64be(shdr->sh_addralign, p + i);
+    i += serialize64be(shdr->sh_entsize, p + i);
+    return i;
+}
+
+/* serialize a 64-bit Sym into a byte sequence, in LSB order */
+size_t serialize_sym64_le(const Elf64_Sym *sym, void *dest) {
+    size_t i = 0;
+    char *p = dest;
+    i += serialize32le(sym->st_name, p + i);
+    p[i++] = sym->st_info;
+    p[i++] = sym->st_other;
+    i += serialize16le(sym->st_shndx, p + i);
+    i += serialize64le(sym->st_value, p + i);
+    i += serialize64le(sym->st_size, p + i);
+    return i;
+}
+
+/* serialize a 64-bit Sym into a byte sequence, in MSB order */
+size_t serialize_sym64_be(const Elf64_Sym *sym, void *dest) {
+    size_t i = 0;
+    char *p = dest;
+    i += serialize32be(sym->st_name, p + i);
+    p[i++] = sym->st_info;
+    p[i++] = sym->st_other;
+    i += serialize16be(sym->st_shndx, p + i);
+    i += serialize64be(sym->st_value, p + i);
+    i += serialize64be(sym->st_size, p + i);
+    return i;
+}
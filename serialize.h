@@ -7,7 +7,7 @@
 #ifndef EAMBFC_SERIALIZE_H
 #define EAMBFC_SERIALIZE_H 1
 /* internal */
-#include "compat/elf.h" /* Elf64_Ehdr, Elf64_Phdr */
+#include "compat/elf.h" /* Elf64_Ehdr, Elf64_Phdr, Elf64_Shdr, Elf64_Sym */
 #include "types.h" /* [iu]{8,16,32,64} */
 
 /* given an unsigned integer of a given size and a char array, these write the
@@ -21,6 +21,8 @@ size_t serialize64le(u64 v64, void *dest);
  * the fields of the struct in LSB order to the char array without padding . */
 size_t serialize_ehdr64_le(Elf64_Ehdr *ehdr, void *dest); /* Elf64_Ehdr */
 size_t serialize_phdr64_le(const Elf64_Phdr *phdr, void *dest); /* Elf64_Phdr */
+size_t serialize_shdr64_le(const Elf64_Shdr *shdr, void *dest); /* Elf64_Shdr */
+size_t serialize_sym64_le(const Elf64_Sym *sym, void *dest); /* Elf64_Sym */
 
 /* The same as the above, except in MSB order. */
 size_t serialize16be(u16 v16, void *dest);
@@ -28,4 +30,6 @@ size_t serialize32be(u32 v32, void *dest);
 size_t serialize64be(u64 v64, void *dest);
 size_t serialize_ehdr64_be(Elf64_Ehdr *ehdr, void *dest); /* Elf64_Ehdr */
 size_t serialize_phdr64_be(const Elf64_Phdr *phdr, void *dest); /* Elf64_Phdr */
+size_t serialize_shdr64_be(const Elf64_Shdr *shdr, void *dest); /* Elf64_Shdr */
+size_t serialize_sym64_be(const Elf64_Sym *sym, void *dest); /* Elf64_Sym */
 #endif /* EAMBFC_SERIALIZE_H */
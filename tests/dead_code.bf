@@ -22,3 +22,6 @@ also have enough consecutive + and - instructions to overflow instantly [that sh
 ----------------------------------------------------------------
 ----------------------------------------------------------------
 ----------------------------------------------------------------
+
+nothing reads the tape after the end of the program either so changing any
+cells right before then is also useless > +++ > ++ < - <
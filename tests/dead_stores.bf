@@ -0,0 +1,16 @@
+A brainfuck program that changes cells in ways that are overwritten before
+anything reads them in order to test the optimization that removes them
+
+set cells 1 and 2 to 1 in a loop that is not folded so that they are unknown
++[>+>+<<-[]]
+add to cell 1 then clear it and set it to a capital H before printing it
+>+++[-]++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.
+add cell 2 times three to cell 1 then clear both and set cell 1 to a lowercase
+i before printing it
+>[<+++>-]<[-]+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.
+add to cell 2 then move it back to cell 1 and set cell 2 to a newline and
+>++++[<+>-]++++++++++.
+print it then print cell 1 which still holds the lowercase i plus 4 as an m
+<.
+cell 2 is changed at the end but nothing reads it after that
+>+++
@@ -0,0 +1,17 @@
+A brainfuck program that prints some characters using cells with values that
+can be worked out while compiling in order to test the optimization that folds
+them into constants
+
+these loops start on zero cells so they never run
+[-]>[>+<-]<[[>]<]
+set cell 1 to 72 with a multiplication loop and print it as a capital H
+++++++++[>+++++++++<-]>.
+add 33 to make a lowercase i and print it then clear it and set it to 33 before
+printing it as an exclamation mark then print a newline in cell 2
++++++++++++++++++++++++++++++++++.[-]+++++++++++++++++++++++++++++++++.>++++++++++.
+print cell 1 with values counting down from 33 to 31 in a loop that runs 3
+times then print a newline
+<<+++[>.-<-]>>.
+add 2 to cell 1 with a multiplication loop and print it as a space then print
+the known newline in cell 2
+<<++[>+<-]>.>.
@@ -0,0 +1,17 @@
+A brainfuck program that prints some characters using loops that add multiples
+of the current cell to other cells in order to test the optimizations for them
+
+run a loop that is not folded so that the values of all cells are unknown
++[-[]]
+
+set cell 1 to 42 then print it as an asterisk
+++++++[->+++++++<]>.
+copy cell 1 into cell 2 and add 6 for a zero character then add double cell 1
+into cell 3 and subtract 19 for a capital A
+[->+>++<<]>++++++.>-------------------.
+set cell 0 to 4 then multiply it by 30 and add it to cell 5 then print cell 5
+plus 1 for a lowercase y
+<<<++++[->>>>>++++++++++++++++++++++++++++++<<<<<]>>>>>+.
+use a loop that increments its counter back to zero to subtract 132 times 3
+from cell 6 after setting it to 2 and then print it as a lowercase v
+>++<+++[+>---<]>.
@@ -0,0 +1,13 @@
+A brainfuck program that prints some characters after running loops that take
+too long to be run in full while compiling it in order to test continuing the
+program from wherever the compiler stopped running it
+
+set cell 1 to 72 and print it as a capital H then add 33 to it and print it as
+a lowercase i then print a newline in cell 2
+++++++++[>+++++++++<-]>.+++++++++++++++++++++++++++++++++.>++++++++++.
+run the inner loop 127 times for each of the 255 times the middle loop runs
+for each of the 255 times the outer loop runs and add 1 to cell 6 and 3 to cell
+7 each time
+>-[>-[>--[-->+>+++<<]<-]<-]
+print cells 6 and 7 then the newline in cell 2
+>>>.>.<<<<<.
@@ -0,0 +1,2 @@
+A program that echoes a line of input to test loop profiling
+,----------[++++++++++.,----------]
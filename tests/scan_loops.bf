@@ -0,0 +1,16 @@
+A brainfuck program that prints some characters after using loops that scan
+across the tape for a zero cell in order to test the optimizations for them
+
+leave cell 0 set to zero then set cells 1 to 40 to 1 and end up on cell 41
+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>+>
+scan left from cell 40 to cell 0 then right from cell 1 to cell 41 and print
+an A there before zeroing it
+<[<]>[>]+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.[-]
+scan back left to cell 0 and print a B there before zeroing it
+<[<]++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.[-]
+scan right from cell 1 in steps of 3 to cell 43 and print a C
+>[>>>]+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.[-]
+scan left from cell 40 in steps of 2 to cell 0 and print a D
+<<<[<<]++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.[-]
+scan right from cell 1 in steps of 5 to cell 41 and print an E then a newline
+>[>>>>>]+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.-----------------------------------------------------------.[-]
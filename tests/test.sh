@@ -37,6 +37,22 @@ test_simple () {
     fi
 }
 
+# like test_simple, but run the source file with the JIT run mode instead.
+# Always uses the architecture the tests are running on, so it's not passed the
+# arguments used for the rest of the tests.
+test_jit () {
+    total=$((total+1))
+    name="$1"; shift
+    expected="$1"; shift
+    if [ "$("$EAMBFC" -x "$@" "$name.bf" | cksum)" = "$expected" ]; then
+        successes=$((successes+1))
+        printf 'SUCCESS - %s, run with -x %s\n' "$name" "$*"
+    else
+        fails=$((fails+1))
+        printf 'FAIL - output mismatch: %s, run with -x %s\n' "$name" "$*"
+    fi
+}
+
 errid_pat='s/.*"errorId":"\([^"]*\).*/\1/'
 # a lot like test_simple, but this time, instead of testing the binary, check
 # that the error message matches the expectation
@@ -79,9 +95,18 @@ test_arg_error () {
 }
 
 test_simple colortest '1395950558 3437'
+test_simple dead_stores '3292634393 4'
+test_simple deferred_moves '2258742855 5'
 test_simple hello '1639980005 14'
+test_simple known_values '3592939668 10'
+test_simple long_loop '4061627707 120004'
 test_simple loop '159651250 1'
+test_simple mul_loops '694855180 5'
 test_simple null '4294967295 0'
+test_simple partial_eval '4033038149 6'
+test_simple ranges '213617848 39'
+test_simple scan_loops '4066623336 6'
+test_simple unrolled_loops '2150597330 85'
 test_simple wrap '781852651 4'
 test_simple wrap2 '1742477431 4'
 
@@ -92,6 +117,30 @@ test_simple wrap2 '1742477431 4'
 test_simple alternative_extension '1639980005 14' # self-explanatory
 test_simple unseekable '1639980005 14' # output is a FIFO, can't be seeked
 test_simple piped_in '1639980005 14' # input is a FIFO, can't be seeked
+test_simple buffered '1395950558 3437' # colortest, but with buffered output
+test_simple aligned '1395950558 3437' # colortest, but with aligned loops
+test_simple evaluated '1395950558 3437' # colortest, but run while compiling
+test_simple cached '1395950558 3437' # colortest, but copied from the cache
+test_simple uncached '1395950558 3437' # colortest, but not cached
+test_simple collided '1639980005 14' # hello, despite a colliding entry
+test_simple unseekable_cached '1639980005 14' # unseekable, with a cache
+test_simple guided '1395950558 3437' # colortest, but aligned using a profile
+test_simple symbols '1395950558 3437' # colortest, but with symbols
+test_simple stats '3292634393 4' # dead_stores, but with stats reported
+test_simple huge_tape '4066623336 6' # scan_loops, but placed for huge pages
+test_simple parallel_hello '1639980005 14' # hello, compiled alongside wrap
+test_simple parallel_wrap '781852651 4' # wrap, compiled alongside hello
+test_simple parallel_last '1639980005 14' # hello, compiled after failures
+
+# run some programs without writing executables at all
+test_jit hello '1639980005 14' -t 8
+test_jit mul_loops '694855180 5' -O
+test_jit colortest '1395950558 3437' -Ob
+test_jit known_values '3592939668 10' -O
+test_jit partial_eval '4033038149 6' -OE
+test_jit ranges '213617848 39' -O
+test_jit scan_loops '4066623336 6' -OH
+test_jit unrolled_loops '2150597330 85' -O
 
 # ensure that the proper errors were encountered
 
@@ -111,6 +160,17 @@ test_arg_error BAD_EXTENSION 'wrong file extension for source file' \
     "$@" 'test.sh'
 test_arg_error NO_TAPE 'tape size is set to 0 blocks' \
     "$@" -t0 hello.bf
+test_arg_error MULTIPLE_JOB_COUNTS 'multiple job counts' \
+    "$@" -J 2 -J 4
+test_arg_error NO_JOBS 'job count is set to 0' \
+    "$@" -J0 hello.bf
+test_arg_error MULTIPLE_CACHE_DIRS 'multiple cache directories' \
+    "$@" -C .cache -C .cache
+test_arg_error MULTIPLE_PROFILES 'multiple profiles' \
+    "$@" -p guided.prof -p guided.prof
+test_arg_error BAD_PROFILE 'profile is not valid' \
+    "$@" -p hello.bf hello.bf
+test_arg_error JIT_PROFILE 'profiling code run within eambfc' -xP hello.bf
 test_arg_error TAPE_TOO_LARGE 'tape size large enough to cause an overflow' \
     "$@" -t9223372036854775807
 
@@ -149,17 +209,20 @@ done
 # pipe through `od` to ensure it can be handled cleanly as text
 # and is encoded the same way as it is in $bvs, including the leading space
 # on some `od` implementations, extra spaces might be added, so `sed` them away
-output_bvs="$(for bv in $bvs; do printf '%b' "\\0$bv" | ./rw; done |\
-        od -to1 -An | tr -d '\n' | sed 's/  */ /g')"
+# do the same for buffered_rw, which is rw compiled with buffered I/O
+for rw in rw buffered_rw; do
+    output_bvs="$(for bv in $bvs; do printf '%b' "\\0$bv" | ./$rw; done |\
+            od -to1 -An | tr -d '\n' | sed 's/  */ /g')"
 
-total=$((total+1))
-if [ "$bvs" = "$output_bvs" ]; then
-    successes=$((successes+1))
-    printf 'SUCCESS - rw works for all 8-bit values.\n'
-else
-    fails=$((fails+1))
-    printf 'FAIL - rw does not work for all 8-bit values.\n'
-fi
+    total=$((total+1))
+    if [ "$bvs" = "$output_bvs" ]; then
+        successes=$((successes+1))
+        printf 'SUCCESS - %s works for all 8-bit values.\n' "$rw"
+    else
+        fails=$((fails+1))
+        printf 'FAIL - %s does not work for all 8-bit values.\n' "$rw"
+    fi
+done
 
 # lastly, the truth machine
 # it goes on forever if the input is 1, which means that testing is a problem
@@ -181,6 +244,91 @@ else
     printf 'FAIL - truthmachine fails for at least one of its two inputs.\n'
 fi
 
+# the cache should have an entry for each of the 2 tape sizes cached was
+# compiled with, and the copy of the first one should be identical to the end
+# of it, after the header identifying what it was compiled from
+total=$((total+1))
+matches=0
+for entry in .cache/*; do
+    tail -c "$(wc -c <cached)" "$entry" | cmp -s - cached &&
+        matches=$((matches+1))
+done
+if [ "$(ls .cache | wc -l)" -eq 2 ] && [ "$matches" -eq 1 ]; then
+    successes=$((successes+1))
+    printf 'SUCCESS - cached was added to the cache and copied from it\n'
+else
+    fails=$((fails+1))
+    printf 'FAIL - cached was not added to the cache or copied from it\n'
+fi
+
+# profiled echoes a line, and its one loop, at line 2, column 12, should run
+# once for each byte before the newline, with the profile in the byte order of
+# the architecture it was compiled for
+total=$((total+1))
+z3='\0\0\0'
+z7="$z3$z3\\0"
+profile_le="EAMBFCP\\01\\01$z7\\02$z3\\014$z3\\03$z7"
+profile_be="EAMBFCP\\02$z7\\01$z3\\02$z3\\014$z7\\03"
+if [ "$(printf 'abc\n' | ./profiled 3>profiled.prof)" = abc ] && \
+    profile="$(cksum <profiled.prof)" && \
+    { [ "$profile" = "$(printf '%b' "$profile_le" | cksum)" ] || \
+    [ "$profile" = "$(printf '%b' "$profile_be" | cksum)" ]; }; then
+    successes=$((successes+1))
+    printf 'SUCCESS - profiled wrote the expected profile\n'
+else
+    fails=$((fails+1))
+    printf 'FAIL - profiled did not write the expected profile\n'
+fi
+
+# parallel_skipped came after a file that failed to compile without -m, so it
+# shouldn't have been compiled, and with -m, the errors from the 2 files that
+# failed should have been printed in the order they were passed, each naming
+# the file it's about
+total=$((total+1))
+open_err='{"file":"parallel_open.bf","errorId":"UNMATCHED_OPEN"'
+close_err='{"file":"parallel_close.bf","errorId":"UNMATCHED_CLOSE"'
+if [ ! -e parallel_skipped ] && [ "$(wc -l <parallel.json)" -eq 2 ] && \
+    head -n 1 parallel.json | grep -F "$open_err" >/dev/null && \
+    tail -n 1 parallel.json | grep -F "$close_err" >/dev/null; then
+    successes=$((successes+1))
+    printf 'SUCCESS - parallel skipped files after failures, and kept order\n'
+else
+    fails=$((fails+1))
+    printf 'FAIL - parallel compiled skipped files, or mixed up errors\n'
+fi
+
+# symbols should have section headers, a symbol for each loop, named after
+# where it is in the source code, and a .bf_lines section, none of which are in
+# colortest, which is the same program compiled without -g
+total=$((total+1))
+has_sections() {
+    # e_shnum is the 2 bytes at offset 60, in either byte order
+    [ "$(od -An -j60 -N2 -tu1 "$1" | tr -d ' \n')" != 00 ]
+}
+has_symbols() {
+    strings -a "$1" | grep -x 'bf_loop_L74_C1' >/dev/null && \
+        strings -a "$1" | grep -x '\.bf_lines' >/dev/null
+}
+if has_sections symbols && has_symbols symbols && \
+    ! has_sections colortest && ! has_symbols colortest; then
+    successes=$((successes+1))
+    printf 'SUCCESS - symbols has section headers, loop symbols, and lines\n'
+else
+    fails=$((fails+1))
+    printf 'FAIL - symbols is missing section headers, loop symbols, or lines\n'
+fi
+
+# stats reports what was done to the source code and how large it is, in JSON
+total=$((total+1))
+if grep -F '"sourceBytes":854,"commentBytes":615,' stats.json >/dev/null && \
+    grep -F '"deadStores":5,' stats.json >/dev/null; then
+    successes=$((successes+1))
+    printf 'SUCCESS - stats reported the expected stats\n'
+else
+    fails=$((fails+1))
+    printf 'FAIL - stats did not report the expected stats\n'
+fi
+
 total=$((total+1))
 if [ -n "$SKIP_DEAD_CODE" ]; then
     skipped=$((skipped+1))
@@ -0,0 +1,19 @@
+A brainfuck program with loops that run a number of times that can be worked
+out while compiling in order to test the optimization that unrolls them
+
+set cell 0 to 12 then add 12 to cell 1 in a loop that subtracts 2 from cell 0
+so that it runs 6 times and print the 72 left in cell 1 as a capital H
+++++++++++++[>++++++++++++<--]>.
+print I then J then K from cell 1 in a loop that runs 3 times
+<+++[>+.<-]
+set cell 0 to 250 then print I then G then E from cell 1 in a loop that adds 2
+to cell 0 so that it runs 3 times before wrapping around to 0
+------[>--.<++]
+print the E in cell 1 70 times in a loop too long to unroll then a newline
+>>++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++[<.>-]
+++++++++++.
+print the E 3 times in an inner loop that runs 3 times each time an outer loop
+runs and the outer loop runs twice so it can be unrolled once the inner one is
+then print another newline
+[-]++[>[-]+++[<<.>>-]<-]
+++++++++++.
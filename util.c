@@ -5,18 +5,23 @@
  * Miscellaneous utility functions used throughout the eambfc codebase. */
 
 /* C99 */
+#include <errno.h> /* errno, EINTR */
 #include <limits.h> /* SSIZE_MAX */
 #include <string.h> /* memcpy */
 /* POSIX */
+#include <sys/mman.h> /* mmap, munmap, MAP_*, PROT_READ */
+#include <sys/stat.h> /* fstat, struct stat, S_ISREG */
+#include <sys/uio.h> /* writev, struct iovec */
+#include <time.h> /* clock_gettime, CLOCK_MONOTONIC, struct timespec */
 #include <unistd.h> /* read, write */
 /* internal */
-#include "err.h" /* basic_err */
+#include "err.h" /* basic_err, internal_err */
 #include "resource_mgr.h" /* mgr_malloc, mgr_realloc, mgr_free */
-#include "types.h" /* ssize_t, size_t, off_t */
+#include "types.h" /* ssize_t, size_t, off_t, u64 */
 
-/* Wrapper around write.3POSIX that returns true if all bytes were written, and
- * prints an error and returns false otherwise or if ct is too large to
- * validate. */
+/* Wrapper around write.3POSIX that returns true if all bytes were written,
+ * retrying after partial writes and interruptions, and prints an error and
+ * returns false otherwise or if ct is too large to validate. */
 bool write_obj(int fd, const void *buf, size_t ct) {
     if (ct > SSIZE_MAX) {
         basic_err(
@@ -25,17 +30,74 @@ bool write_obj(int fd, const void *buf, size_t ct) {
         );
         return false;
     }
-    ssize_t written = write(fd, buf, ct);
-    if (written != (ssize_t)ct) {
-        basic_err("FAILED_WRITE", "Failed to write to file");
-        return false;
+    const char *pos = buf;
+    while (ct > 0) {
+        ssize_t written = write(fd, pos, ct);
+        if (written < 0 && errno == EINTR) continue;
+        /* a write of 0 bytes would never finish, so treat it as a failure */
+        if (written <= 0) {
+            basic_err("FAILED_WRITE", "Failed to write to file");
+            return false;
+        }
+        pos += written;
+        ct -= (size_t)written;
     }
     return true;
 }
 
-/* Append bytes to dst, handling reallocs as needed.
+/* Wrapper around writev.3POSIX that works like write_obj. */
+bool writev_obj(int fd, struct iovec *iov, int iov_ct) {
+    size_t total = 0;
+    for (int i = 0; i < iov_ct; i++) {
+        if (iov[i].iov_len > SSIZE_MAX - total) {
+            basic_err(
+                "WRITE_TOO_LARGE",
+                "Didn't write because write is too large to properly validate."
+            );
+            return false;
+        }
+        total += iov[i].iov_len;
+    }
+    while (total > 0) {
+        /* skip past any buffers that have been written in full */
+        while (iov->iov_len == 0) {
+            iov++;
+            iov_ct--;
+        }
+        ssize_t written = writev(fd, iov, iov_ct);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            basic_err("FAILED_WRITE", "Failed to write to file");
+            return false;
+        }
+        total -= (size_t)written;
+        /* advance past what was written, which may end partway into one */
+        size_t left = (size_t)written;
+        for (; iov_ct > 0 && left >= iov->iov_len; iov++, iov_ct--) {
+            left -= iov->iov_len;
+        }
+        if (left) {
+            iov->iov_base = (char *)iov->iov_base + left;
+            iov->iov_len -= left;
+        }
+    }
+    return true;
+}
+
+/* Ensure that dst has room for at least sz more bytes, and return a pointer to
+ * the first byte of that space, which stays valid until dst is next extended.
  * Assumes that dst has been allocated with resource_mgr. */
-bool append_obj(sized_buf *dst, const void *bytes, size_t bytes_sz) {
+void *reserve_obj(sized_buf *dst, size_t sz) {
+    if (dst->buf == NULL) {
+        internal_err(
+            "APPEND_OBJ_TO_NULL", "reserve_obj called with dst->buf set to NULL"
+        );
+        /* will never return, as internal_err calls exit(EXIT_FAILURE) */
+        return NULL;
+    }
+    /* fast path - enough space is already available */
+    if (sz <= dst->capacity - dst->sz) return (char *)(dst->buf) + dst->sz;
+
     /* if more space is needed, ensure no overflow occurs when calculating new
      * space requirements, then allocate it.
      *
@@ -43,8 +105,8 @@ bool append_obj(sized_buf *dst, const void *bytes, size_t bytes_sz) {
      * get anywhere near that high in any realisitic scenario, and the extra
      * space simplifies overflow checking logic. Besides, any sensible malloc
      * implementation will be returning NULL well before this is relevant. */
-    if ((bytes_sz > (SIZE_MAX - 0x8000)) ||
-        (dst->capacity > (SIZE_MAX - (bytes_sz + 0x8000)))) {
+    if ((sz > (SIZE_MAX - 0x8000)) ||
+        (dst->sz > (SIZE_MAX - (sz + 0x8000)))) {
         basic_err(
             "BUF_TOO_LARGE",
             "Extending buffer would put size within 8 KiB of SIZE_MAX"
@@ -53,18 +115,11 @@ bool append_obj(sized_buf *dst, const void *bytes, size_t bytes_sz) {
         dst->capacity = 0;
         dst->sz = 0;
         dst->buf = NULL;
-        return false;
+        return NULL;
     }
 
-    if (dst->buf == NULL) {
-        internal_err(
-            "APPEND_OBJ_TO_NULL", "append_obj called with dst->buf set to NULL"
-        );
-        /* will never return, as internal_err calls exit(EXIT_FAILURE) */
-        return false;
-    }
     /* how much capacity is needed */
-    size_t needed_cap = bytes_sz + dst->sz;
+    size_t needed_cap = sz + dst->sz;
     /* if needed_cap isn't a multiple of 4 KiB in size, pad it out -
      * most usage of this function is going to be for small objects, so the
      * number of reallocations is vastly reduced that way.
@@ -72,15 +127,32 @@ bool append_obj(sized_buf *dst, const void *bytes, size_t bytes_sz) {
      * Because the previous check established that there's at least 8 KiB of
      * padding available, this is guaranteed not to overflow. */
     if (needed_cap & 0xfff) needed_cap = (needed_cap + 0x1000) & (~0xfff);
-
-    if (needed_cap > dst->capacity) {
-        /* reallocate to new capacity */
-        dst->buf = mgr_realloc(dst->buf, needed_cap);
-        dst->capacity = needed_cap;
+    /* grow geometrically, so that building up a large buffer a few bytes at a
+     * time takes a logarithmic rather than a linear number of reallocations,
+     * and the total amount of copying stays linear in the final size. */
+    if (dst->capacity <= (SIZE_MAX - 0x8000) / 2 &&
+        dst->capacity * 2 > needed_cap) {
+        needed_cap = dst->capacity * 2;
     }
-    /* actually append the object now that prep work is done */
-    memcpy((char *)(dst->buf) + dst->sz, bytes, bytes_sz);
-    dst->sz += bytes_sz;
+
+    /* reallocate to new capacity */
+    dst->buf = mgr_realloc(dst->buf, needed_cap);
+    dst->capacity = needed_cap;
+    return (char *)(dst->buf) + dst->sz;
+}
+
+/* Mark sz bytes written to space returned by reserve_obj as part of dst. */
+void commit_obj(sized_buf *dst, size_t sz) {
+    dst->sz += sz;
+}
+
+/* Append bytes to dst, handling reallocs as needed.
+ * Assumes that dst has been allocated with resource_mgr. */
+bool append_obj(sized_buf *dst, const void *bytes, size_t bytes_sz) {
+    void *dst_bytes = reserve_obj(dst, bytes_sz);
+    if (dst_bytes == NULL) return false;
+    memcpy(dst_bytes, bytes, bytes_sz);
+    commit_obj(dst, bytes_sz);
     return true;
 }
 
@@ -104,3 +176,38 @@ sized_buf read_to_sized_buf(int fd) {
     }
     return sb;
 }
+
+/* If fd is a non-empty regular file, maps its contents into memory read-only,
+ * rather than copying them into an allocated buffer. Anything else, such as a
+ * FIFO, is read with read_to_sized_buf instead. */
+sized_buf map_to_sized_buf(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+        (u64)st.st_size <= SIZE_MAX) {
+        void *mapped =
+            mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            sized_buf sb = {.sz = st.st_size, .capacity = 0, .buf = mapped};
+            return sb;
+        }
+    }
+    return read_to_sized_buf(fd);
+}
+
+/* Release the contents of a sized_buf from map_to_sized_buf. */
+void unmap_sized_buf(sized_buf *sb) {
+    if (sb->capacity == 0) {
+        munmap(sb->buf, sb->sz);
+    } else {
+        mgr_free(sb->buf);
+    }
+    sb->sz = 0;
+    sb->capacity = 0;
+    sb->buf = NULL;
+}
+
+u64 time_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) return 0;
+    return (u64)ts.tv_sec * 1000000000 + (u64)ts.tv_nsec;
+}
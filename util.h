@@ -5,19 +5,59 @@
  * Miscellaneous utility functions used throughout the eambfc codebase. */
 #ifndef EAMBFC_UTIL_H
 #define EAMBFC_UTIL_H 1
-#include "types.h" /* off_t, size_t, sized_buf */
-/* Passes arguments to write, and checks if bytes written is equal to ct.
- * If it is, returns true. otherwise, outputs a FAILED_WRITE error and
- * returns false. If ct is more than SSIZE_MAX, it will print an error and
- * return false immediately, as it's too big to validate.
+/* POSIX */
+#include <sys/uio.h> /* struct iovec */
+/* internal */
+#include "types.h" /* off_t, size_t, sized_buf, u64 */
+/* Passes arguments to write, calling it again to write the rest after a
+ * partial write or an interruption by a signal, until all ct bytes are
+ * written. If that worked, returns true. Otherwise, outputs a FAILED_WRITE
+ * error and returns false. If ct is more than SSIZE_MAX, it will print an
+ * error and return false immediately, as it's too big to validate.
  *
  * See write.3POSIX for more information on arguments. */
 bool write_obj(int fd, const void *buf, size_t ct);
 
+/* Like write_obj, but writes the iov_ct buffers in iov, in order, with as few
+ * calls to writev as possible - usually one. The entries in iov are changed to
+ * track what's left after a partial write. iov_ct must be at most 16, the
+ * smallest IOV_MAX that POSIX allows.
+ *
+ * See writev.3POSIX for more information on arguments. */
+bool writev_obj(int fd, struct iovec *iov, int iov_ct);
+
 /* Appends first bytes_sz of bytes to dst, reallocating dst as needed. */
 bool append_obj(sized_buf *dst, const void *bytes, size_t bytes_sz);
 
+/* Ensures dst has room for at least sz more bytes, reallocating it as needed,
+ * and returns a pointer to the start of that space. Bytes written there are
+ * not part of dst until they're passed to commit_obj, and the pointer is only
+ * valid until dst is next reallocated.
+ *
+ * Capacity grows geometrically, so reserving a large size up front and then
+ * filling it with many small commits is cheap. On failure, prints an error,
+ * frees dst->buf, sets dst to {0, 0, NULL}, and returns NULL. */
+void *reserve_obj(sized_buf *dst, size_t sz);
+
+/* Adds the next sz bytes reserved with reserve_obj to dst. */
+void commit_obj(sized_buf *dst, size_t sz);
+
 /* Reads the contents of fd into a sized_buf. If a read error occurs, frees
  * what's already been read, and sets the sized_buf to {0, 0, NULL}. */
 sized_buf read_to_sized_buf(int fd);
+
+/* Like read_to_sized_buf, but if fd is a non-empty regular file, it maps it
+ * into memory read-only instead of reading it. In that case, the capacity of
+ * the returned sized_buf is 0, as nothing can be appended to it.
+ *
+ * Either way, the caller must pass it to unmap_sized_buf when it's done with
+ * it, rather than calling mgr_free on its buf. */
+sized_buf map_to_sized_buf(int fd);
+
+/* Unmap or free the contents of a sized_buf returned by map_to_sized_buf. */
+void unmap_sized_buf(sized_buf *sb);
+
+/* Returns the number of nanoseconds since an arbitrary point in time, for
+ * measuring how long things take, or 0 if the time couldn't be read. */
+u64 time_ns(void);
 #endif /* EAMBFC_UTIL_H */
@@ -0,0 +1,9 @@
+/* generated header file with version information */
+#ifndef EAMBFC_VERSION_H
+#define EAMBFC_VERSION_H 1
+
+#define EAMBFC_VERSION "3.2.1"
+
+#define EAMBFC_COMMIT "git commit: 57b485b (with local changes)"
+
+#endif /* EAMBFC_VERSION_H */